@@ -13,6 +13,7 @@
 #include <chrono>
 #include <vector>
 #include <map>
+#include <algorithm>
 #include <cmath>
 #include <fstream>
 #include <sstream>
@@ -27,6 +28,8 @@
 #include <glm/gtx/quaternion.hpp>
 #include <glm/gtx/string_cast.hpp>
 
+#include "pose_blend.hpp"
+
 std::string to_string(std::string_view str)
 {
 	return std::string(str.begin(), str.end());
@@ -48,6 +51,7 @@ R"(#version 330 core
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+uniform mat4x3 bones[64];
 
 layout (location = 0) in vec3 in_position;
 layout (location = 1) in vec3 in_normal;
@@ -74,9 +78,13 @@ vec3 quat_rotate(vec4 q, vec3 v)
 
 void main()
 {
-	gl_Position = projection * view * model * vec4(in_position, 1.0);
-	position = (model * vec4(in_position, 1.0)).xyz;
-	normal = normalize((model * vec4(in_normal, 0.0)).xyz);
+	mat4x3 bone = bones[in_bone_id.x] * in_bone_weight.x + bones[in_bone_id.y] * in_bone_weight.y;
+	vec3 skinned_position = bone * vec4(in_position, 1.0);
+	vec3 skinned_normal = bone * vec4(in_normal, 0.0);
+
+	gl_Position = projection * view * model * vec4(skinned_position, 1.0);
+	position = (model * vec4(skinned_position, 1.0)).xyz;
+	normal = normalize((model * vec4(skinned_normal, 0.0)).xyz);
 }
 )";
 
@@ -162,20 +170,18 @@ struct bone
 	glm::quat rotation;
 };
 
-struct bone_pose
-{
-	glm::quat rotation = glm::quat(1.f, 0.f, 0.f, 0.f);
-	float scale = 1.f;
-	glm::vec3 translation = glm::vec3(0.f, 0.f, 0.f);
-};
-
-bone_pose operator * (bone_pose const & p1, bone_pose const & p2)
+int main(int argc, char ** argv) try
 {
-	return {p1.rotation * p2.rotation, p1.scale * p2.scale, p1.scale * glm::rotate(p1.rotation, p2.translation) + p1.translation};
-}
+	// --benchmark times blending a crowd of characters before the window opens
+	bool benchmark = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::string_view(argv[i]) == "--benchmark")
+			benchmark = true;
+		else
+			throw std::runtime_error("Unknown argument: " + std::string(argv[i]));
+	}
 
-int main() try
-{
 	if (SDL_Init(SDL_INIT_VIDEO) != 0)
 		sdl2_fail("SDL_Init: ");
 
@@ -226,6 +232,8 @@ int main() try
 	GLuint light_direction_location = glGetUniformLocation(program, "light_direction");
 	GLuint light_color_location = glGetUniformLocation(program, "light_color");
 
+	GLuint bones_location = glGetUniformLocation(program, "bones");
+
 	std::vector<vertex> vertices;
 	std::vector<std::uint32_t> indices;
 	std::vector<bone> bones;
@@ -263,6 +271,48 @@ int main() try
 
 	std::cout << "Loaded " << vertices.size() << " vertices, " << indices.size() << " indices, " << bones.size() << " bones" << std::endl;
 
+	std::vector<std::int32_t> bone_parents;
+	for (auto const & bone : bones)
+		bone_parents.push_back(bone.parent_id);
+
+	pose_set pose_data(bones.size());
+	for (auto const & pose : poses)
+		pose_data.add(pose);
+
+	pose_set blended_pose(bones.size());
+	std::vector<glm::mat4x3> bone_matrices;
+	std::vector<bone_pose> global_poses;
+
+	if (benchmark)
+	{
+		std::size_t const character_count = 100;
+		std::size_t const iterations = 100;
+
+		std::vector<float> character_weights(character_count * poses.size());
+		for (std::size_t c = 0; c < character_count; ++c)
+		{
+			float sum = 0.f;
+			for (std::size_t p = 0; p < poses.size(); ++p)
+				sum += character_weights[c * poses.size() + p] = 1.f + (c * 7 + p * 13) % 5;
+			for (std::size_t p = 0; p < poses.size(); ++p)
+				character_weights[c * poses.size() + p] /= sum;
+		}
+
+		auto start = std::chrono::high_resolution_clock::now();
+		for (std::size_t i = 0; i < iterations; ++i)
+		{
+			for (std::size_t c = 0; c < character_count; ++c)
+			{
+				blend_poses(pose_data, character_weights.data() + c * poses.size(), blended_pose);
+				compute_bone_matrices(blended_pose, bone_parents, bone_matrices, global_poses);
+			}
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+
+		float ms = std::chrono::duration_cast<std::chrono::duration<float, std::milli>>(end - start).count() / iterations;
+		std::cout << "Blending " << character_count << " characters x " << poses.size() << " poses: " << ms << " ms per frame" << std::endl;
+	}
+
 	GLuint vao, vbo, ebo;
 	glGenVertexArrays(1, &vao);
 	glBindVertexArray(vao);
@@ -290,6 +340,8 @@ int main() try
 
 	float time = 0.f;
 
+	std::vector<float> pose_weights(poses.size());
+
 	std::map<SDL_Keycode, bool> button_down;
 
 	float view_angle = 0.f;
@@ -360,10 +412,24 @@ int main() try
 
 		glm::vec3 camera_position = (glm::inverse(view) * glm::vec4(0.f, 0.f, 0.f, 1.f)).xyz();
 
+		// Cycle through the poses, blending each one with the next
+		std::fill(pose_weights.begin(), pose_weights.end(), 0.f);
+		{
+			float const phase = std::fmod(time, static_cast<float>(poses.size()));
+			std::size_t const current = static_cast<std::size_t>(phase);
+			float const t = phase - current;
+			pose_weights[current] += 1.f - t;
+			pose_weights[(current + 1) % poses.size()] += t;
+		}
+
+		blend_poses(pose_data, pose_weights.data(), blended_pose);
+		compute_bone_matrices(blended_pose, bone_parents, bone_matrices, global_poses);
+
 		glUseProgram(program);
 		glUniformMatrix4fv(model_location, 1, GL_FALSE, reinterpret_cast<float *>(&model));
 		glUniformMatrix4fv(view_location, 1, GL_FALSE, reinterpret_cast<float *>(&view));
 		glUniformMatrix4fv(projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&projection));
+		glUniformMatrix4x3fv(bones_location, bone_matrices.size(), GL_FALSE, reinterpret_cast<float *>(bone_matrices.data()));
 
 		glUniform3fv(camera_position_location, 1, (float*)(&camera_position));
 
@@ -0,0 +1,147 @@
+#include "pose_blend.hpp"
+
+#include <cassert>
+#include <cmath>
+
+pose_set::pose_set(std::size_t bone_count)
+	: bone_count(bone_count)
+{}
+
+void pose_set::resize(std::size_t pose_count)
+{
+	this->pose_count = pose_count;
+
+	std::size_t const size = pose_count * bone_count;
+	rw.resize(size, 1.f);
+	rx.resize(size, 0.f);
+	ry.resize(size, 0.f);
+	rz.resize(size, 0.f);
+	scale.resize(size, 1.f);
+	tx.resize(size, 0.f);
+	ty.resize(size, 0.f);
+	tz.resize(size, 0.f);
+}
+
+void pose_set::add(std::vector<bone_pose> const & pose)
+{
+	assert(pose.size() == bone_count);
+
+	std::size_t const offset = pose_count * bone_count;
+	resize(pose_count + 1);
+
+	for (std::size_t b = 0; b < bone_count; ++b)
+	{
+		rw[offset + b] = pose[b].rotation.w;
+		rx[offset + b] = pose[b].rotation.x;
+		ry[offset + b] = pose[b].rotation.y;
+		rz[offset + b] = pose[b].rotation.z;
+		scale[offset + b] = pose[b].scale;
+		tx[offset + b] = pose[b].translation.x;
+		ty[offset + b] = pose[b].translation.y;
+		tz[offset + b] = pose[b].translation.z;
+	}
+}
+
+bone_pose pose_set::get(std::size_t pose, std::size_t bone) const
+{
+	std::size_t const i = pose * bone_count + bone;
+	return {glm::quat(rw[i], rx[i], ry[i], rz[i]), scale[i], glm::vec3(tx[i], ty[i], tz[i])};
+}
+
+void blend_poses(pose_set const & poses, float const * weights, pose_set & result)
+{
+	std::size_t const n = poses.bone_count;
+
+	assert(poses.pose_count > 0);
+	assert(result.bone_count == n);
+	if (result.pose_count != 1)
+		result.resize(1);
+
+	float * __restrict rw = result.rw.data();
+	float * __restrict rx = result.rx.data();
+	float * __restrict ry = result.ry.data();
+	float * __restrict rz = result.rz.data();
+	float * __restrict s = result.scale.data();
+	float * __restrict tx = result.tx.data();
+	float * __restrict ty = result.ty.data();
+	float * __restrict tz = result.tz.data();
+
+	for (std::size_t b = 0; b < n; ++b)
+	{
+		rw[b] = rx[b] = ry[b] = rz[b] = 0.f;
+		s[b] = tx[b] = ty[b] = tz[b] = 0.f;
+	}
+
+	// Pose 0 is the reference hemisphere for every bone
+	float const * __restrict hw = poses.rw.data();
+	float const * __restrict hx = poses.rx.data();
+	float const * __restrict hy = poses.ry.data();
+	float const * __restrict hz = poses.rz.data();
+
+	for (std::size_t p = 0; p < poses.pose_count; ++p)
+	{
+		float const w = weights[p];
+		if (w == 0.f)
+			continue;
+
+		std::size_t const offset = p * n;
+		float const * __restrict pw = poses.rw.data() + offset;
+		float const * __restrict px = poses.rx.data() + offset;
+		float const * __restrict py = poses.ry.data() + offset;
+		float const * __restrict pz = poses.rz.data() + offset;
+		float const * __restrict ps = poses.scale.data() + offset;
+		float const * __restrict ptx = poses.tx.data() + offset;
+		float const * __restrict pty = poses.ty.data() + offset;
+		float const * __restrict ptz = poses.tz.data() + offset;
+
+		for (std::size_t b = 0; b < n; ++b)
+		{
+			float const dot = pw[b] * hw[b] + px[b] * hx[b] + py[b] * hy[b] + pz[b] * hz[b];
+			float const wq = (dot < 0.f) ? -w : w;
+
+			rw[b] += wq * pw[b];
+			rx[b] += wq * px[b];
+			ry[b] += wq * py[b];
+			rz[b] += wq * pz[b];
+
+			s[b] += w * ps[b];
+			tx[b] += w * ptx[b];
+			ty[b] += w * pty[b];
+			tz[b] += w * ptz[b];
+		}
+	}
+
+	for (std::size_t b = 0; b < n; ++b)
+	{
+		float const length_squared = rw[b] * rw[b] + rx[b] * rx[b] + ry[b] * ry[b] + rz[b] * rz[b];
+		float const inv_length = (length_squared > 0.f) ? 1.f / std::sqrt(length_squared) : 0.f;
+
+		rw[b] = (length_squared > 0.f) ? rw[b] * inv_length : 1.f;
+		rx[b] *= inv_length;
+		ry[b] *= inv_length;
+		rz[b] *= inv_length;
+	}
+}
+
+void compute_bone_matrices(pose_set const & local, std::vector<std::int32_t> const & parents, std::vector<glm::mat4x3> & result,
+	std::vector<bone_pose> & global_poses)
+{
+	std::size_t const n = local.bone_count;
+	assert(parents.size() == n);
+
+	global_poses.resize(n);
+	result.resize(n);
+
+	bone_pose * const global = global_poses.data();
+
+	for (std::size_t b = 0; b < n; ++b)
+	{
+		assert(parents[b] < static_cast<std::int32_t>(b));
+
+		bone_pose const pose = local.get(0, b);
+		global[b] = (parents[b] < 0) ? pose : global[parents[b]] * pose;
+
+		glm::mat3 const r = glm::mat3_cast(global[b].rotation) * global[b].scale;
+		result[b] = glm::mat4x3(r[0], r[1], r[2], global[b].translation);
+	}
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x3.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+struct bone_pose
+{
+	glm::quat rotation = glm::quat(1.f, 0.f, 0.f, 0.f);
+	float scale = 1.f;
+	glm::vec3 translation = glm::vec3(0.f, 0.f, 0.f);
+};
+
+inline bone_pose operator * (bone_pose const & p1, bone_pose const & p2)
+{
+	return {p1.rotation * p2.rotation, p1.scale * p2.scale, p1.scale * (p1.rotation * p2.translation) + p1.translation};
+}
+
+// A set of skeleton poses stored component-wise: the value for bone b
+// of pose p lives at index p * bone_count + b of each array
+struct pose_set
+{
+	std::size_t bone_count = 0;
+	std::size_t pose_count = 0;
+
+	std::vector<float> rw, rx, ry, rz;
+	std::vector<float> scale;
+	std::vector<float> tx, ty, tz;
+
+	explicit pose_set(std::size_t bone_count);
+
+	void resize(std::size_t pose_count);
+	void add(std::vector<bone_pose> const & pose);
+
+	bone_pose get(std::size_t pose, std::size_t bone) const;
+};
+
+// Blends all poses of the set with the given weights (one per pose) into
+// pose 0 of result. Rotations are accumulated as quaternions flipped into
+// the hemisphere of pose 0 and normalized; scale and translation are
+// weighted sums. Weights are expected to sum up to one.
+void blend_poses(pose_set const & poses, float const * weights, pose_set & result);
+
+// Composes local poses (pose 0 of the set) along the hierarchy and writes
+// the resulting bone transforms; parents must precede their children.
+// global_poses is scratch storage for the composed poses, owned by the
+// caller so that repeated calls don't allocate.
+void compute_bone_matrices(pose_set const & local, std::vector<std::int32_t> const & parents, std::vector<glm::mat4x3> & result,
+	std::vector<bone_pose> & global_poses);
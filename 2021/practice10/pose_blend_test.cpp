@@ -0,0 +1,178 @@
+#include "pose_blend.hpp"
+#include "check.hpp"
+
+#include <glm/geometric.hpp>
+
+#include <iostream>
+#include <random>
+#include <cmath>
+
+// Blends pairs of random poses and compares blend_poses with a two-pose
+// reference: nlerp of the rotations after flipping the second one into the
+// hemisphere of the first, which matches slerp at both ends and halfway,
+// and weighted sums of scale and translation. Also checks that rotations
+// do not depend on the sign of the stored quaternions or on the scale of
+// the weights.
+namespace
+{
+
+	std::size_t const bone_count = 19;
+
+	// q and -q are the same rotation
+	bool same_rotation(glm::quat const & a, glm::quat const & b, float tolerance = 1e-5f)
+	{
+		return std::abs(std::abs(glm::dot(a, b)) - 1.f) <= tolerance;
+	}
+
+	bool near(float a, float b, float tolerance = 1e-5f)
+	{
+		return std::abs(a - b) <= tolerance;
+	}
+
+	std::vector<bone_pose> random_pose(std::mt19937 & rng)
+	{
+		std::uniform_real_distribution<float> uniform(-1.f, 1.f);
+		std::uniform_real_distribution<float> positive(0.5f, 2.f);
+
+		std::vector<bone_pose> pose(bone_count);
+		for (auto & bone : pose)
+		{
+			bone.rotation = glm::normalize(glm::quat(uniform(rng), uniform(rng), uniform(rng), uniform(rng)));
+			bone.scale = positive(rng);
+			bone.translation = {uniform(rng), uniform(rng), uniform(rng)};
+		}
+		return pose;
+	}
+
+	bone_pose reference_blend(bone_pose const & a, bone_pose const & b, float t)
+	{
+		glm::quat const q = (glm::dot(a.rotation, b.rotation) < 0.f) ? -b.rotation : b.rotation;
+		return {glm::normalize(a.rotation * (1.f - t) + q * t), a.scale * (1.f - t) + b.scale * t, a.translation * (1.f - t) + b.translation * t};
+	}
+
+	void test_two_poses()
+	{
+		std::mt19937 rng(5);
+		pose_set result(bone_count);
+
+		for (int pair = 0; pair < 50; ++pair)
+		{
+			auto const a = random_pose(rng);
+			auto const b = random_pose(rng);
+
+			pose_set poses(bone_count);
+			poses.add(a);
+			poses.add(b);
+
+			for (float t : {0.f, 0.1f, 0.25f, 0.5f, 0.8f, 1.f})
+			{
+				float const weights[2] = {1.f - t, t};
+				blend_poses(poses, weights, result);
+				CHECK(result.pose_count == 1);
+
+				for (std::size_t bone = 0; bone < bone_count; ++bone)
+				{
+					bone_pose const actual = result.get(0, bone);
+					bone_pose const expected = reference_blend(a[bone], b[bone], t);
+
+					CHECK(near(glm::length(actual.rotation), 1.f));
+					CHECK(same_rotation(actual.rotation, expected.rotation));
+					CHECK(near(actual.scale, expected.scale));
+					CHECK(glm::length(actual.translation - expected.translation) <= 1e-5f);
+
+					// nlerp and slerp agree at both ends and halfway
+					if (t == 0.f || t == 0.5f || t == 1.f)
+						CHECK(same_rotation(actual.rotation, glm::slerp(a[bone].rotation, b[bone].rotation, t)));
+				}
+			}
+		}
+	}
+
+	void test_hemisphere()
+	{
+		std::mt19937 rng(7);
+		auto const a = random_pose(rng);
+		auto b = random_pose(rng);
+
+		pose_set poses(bone_count), negated(bone_count);
+		poses.add(a);
+		poses.add(b);
+
+		for (auto & bone : b)
+			bone.rotation = -bone.rotation;
+		negated.add(a);
+		negated.add(b);
+
+		// The stored sign of the second pose does not change the blend
+		float const weights[2] = {0.3f, 0.7f};
+		pose_set result(bone_count), negated_result(bone_count);
+		blend_poses(poses, weights, result);
+		blend_poses(negated, weights, negated_result);
+		for (std::size_t bone = 0; bone < bone_count; ++bone)
+			CHECK(same_rotation(result.get(0, bone).rotation, negated_result.get(0, bone).rotation));
+
+		// A rotation blended halfway with its own negation stays put instead of cancelling out
+		pose_set opposite(bone_count);
+		opposite.add(a);
+		for (std::size_t bone = 0; bone < bone_count; ++bone)
+			b[bone].rotation = -a[bone].rotation;
+		opposite.add(b);
+
+		float const halves[2] = {0.5f, 0.5f};
+		blend_poses(opposite, halves, result);
+		for (std::size_t bone = 0; bone < bone_count; ++bone)
+			CHECK(same_rotation(result.get(0, bone).rotation, a[bone].rotation));
+	}
+
+	void test_weights()
+	{
+		std::mt19937 rng(11);
+		pose_set poses(bone_count);
+		for (int p = 0; p < 4; ++p)
+			poses.add(random_pose(rng));
+
+		// Rotations are normalized, so scaling all weights leaves them unchanged
+		float const weights[4] = {0.1f, 0.2f, 0.3f, 0.4f};
+		float const scaled[4] = {0.3f, 0.6f, 0.9f, 1.2f};
+		pose_set result(bone_count), scaled_result(bone_count);
+		blend_poses(poses, weights, result);
+		blend_poses(poses, scaled, scaled_result);
+		for (std::size_t bone = 0; bone < bone_count; ++bone)
+		{
+			CHECK(same_rotation(result.get(0, bone).rotation, scaled_result.get(0, bone).rotation));
+			CHECK(near(3.f * result.get(0, bone).scale, scaled_result.get(0, bone).scale, 1e-4f));
+		}
+
+		// A single pose with all the weight comes out as it went in
+		float const single[4] = {0.f, 0.f, 1.f, 0.f};
+		blend_poses(poses, single, result);
+		for (std::size_t bone = 0; bone < bone_count; ++bone)
+		{
+			bone_pose const actual = result.get(0, bone);
+			bone_pose const expected = poses.get(2, bone);
+			CHECK(same_rotation(actual.rotation, expected.rotation));
+			CHECK(near(actual.scale, expected.scale));
+			CHECK(glm::length(actual.translation - expected.translation) <= 1e-6f);
+		}
+
+		// All weights zero give the identity rotation
+		float const none[4] = {};
+		blend_poses(poses, none, result);
+		for (std::size_t bone = 0; bone < bone_count; ++bone)
+			CHECK(same_rotation(result.get(0, bone).rotation, glm::quat(1.f, 0.f, 0.f, 0.f)));
+	}
+
+}
+
+int main() try
+{
+	test_two_poses();
+	test_hemisphere();
+	test_weights();
+	std::cout << "pose_blend: all checks passed" << std::endl;
+}
+catch (std::exception const & e)
+{
+	std::cerr << e.what() << std::endl;
+	return EXIT_FAILURE;
+}
@@ -26,6 +26,8 @@
 #include <glm/ext/scalar_constants.hpp>
 #include <glm/gtx/string_cast.hpp>
 
+#include "shadow_fitting.hpp"
+
 std::string to_string(std::string_view str)
 {
 	return std::string(str.begin(), str.end());
@@ -389,7 +391,32 @@ int main() try
 		std::ifstream bunny_file(PRACTICE_SOURCE_DIRECTORY "/bunny.obj");
 		std::tie(vertices, indices) = load_obj(bunny_file);
 	}
+
+	// The bunny and the ground plane are culled as separate shadow casters
+	struct shadow_caster
+	{
+		std::uint32_t first_index;
+		std::uint32_t index_count;
+	};
+
+	std::vector<shadow_caster> shadow_casters;
+	std::vector<shadow_box> shadow_boxes;
+	{
+		auto [ min, max ] = bbox(vertices);
+		shadow_casters.push_back({0, static_cast<std::uint32_t>(indices.size())});
+		shadow_boxes.push_back({min, max});
+	}
+
+	std::size_t const bunny_vertex_count = vertices.size();
 	add_ground_plane(vertices, indices);
+	{
+		auto [ min, max ] = bbox(std::vector<vertex>(vertices.begin() + bunny_vertex_count, vertices.end()));
+		shadow_casters.push_back({shadow_casters[0].index_count, static_cast<std::uint32_t>(indices.size()) - shadow_casters[0].index_count});
+		shadow_boxes.push_back({min, max});
+	}
+
+	float const shadow_size_step = glm::length(shadow_boxes[1].max - shadow_boxes[1].min) / 32.f;
+	shadow_setup shadow;
 	fill_normals(vertices, indices);
 
 	GLuint vao, vbo, ebo;
@@ -494,6 +521,21 @@ int main() try
 
 		glm::vec3 light_direction = glm::normalize(glm::vec3(std::cos(time * 0.5f), 1.f, std::sin(time * 0.5f)));
 
+		float near = 0.01f;
+		float far = 10.f;
+
+		glm::mat4 view(1.f);
+		view = glm::translate(view, {0.f, 0.f, -camera_distance});
+		view = glm::rotate(view, view_elevation, {1.f, 0.f, 0.f});
+		view = glm::rotate(view, view_azimuth, {0.f, 1.f, 0.f});
+		view = glm::translate(view, {0.f, -camera_target, 0.f});
+
+		glm::mat4 projection = glm::mat4(1.f);
+		projection = glm::perspective(glm::pi<float>() / 2.f, (1.f * width) / height, near, far);
+
+		fit_shadow(light_direction, projection * view, shadow_boxes, shadow_map_resolution, shadow_size_step, shadow);
+		glm::mat4 transform = shadow.transform;
+
 		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, shadow_fbo);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 		glViewport(0, 0, shadow_map_resolution, shadow_map_resolution);
@@ -504,25 +546,14 @@ int main() try
 		glEnable(GL_CULL_FACE);
 		glCullFace(GL_BACK);
 
-		glm::vec3 light_z = -light_direction;
-		glm::vec3 light_x = glm::normalize(glm::cross(light_z, {0.f, 1.f, 0.f}));
-		glm::vec3 light_y = glm::cross(light_x, light_z);
-		float shadow_scale = 2.f;
-
-		glm::mat4 transform = glm::mat4(1.f);
-		for (size_t i = 0; i < 3; ++i)
-		{
-			transform[i][0] = shadow_scale * light_x[i];
-			transform[i][1] = shadow_scale * light_y[i];
-			transform[i][2] = shadow_scale * light_z[i];
-		}
-
 		glUseProgram(shadow_program);
 		glUniformMatrix4fv(shadow_model_location, 1, GL_FALSE, reinterpret_cast<float *>(&model));
 		glUniformMatrix4fv(shadow_transform_location, 1, GL_FALSE, reinterpret_cast<float *>(&transform));
 
 		glBindVertexArray(vao);
-		glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, nullptr);
+		for (auto caster : shadow.casters)
+			glDrawElements(GL_TRIANGLES, shadow_casters[caster].index_count, GL_UNSIGNED_INT,
+				reinterpret_cast<void *>(shadow_casters[caster].first_index * sizeof(std::uint32_t)));
 
 		glBindTexture(GL_TEXTURE_2D, shadow_map);
 		glGenerateMipmap(GL_TEXTURE_2D);
@@ -539,18 +570,6 @@ int main() try
 		glEnable(GL_CULL_FACE);
 		glCullFace(GL_BACK);
 
-		float near = 0.01f;
-		float far = 10.f;
-
-		glm::mat4 view(1.f);
-		view = glm::translate(view, {0.f, 0.f, -camera_distance});
-		view = glm::rotate(view, view_elevation, {1.f, 0.f, 0.f});
-		view = glm::rotate(view, view_azimuth, {0.f, 1.f, 0.f});
-		view = glm::translate(view, {0.f, -camera_target, 0.f});
-
-		glm::mat4 projection = glm::mat4(1.f);
-		projection = glm::perspective(glm::pi<float>() / 2.f, (1.f * width) / height, near, far);
-
 		glBindTexture(GL_TEXTURE_2D, shadow_map);
 
 		glUseProgram(program);
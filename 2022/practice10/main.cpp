@@ -25,7 +25,8 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include "obj_parser.hpp"
-#include "stb_image.h"
+#include "texture_cache.hpp"
+#include "gl_texture_backend.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -249,23 +250,8 @@ std::pair<std::vector<vertex>, std::vector<std::uint32_t>> generate_sphere(float
     return {std::move(vertices), std::move(indices)};
 }
 
-GLuint load_texture(std::string const & path)
-{
-    int width, height, channels;
-    auto pixels = stbi_load(path.data(), &width, &height, &channels, 4);
-
-    GLuint result;
-    glGenTextures(1, &result);
-    glBindTexture(GL_TEXTURE_2D, result);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    stbi_image_free(pixels);
-
-    return result;
-}
+// Beyond this, the least recently bound textures are evicted
+constexpr std::size_t texture_budget = 256 << 20;
 
 int main() try
 {
@@ -356,9 +342,13 @@ int main() try
     glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (void *)offsetof(vertex, texcoords));
 
     std::string project_root = PROJECT_ROOT;
-    GLuint albedo_texture = load_texture(project_root + "/textures/brick_albedo.jpg");
-    GLuint normal_texture = load_texture(project_root + "/textures/brick_normal.jpg");
-    GLuint environment_map_texture = load_texture(project_root + "/textures/environment_map.jpg");
+
+    gl_texture_backend texture_backend;
+    texture_cache<gl_texture_backend> textures(texture_backend, texture_budget);
+    auto albedo_texture = textures.request(project_root + "/textures/brick_albedo.jpg");
+    auto normal_texture = textures.request(project_root + "/textures/brick_normal.jpg");
+    auto environment_map_texture = textures.request(project_root + "/textures/environment_map.jpg");
+    textures.finish();
 
     auto last_frame_start = std::chrono::high_resolution_clock::now();
 
@@ -413,6 +403,8 @@ int main() try
         if (button_down[SDLK_RIGHT])
             view_azimuth += 2.f * dt;
 
+        textures.update();
+
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         glEnable(GL_CULL_FACE);
@@ -447,7 +439,7 @@ int main() try
 
         glUniform1i(environment_map_texture_location_back, 2);
         glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, environment_map_texture);
+        glBindTexture(GL_TEXTURE_2D, textures.bind(environment_map_texture));
 
         glBindVertexArray(back_vao);
         glDrawArrays(GL_TRIANGLES, 0, 6);
@@ -465,17 +457,19 @@ int main() try
         glUniform1i(environment_map_texture_location, 2);
 
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, albedo_texture);
+        glBindTexture(GL_TEXTURE_2D, textures.bind(albedo_texture));
 
         glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, normal_texture);
+        glBindTexture(GL_TEXTURE_2D, textures.bind(normal_texture));
 
         glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, environment_map_texture);
+        glBindTexture(GL_TEXTURE_2D, textures.bind(environment_map_texture));
 
         glBindVertexArray(sphere_vao);
         glDrawElements(GL_TRIANGLES, sphere_index_count, GL_UNSIGNED_INT, nullptr);
 
+        textures.end_frame();
+
         SDL_GL_SwapWindow(window);
     }
 
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <GL/glew.h>
+
+// texture_cache backend for OpenGL 3.3: mipmapped RGBA8 2D textures with
+// trilinear filtering. Creating a texture changes the GL_TEXTURE_2D binding
+// of the active texture unit.
+struct gl_texture_backend
+{
+    GLuint create_texture(int width, int height, unsigned char const * rgba)
+    {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        return texture;
+    }
+
+    void delete_texture(GLuint texture)
+    {
+        glDeleteTextures(1, &texture);
+    }
+};
@@ -27,7 +27,9 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include "obj_parser.hpp"
-#include "stb_image.h"
+#include "texture_cache.hpp"
+#include "gl_texture_backend.hpp"
+#include "benchmark.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -44,23 +46,8 @@ void glew_fail(std::string_view message, GLenum error)
     throw std::runtime_error(to_string(message) + reinterpret_cast<const char *>(glewGetErrorString(error)));
 }
 
-GLuint load_texture(std::string const & path)
-{
-    int width, height, channels;
-    auto pixels = stbi_load(path.data(), &width, &height, &channels, 4);
-
-    GLuint result;
-    glGenTextures(1, &result);
-    glBindTexture(GL_TEXTURE_2D, result);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    stbi_image_free(pixels);
-
-    return result;
-}
+// Beyond this, the least recently bound textures are evicted
+constexpr std::size_t texture_budget = 256 << 20;
 
 const char vertex_shader_source[] =
 R"(#version 330 core
@@ -187,8 +174,64 @@ struct particle
     float angle_velocity;
 };
 
-int main() try
+void update_particles(std::vector<particle> & particles, std::default_random_engine & rng, float dt)
+{
+    if (particles.size() != 256) {
+        particle p;
+        p.position.x = std::uniform_real_distribution<float>{-1.f, 1.f}(rng);
+        p.position.y = 0.f;
+        p.position.z = std::uniform_real_distribution<float>{-1.f, 1.f}(rng);
+        p.size = (rand() % 11 / 10.0 / 5.0) + 0.2;
+        p.angle_velocity = std::uniform_real_distribution<float>{-5.f, 5.f}(rng);
+        particles.push_back(p);
+    }
+    for (auto & p : particles) {
+        p.velocity.y += dt * 10.f;
+        p.velocity *= exp(-dt * 10.f);
+        p.position += p.velocity * dt;
+        p.size *= exp(-dt * 2.f);
+        p.angle += p.angle_velocity * dt;
+
+        if (p.position.y > 1.f || p.size < 0.001f) {
+            p.position.x = std::uniform_real_distribution<float>{-1.f, 1.f}(rng);
+            p.position.y = 0.f;
+            p.position.z = std::uniform_real_distribution<float>{-1.f, 1.f}(rng);
+            p.size = (rand() % 11 / 10.0 / 5.0) + 0.2;
+            p.angle_velocity = std::uniform_real_distribution<float>{-5.f, 5.f}(rng);
+        }
+    }
+}
+
+int main(int argc, char ** argv) try
 {
+    auto const options = parse_benchmark_options(argc, argv);
+
+    // The particle update doesn't depend on the camera, so only time is replayed
+    if (!options.path.empty() || !options.record.empty())
+        throw std::runtime_error("Camera paths are not supported by this practice");
+
+    if (options.frames > 0)
+    {
+        std::default_random_engine rng;
+        std::vector<particle> particles;
+
+        benchmark_report report("practice11", options);
+        auto const update_stage = report.stage("particles");
+        auto const particle_counter = report.counter("particles");
+
+        for (std::size_t frame = 0; frame < options.frames; ++frame) {
+            report.time(update_stage, [&] {
+                update_particles(particles, rng, options.dt);
+            });
+            report.add(particle_counter, particles.size());
+            report.end_frame();
+        }
+
+        report.write(options.report);
+        std::cout << "Benchmark of " << report.frames() << " frames written to " << options.report << std::endl;
+        return EXIT_SUCCESS;
+    }
+
     if (SDL_Init(SDL_INIT_VIDEO) != 0)
         sdl2_fail("SDL_Init: ");
 
@@ -265,7 +308,11 @@ int main() try
 
     const std::string project_root = PROJECT_ROOT;
     const std::string particle_texture_path = project_root + "/particle.png";
-    GLuint particle_texture = load_texture(particle_texture_path);
+
+    gl_texture_backend texture_backend;
+    texture_cache<gl_texture_backend> textures(texture_backend, texture_budget);
+    auto particle_texture = textures.request(particle_texture_path);
+    textures.finish();
 
     std::vector<glm::vec4> tex_colors(3);
     tex_colors[2] = glm::vec4(1.f, 1.f, 1.f, 1.f);
@@ -341,32 +388,10 @@ int main() try
         if (button_down[SDLK_RIGHT])
             camera_rotation += 3.f * dt;
 
-        if (!paused) {
-            if (particles.size() != 256) {
-                particle p;
-                p.position.x = std::uniform_real_distribution<float>{-1.f, 1.f}(rng);
-                p.position.y = 0.f;
-                p.position.z = std::uniform_real_distribution<float>{-1.f, 1.f}(rng);
-                p.size = (rand() % 11 / 10.0 / 5.0) + 0.2;
-                p.angle_velocity = std::uniform_real_distribution<float>{-5.f, 5.f}(rng);
-                particles.push_back(p);
-            }
-            for (auto & p : particles) {
-                p.velocity.y += dt * 10.f;
-                p.velocity *= exp(-dt * 10.f);
-                p.position += p.velocity * dt;
-                p.size *= exp(-dt * 2.f);
-                p.angle += p.angle_velocity * dt;
-
-                if (p.position.y > 1.f || p.size < 0.001f) {
-                    p.position.x = std::uniform_real_distribution<float>{-1.f, 1.f}(rng);
-                    p.position.y = 0.f;
-                    p.position.z = std::uniform_real_distribution<float>{-1.f, 1.f}(rng);
-                    p.size = (rand() % 11 / 10.0 / 5.0) + 0.2;
-                    p.angle_velocity = std::uniform_real_distribution<float>{-5.f, 5.f}(rng);
-                }
-            }
-        }
+        if (!paused)
+            update_particles(particles, rng, dt);
+
+        textures.update();
 
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         //glEnable(GL_DEPTH_TEST);
@@ -400,12 +425,14 @@ int main() try
         glUniform1i(particle_color_location, 1);
 
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, particle_texture);
+        glBindTexture(GL_TEXTURE_2D, textures.bind(particle_texture));
         glActiveTexture(GL_TEXTURE1);
         glBindTexture(GL_TEXTURE_1D, color_texture);
         glBindVertexArray(vao);
         glDrawArrays(GL_POINTS, 0, particles.size());
 
+        textures.end_frame();
+
         SDL_GL_SwapWindow(window);
     }
 
@@ -0,0 +1,388 @@
+#pragma once
+
+#include "stb_image.h"
+
+#include <experimental/filesystem>
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+// Textures shared by path and by content, decoded on background threads and
+// kept within a byte budget.
+//
+// request() returns a handle right away and queues the file for a decoder
+// thread; update(), called once per frame on the rendering thread, uploads
+// what finished decoding. Paths are canonicalized, so different spellings of
+// one file share a handle, and files with identical contents (by a 64-bit
+// FNV-1a hash) share one texture; such duplicates are not even decoded while
+// their texture is resident.
+//
+// Resident sizes are estimated as RGBA8 with a full mip chain. When they add
+// up to more than the budget, the textures least recently passed to bind()
+// are deleted, except those bound in the current or the previous frame:
+// update() runs before the frame binds anything, so the previous frame stands
+// in for its working set, which can exceed the budget. An evicted texture is
+// decoded again the next time it is bound; until a texture is resident,
+// bind() returns 0. Files that fail to load stay non-resident, see failed().
+//
+// The backend performs the actual API calls on the rendering thread and must provide
+//     unsigned int create_texture(int width, int height, unsigned char const * rgba);
+//     void delete_texture(unsigned int texture);
+template <typename Backend>
+struct texture_cache
+{
+    using handle = std::uint32_t;
+
+    // Residency of one texture, shared by all handles with its contents
+    struct texture_statistics
+    {
+        // Estimated size while resident, 0 otherwise
+        std::size_t bytes = 0;
+        std::uint64_t uploads = 0;
+        std::uint64_t evictions = 0;
+        std::uint64_t binds = 0;
+        std::uint64_t resident_frames = 0;
+        std::uint64_t last_bound_frame = 0;
+    };
+
+    struct statistics
+    {
+        std::size_t resident_bytes = 0;
+        std::size_t peak_resident_bytes = 0;
+        std::size_t resident_textures = 0;
+        std::uint64_t requests = 0;
+        // Requests of an already known path
+        std::uint64_t path_hits = 0;
+        // Distinct paths whose contents matched a known texture
+        std::uint64_t content_hits = 0;
+        std::uint64_t decodes = 0;
+        std::uint64_t uploads = 0;
+        std::uint64_t evictions = 0;
+    };
+
+    texture_cache(Backend & backend, std::size_t budget_bytes, std::size_t decoder_count = 2)
+        : backend(backend)
+        , budget_bytes(budget_bytes)
+    {
+        for (std::size_t i = 0; i < std::max<std::size_t>(decoder_count, 1); ++i)
+            decoders.emplace_back(&texture_cache::decoder_loop, this);
+    }
+
+    ~texture_cache()
+    {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        job_condition.notify_all();
+        for (auto & decoder : decoders)
+            decoder.join();
+
+        for (auto const & texture : textures)
+            if (texture.name != 0)
+                backend.delete_texture(texture.name);
+    }
+
+    texture_cache(texture_cache const &) = delete;
+    texture_cache & operator = (texture_cache const &) = delete;
+
+    handle request(std::string const & path)
+    {
+        namespace fs = std::experimental::filesystem;
+
+        ++stats.requests;
+
+        fs::path canonical = fs::absolute(path);
+        std::error_code error;
+        if (auto resolved = fs::canonical(canonical, error); !error)
+            canonical = resolved;
+
+        auto [it, inserted] = by_path.emplace(canonical.string(), handle(entries.size()));
+        if (!inserted)
+        {
+            ++stats.path_hits;
+            return it->second;
+        }
+
+        entries.push_back({it->first});
+        enqueue(it->second);
+        return it->second;
+    }
+
+    // Uploads decoded textures and evicts down to the budget. Returns how many
+    // textures were created or deleted: either changes texture bindings
+    // behind the back of a state cache.
+    std::size_t update()
+    {
+        std::vector<decoded> finished;
+        {
+            std::lock_guard lock(mutex);
+            finished.swap(done);
+            stats.decodes = decodes;
+        }
+
+        std::size_t changes = 0;
+        for (auto & result : finished)
+        {
+            auto & entry = entries[result.entry];
+            entry.pending = false;
+
+            if (!result.hash)
+            {
+                entry.failed = true;
+                continue;
+            }
+
+            auto [it, inserted] = by_hash.emplace(*result.hash, std::uint32_t(textures.size()));
+            if (inserted)
+                textures.push_back({*result.hash, 0, 0, {}});
+
+            if (entry.texture != it->second)
+            {
+                if (textures[it->second].references++ > 0)
+                    ++stats.content_hits;
+                entry.texture = it->second;
+            }
+
+            auto & texture = textures[entry.texture];
+            if (texture.name != 0)
+                continue;
+
+            // Skipped as a duplicate of a texture evicted since
+            if (!result.pixels)
+            {
+                enqueue(result.entry);
+                continue;
+            }
+
+            texture.name = backend.create_texture(result.width, result.height, result.pixels.get());
+            texture.stats.bytes = std::size_t(result.width) * result.height * 4 * 4 / 3;
+            texture.stats.last_bound_frame = frame;
+            ++texture.stats.uploads;
+            ++stats.uploads;
+            ++stats.resident_textures;
+            stats.resident_bytes += texture.stats.bytes;
+            stats.peak_resident_bytes = std::max(stats.peak_resident_bytes, stats.resident_bytes);
+            ++changes;
+
+            std::lock_guard lock(mutex);
+            resident_hashes.insert(texture.hash);
+        }
+
+        return changes + evict();
+    }
+
+    // Marks the texture as used in this frame and returns its name, or 0 if
+    // it is not resident yet
+    unsigned int bind(handle h)
+    {
+        auto & entry = entries[h];
+        if (entry.texture != none)
+        {
+            auto & texture = textures[entry.texture];
+            ++texture.stats.binds;
+            texture.stats.last_bound_frame = frame;
+            if (texture.name != 0)
+                return texture.name;
+        }
+
+        if (!entry.pending && !entry.failed)
+            enqueue(h);
+        return 0;
+    }
+
+    // Blocks until every queued texture is decoded and uploaded; returns like update()
+    std::size_t finish()
+    {
+        std::size_t changes = 0;
+        while (true)
+        {
+            {
+                std::unique_lock lock(mutex);
+                done_condition.wait(lock, [this]{ return in_flight == 0; });
+            }
+            changes += update();
+
+            std::lock_guard lock(mutex);
+            if (in_flight == 0)
+                return changes;
+        }
+    }
+
+    void end_frame()
+    {
+        for (auto & texture : textures)
+            if (texture.name != 0)
+                ++texture.stats.resident_frames;
+        ++frame;
+    }
+
+    bool resident(handle h) const { return entries[h].texture != none && textures[entries[h].texture].name != 0; }
+    bool failed(handle h) const { return entries[h].failed; }
+    std::string const & path(handle h) const { return entries[h].path; }
+
+    // Empty until the texture was decoded once
+    texture_statistics residency(handle h) const
+    {
+        return entries[h].texture != none ? textures[entries[h].texture].stats : texture_statistics{};
+    }
+
+    statistics const & totals() const { return stats; }
+    std::size_t budget() const { return budget_bytes; }
+
+private:
+    static constexpr std::uint32_t none = std::uint32_t(-1);
+
+    struct entry
+    {
+        std::string path;
+        std::uint32_t texture = none;
+        bool pending = false;
+        bool failed = false;
+    };
+
+    struct texture
+    {
+        std::uint64_t hash;
+        unsigned int name = 0;
+        // Entries sharing the texture
+        std::size_t references = 0;
+        texture_statistics stats;
+    };
+
+    struct decoded
+    {
+        handle entry;
+        // Empty if the file could not be read or decoded
+        std::optional<std::uint64_t> hash;
+        int width = 0;
+        int height = 0;
+        // Null for files skipped as duplicates of a resident texture
+        std::unique_ptr<unsigned char, void (*)(void *)> pixels{nullptr, stbi_image_free};
+    };
+
+    void enqueue(handle h)
+    {
+        entries[h].pending = true;
+        {
+            std::lock_guard lock(mutex);
+            jobs.push_back({h, entries[h].path});
+            ++in_flight;
+        }
+        job_condition.notify_one();
+    }
+
+    std::size_t evict()
+    {
+        std::size_t evicted = 0;
+        while (stats.resident_bytes > budget_bytes)
+        {
+            // Linear scan, textures are few and eviction is rare
+            texture * victim = nullptr;
+            for (auto & candidate : textures)
+                if (candidate.name != 0 && candidate.stats.last_bound_frame + 1 < frame
+                    && (!victim || candidate.stats.last_bound_frame < victim->stats.last_bound_frame))
+                    victim = &candidate;
+
+            if (!victim)
+                break;
+
+            backend.delete_texture(victim->name);
+            victim->name = 0;
+            stats.resident_bytes -= victim->stats.bytes;
+            victim->stats.bytes = 0;
+            ++victim->stats.evictions;
+            ++stats.evictions;
+            --stats.resident_textures;
+            ++evicted;
+
+            std::lock_guard lock(mutex);
+            resident_hashes.erase(victim->hash);
+        }
+        return evicted;
+    }
+
+    void decoder_loop()
+    {
+        while (true)
+        {
+            std::pair<handle, std::string> job;
+            {
+                std::unique_lock lock(mutex);
+                job_condition.wait(lock, [this]{ return stopping || !jobs.empty(); });
+                if (stopping)
+                    return;
+
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+
+            decoded result;
+            result.entry = job.first;
+
+            std::ifstream file(job.second, std::ios::binary);
+            std::vector<unsigned char> const contents{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+
+            std::uint64_t hash = 14695981039346656037ull;
+            for (unsigned char c : contents)
+                hash = (hash ^ c) * 1099511628211ull;
+
+            bool duplicate;
+            {
+                std::lock_guard lock(mutex);
+                duplicate = resident_hashes.count(hash) > 0;
+            }
+
+            if (duplicate)
+                result.hash = hash;
+            else if (file && !contents.empty())
+            {
+                int channels;
+                result.pixels.reset(stbi_load_from_memory(contents.data(), int(contents.size()), &result.width, &result.height, &channels, 4));
+                if (result.pixels)
+                    result.hash = hash;
+            }
+
+            std::lock_guard lock(mutex);
+            if (!duplicate)
+                ++decodes;
+            done.push_back(std::move(result));
+            if (--in_flight == 0)
+                done_condition.notify_all();
+        }
+    }
+
+    Backend & backend;
+    std::size_t const budget_bytes;
+
+    std::vector<entry> entries;
+    std::unordered_map<std::string, handle> by_path;
+    std::vector<texture> textures;
+    std::unordered_map<std::uint64_t, std::uint32_t> by_hash;
+    std::uint64_t frame = 1;
+    statistics stats;
+
+    // Shared with the decoders
+    std::mutex mutex;
+    std::condition_variable job_condition;
+    std::condition_variable done_condition;
+    std::deque<std::pair<handle, std::string>> jobs;
+    std::vector<decoded> done;
+    std::unordered_set<std::uint64_t> resident_hashes;
+    std::size_t in_flight = 0;
+    std::uint64_t decodes = 0;
+    bool stopping = false;
+
+    std::vector<std::thread> decoders;
+};
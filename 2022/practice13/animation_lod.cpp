@@ -0,0 +1,93 @@
+#include "animation_lod.hpp"
+
+#include <glm/geometric.hpp>
+#include <glm/vec4.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+double animation_lod::statistics::saved_time() const
+{
+    if (evaluated_bones == 0)
+        return 0.0;
+    return evaluation_time / evaluated_bones * skipped_bones;
+}
+
+void animation_lod::set_skeleton(std::vector<std::uint32_t> const & parents)
+{
+    leaf_bones.assign(parents.size(), 1);
+    for (auto parent : parents)
+    {
+        if (parent != std::uint32_t(-1))
+            leaf_bones[parent] = 0;
+    }
+
+    leaf_bone_count = std::count(leaf_bones.begin(), leaf_bones.end(), 1);
+}
+
+void animation_lod::schedule(glm::mat4 const & view, glm::mat4 const & projection)
+{
+    glm::mat4 const m = glm::transpose(projection * view);
+
+    // Frustum planes in world space, pointing inwards
+    glm::vec4 const planes[6] = {
+        m[3] + m[0],
+        m[3] - m[0],
+        m[3] + m[1],
+        m[3] - m[1],
+        m[3] + m[2],
+        m[3] - m[2],
+    };
+
+    // projection[1][1] is cot(fovy / 2), so this maps view-space size to a fraction of the screen height
+    float const focal = projection[1][1] / 2.f;
+
+    std::size_t const bone_count = leaf_bones.size();
+
+    for (std::size_t i = 0; i < instances.size(); ++i)
+    {
+        auto & inst = instances[i];
+
+        inst.visible = true;
+        for (auto const & plane : planes)
+        {
+            float const distance = glm::dot(glm::vec3(plane), inst.center) + plane.w;
+            if (distance < -inst.radius * glm::length(glm::vec3(plane)))
+            {
+                inst.visible = false;
+                break;
+            }
+        }
+
+        float const depth = std::max(-(view * glm::vec4(inst.center, 1.f)).z, 1e-3f);
+        inst.screen_size = 2.f * inst.radius * focal / depth;
+
+        if (!inst.visible)
+        {
+            inst.update = false;
+            stats.skipped_bones += bone_count;
+            continue;
+        }
+
+        inst.update_interval = 1;
+        if (inst.screen_size < full_rate_screen_size)
+            inst.update_interval = std::min<std::uint32_t>(max_update_interval, std::ceil(full_rate_screen_size / inst.screen_size));
+
+        // Offset by the instance index, so that instances with the same interval update on different frames
+        inst.update = ((frame + i) % inst.update_interval) == 0;
+        inst.update_leaf_bones = inst.screen_size >= leaf_bone_screen_size;
+
+        if (!inst.update)
+            stats.skipped_bones += bone_count;
+        else if (!inst.update_leaf_bones)
+            stats.skipped_bones += leaf_bone_count;
+    }
+
+    ++frame;
+}
+
+void animation_lod::record_evaluation(std::size_t bones, double seconds)
+{
+    stats.evaluated_bones += bones;
+    stats.evaluation_time += seconds;
+}
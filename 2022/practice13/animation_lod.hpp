@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+// Decides which animated instances get their skeleton evaluated this frame.
+// Instances that are small on screen are updated every few frames, with the
+// updates of different instances spread over frames in round-robin; small
+// instances also skip leaf bones, and culled instances are paused.
+struct animation_lod
+{
+    struct instance
+    {
+        glm::vec3 center{0.f};
+        float radius = 1.f;
+
+        // Filled by schedule()
+        bool visible = true;
+        bool update = true;
+        bool update_leaf_bones = true;
+        std::uint32_t update_interval = 1;
+        float screen_size = 1.f;
+    };
+
+    struct statistics
+    {
+        std::uint64_t evaluated_bones = 0;
+        std::uint64_t skipped_bones = 0;
+        double evaluation_time = 0.0;
+
+        // Evaluation time that skipped bones would have cost, in seconds
+        double saved_time() const;
+    };
+
+    // Projected size (fraction of the screen height) at which an instance is updated every frame
+    float full_rate_screen_size = 0.25f;
+    std::uint32_t max_update_interval = 8;
+
+    // Leaf bones are skipped below this projected size
+    float leaf_bone_screen_size = 0.05f;
+
+    std::vector<instance> instances;
+
+    // Marks bones without children, given parent indices (-1 for roots)
+    void set_skeleton(std::vector<std::uint32_t> const & parents);
+
+    std::vector<std::uint8_t> leaf_bones;
+    std::size_t leaf_bone_count = 0;
+
+    void schedule(glm::mat4 const & view, glm::mat4 const & projection);
+
+    // Reports the cost of an evaluation requested by schedule()
+    void record_evaluation(std::size_t bones, double seconds);
+
+    statistics stats;
+    std::uint64_t frame = 0;
+};
@@ -0,0 +1,35 @@
+#include "gltf_loader.hpp"
+#include "vat_baker.hpp"
+
+#include <iostream>
+#include <stdexcept>
+
+int main(int argc, char ** argv) try
+{
+    const std::string project_root = PROJECT_ROOT;
+    const std::string model_path = project_root + "/wolf/Wolf-Blender-2.82a.gltf";
+
+    std::experimental::filesystem::path const output_directory = (argc > 1) ? argv[1] : ".";
+    float const frame_rate = 30.f;
+
+    auto const input_model = load_gltf(model_path);
+
+    for (auto const & [name, animation] : input_model.animations)
+    {
+        auto const baked = bake_animation(input_model, animation, frame_rate);
+        float const error = baked_animation_error(baked, input_model, animation);
+
+        auto const path = output_directory / (name + ".vat");
+        save_baked_animation(baked, path);
+
+        std::cout << name << ": " << baked.info.frame_count << " frames, "
+            << baked.info.width << "x" << baked.height() << "x2 texels, "
+            << baked.texels.size() * sizeof(baked.texels[0]) / 1024 << " KiB, max error " << error
+            << " -> " << path.string() << std::endl;
+    }
+}
+catch (std::exception const & e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
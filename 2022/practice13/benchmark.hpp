@@ -0,0 +1,111 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <map>
+#include <chrono>
+#include <cstdint>
+
+// Command line of a practice:
+//     --benchmark <frames>    run <frames> frames of CPU work without a window and write a report
+//     --dt <seconds>          fixed time step of the benchmark, 1/60 by default
+//     --path <file>           camera path to replay instead of the scripted one
+//     --report <file>         report file, benchmark.json by default
+//     --record <file>         record the camera path of an interactive run
+// followed by the options a practice adds, which also take one value each.
+struct benchmark_options
+{
+    // Zero for an interactive run
+    std::size_t frames = 0;
+    float dt = 1.f / 60.f;
+    std::string path;
+    std::string report = "benchmark.json";
+    std::string record;
+
+    // Values of the practice's own options that were given, by name with the dashes
+    std::map<std::string, std::string> extra;
+
+    std::string extra_value(std::string const & name, std::string const & fallback = {}) const;
+};
+
+// Description of a practice's own option, for the usage message
+struct benchmark_option
+{
+    std::string name;
+    std::string help;
+};
+
+// Throws on unknown or malformed arguments; extra_options are accepted in
+// addition to the common ones
+benchmark_options parse_benchmark_options(int argc, char ** argv, std::vector<benchmark_option> const & extra_options = {});
+
+// Keyframes of named camera parameters, interpolated linearly and looped.
+// Stored as text: a line of parameter names, then one line per keyframe with
+// the time followed by the values.
+struct camera_path
+{
+    explicit camera_path(std::vector<std::string> parameters);
+
+    // Throws if the file is malformed or its parameters differ from the expected ones
+    static camera_path load(std::string const & path, std::vector<std::string> const & expected_parameters);
+    void save(std::string const & path) const;
+
+    // Keyframe times must increase
+    void add(float time, std::vector<float> const & values);
+
+    std::vector<float> sample(float time) const;
+
+    float duration() const { return times.empty() ? 0.f : times.back(); }
+    std::vector<std::string> const & parameters() const { return names; }
+
+private:
+    std::vector<std::string> names;
+    std::vector<float> times;
+    // Keyframe values, names.size() per keyframe
+    std::vector<float> values;
+};
+
+// Per-frame CPU times of the stages of a benchmark run, written as JSON with
+// the mean and percentiles of every stage and of their per-frame sum, and the
+// per-frame mean of every counter
+struct benchmark_report
+{
+    benchmark_report(std::string name, benchmark_options const & options);
+
+    std::uint32_t stage(std::string const & name);
+    std::uint32_t counter(std::string const & name);
+
+    void record(std::uint32_t stage, float milliseconds) { current[stage] += milliseconds; }
+    void add(std::uint32_t counter, double value) { counter_totals[counter] += value; }
+
+    template <typename Work>
+    void time(std::uint32_t stage, Work && work)
+    {
+        auto const start = std::chrono::steady_clock::now();
+        work();
+        record(stage, std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    void end_frame();
+
+    std::size_t frames() const { return frame_count; }
+
+    // Throws if the file can't be written
+    void write(std::string const & path) const;
+
+private:
+    std::string name;
+    float dt;
+    std::string camera_path_source;
+    std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+
+    std::vector<std::string> stage_names;
+    std::vector<float> current;
+    // Per stage, one sample per frame
+    std::vector<std::vector<float>> samples;
+
+    std::vector<std::string> counter_names;
+    std::vector<double> counter_totals;
+
+    std::size_t frame_count = 0;
+};
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+
+// Test assertion that stays on in release builds: a failed check throws, and
+// the test's main reports it and returns EXIT_FAILURE
+#define CHECK(condition) \
+    ((condition) ? void() : throw std::runtime_error(std::string(__FILE__) + ":" + std::to_string(__LINE__) + ": check failed: " #condition))
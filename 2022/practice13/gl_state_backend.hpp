@@ -0,0 +1,50 @@
+#pragma once
+
+#include <GL/glew.h>
+
+// gl_state_cache backend issuing the OpenGL calls directly
+struct gl_state_backend
+{
+    void use_program(unsigned int program)
+    {
+        glUseProgram(program);
+    }
+
+    void bind_vertex_array(unsigned int vertex_array)
+    {
+        glBindVertexArray(vertex_array);
+    }
+
+    void active_texture(unsigned int unit)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+    }
+
+    void bind_texture(unsigned int target, unsigned int texture)
+    {
+        glBindTexture(target, texture);
+    }
+
+    void enable(unsigned int capability, bool enabled)
+    {
+        if (enabled)
+            glEnable(capability);
+        else
+            glDisable(capability);
+    }
+
+    void blend_func(unsigned int source, unsigned int destination)
+    {
+        glBlendFunc(source, destination);
+    }
+
+    void depth_mask(bool enabled)
+    {
+        glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+    }
+
+    void clear_color(float r, float g, float b, float a)
+    {
+        glClearColor(r, g, b, a);
+    }
+};
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <cstdint>
+#include <algorithm>
+
+// Shadow copy of the OpenGL state a frame touches: a call that would set
+// what is already set is skipped and counted as elided. State starts out
+// unknown, so the first call of every kind is issued.
+//
+// The cache only knows about changes made through it; after state is changed
+// directly (or objects are deleted and their names reused), call invalidate().
+// Element array buffer bindings belong to vertex arrays and are not cached.
+//
+// The backend performs the actual API calls and must provide
+//     void use_program(unsigned int program);
+//     void bind_vertex_array(unsigned int vertex_array);
+//     void active_texture(unsigned int unit);               // unit index, not GL_TEXTURE0 + unit
+//     void bind_texture(unsigned int target, unsigned int texture);
+//     void enable(unsigned int capability, bool enabled);
+//     void blend_func(unsigned int source, unsigned int destination);
+//     void depth_mask(bool enabled);
+//     void clear_color(float r, float g, float b, float a);
+template <typename Backend>
+struct gl_state_cache
+{
+    struct statistics
+    {
+        std::uint64_t issued = 0;
+        std::uint64_t elided = 0;
+    };
+
+    explicit gl_state_cache(Backend & backend)
+        : backend(backend)
+    {}
+
+    void use_program(unsigned int program)
+    {
+        if (update(current_program, program))
+            backend.use_program(program);
+    }
+
+    void bind_vertex_array(unsigned int vertex_array)
+    {
+        if (update(current_vertex_array, vertex_array))
+            backend.bind_vertex_array(vertex_array);
+    }
+
+    // Switches the active texture unit only if the binding changes
+    void bind_texture(unsigned int unit, unsigned int target, unsigned int texture)
+    {
+        auto it = std::find_if(textures.begin(), textures.end(), [&](texture_binding const & binding)
+        {
+            return binding.unit == unit && binding.target == target;
+        });
+        if (it == textures.end())
+            it = textures.insert(textures.end(), {unit, target, unknown});
+
+        if (!update(it->texture, texture))
+            return;
+
+        if (current_unit != unit)
+        {
+            current_unit = unit;
+            backend.active_texture(unit);
+            ++frame_stats.issued;
+        }
+        backend.bind_texture(target, texture);
+    }
+
+    void enable(unsigned int capability, bool enabled)
+    {
+        auto it = std::find_if(capabilities.begin(), capabilities.end(), [&](capability_state const & state)
+        {
+            return state.capability == capability;
+        });
+        if (it == capabilities.end())
+            it = capabilities.insert(capabilities.end(), {capability, unknown});
+
+        if (update(it->enabled, enabled))
+            backend.enable(capability, enabled);
+    }
+
+    void blend_func(unsigned int source, unsigned int destination)
+    {
+        if (update(current_blend_func, (std::uint64_t(source) << 32) | destination))
+            backend.blend_func(source, destination);
+    }
+
+    void depth_mask(bool enabled)
+    {
+        if (update(current_depth_mask, enabled))
+            backend.depth_mask(enabled);
+    }
+
+    void clear_color(float r, float g, float b, float a)
+    {
+        std::array<float, 4> const color{r, g, b, a};
+        if (known_clear_color && current_clear_color == color)
+        {
+            ++frame_stats.elided;
+            return;
+        }
+
+        known_clear_color = true;
+        current_clear_color = color;
+        ++frame_stats.issued;
+        backend.clear_color(r, g, b, a);
+    }
+
+    // Forgets all state, so that every next call is issued
+    void invalidate()
+    {
+        current_program = current_vertex_array = current_unit = unknown;
+        current_blend_func = current_depth_mask = unknown;
+        known_clear_color = false;
+        textures.clear();
+        capabilities.clear();
+    }
+
+    // Counters of the current frame, moved to last_frame by end_frame()
+    statistics const & frame() const { return frame_stats; }
+    statistics const & last_frame() const { return last_frame_stats; }
+
+    void end_frame()
+    {
+        last_frame_stats = frame_stats;
+        frame_stats = {};
+    }
+
+private:
+    static constexpr std::uint64_t unknown = std::uint64_t(-1);
+
+    struct texture_binding
+    {
+        unsigned int unit;
+        unsigned int target;
+        std::uint64_t texture;
+    };
+
+    struct capability_state
+    {
+        unsigned int capability;
+        std::uint64_t enabled;
+    };
+
+    // Returns whether the call has to be issued
+    template <typename T>
+    bool update(std::uint64_t & current, T value)
+    {
+        if (current == std::uint64_t(value))
+        {
+            ++frame_stats.elided;
+            return false;
+        }
+
+        current = value;
+        ++frame_stats.issued;
+        return true;
+    }
+
+    Backend & backend;
+
+    std::uint64_t current_program = unknown;
+    std::uint64_t current_vertex_array = unknown;
+    std::uint64_t current_unit = unknown;
+    std::uint64_t current_blend_func = unknown;
+    std::uint64_t current_depth_mask = unknown;
+    std::vector<texture_binding> textures;
+    std::vector<capability_state> capabilities;
+
+    bool known_clear_color = false;
+    std::array<float, 4> current_clear_color;
+
+    statistics frame_stats;
+    statistics last_frame_stats;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstdint>
+
+// stream_ring backend for an OpenGL 3.3 buffer object: segments are mapped
+// unsynchronized, since the ring's fences already guarantee they are free
+struct gl_stream_backend
+{
+    GLenum target;
+    GLuint buffer;
+
+    void * map(std::size_t offset, std::size_t size)
+    {
+        glBindBuffer(target, buffer);
+        return glMapBufferRange(target, offset, size,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_FLUSH_EXPLICIT_BIT);
+    }
+
+    void unmap(std::size_t flushed_size)
+    {
+        glBindBuffer(target, buffer);
+        if (flushed_size > 0)
+            glFlushMappedBufferRange(target, 0, flushed_size);
+        glUnmapBuffer(target);
+    }
+
+    GLsync insert_fence()
+    {
+        return glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    void wait_fence(GLsync fence)
+    {
+        GLenum result = glClientWaitSync(fence, 0, 0);
+        while (result == GL_TIMEOUT_EXPIRED)
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+    }
+
+    void delete_fence(GLsync fence)
+    {
+        glDeleteSync(fence);
+    }
+};
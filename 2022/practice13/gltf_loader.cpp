@@ -5,6 +5,7 @@
 
 #include <fstream>
 #include <stdexcept>
+#include <type_traits>
 
 static unsigned int attribute_type_to_size(std::string const & type)
 {
@@ -16,6 +17,14 @@ static unsigned int attribute_type_to_size(std::string const & type)
     throw std::runtime_error("Unknown attribute type: " + type);
 }
 
+static gltf_model::interpolation_type parse_interpolation(std::string const & interpolation)
+{
+    if (interpolation == "STEP") return gltf_model::interpolation_type::step;
+    if (interpolation == "LINEAR") return gltf_model::interpolation_type::linear;
+    if (interpolation == "CUBICSPLINE") return gltf_model::interpolation_type::cubic_spline;
+    throw std::runtime_error("Unknown interpolation: " + interpolation);
+}
+
 gltf_model load_gltf(std::experimental::filesystem::path const & path)
 {
     rapidjson::Document document;
@@ -181,21 +190,58 @@ gltf_model load_gltf(std::experimental::filesystem::path const & path)
                 auto input = parse_accessor(sampler["input"].GetInt());
                 auto output = parse_accessor(sampler["output"].GetInt());
 
+                auto const interpolation = sampler.HasMember("interpolation")
+                    ? parse_interpolation(sampler["interpolation"].GetString())
+                    : gltf_model::interpolation_type::linear;
+
+                auto fill_spline = [&](auto & spline)
+                {
+                    spline.interpolation = interpolation;
+                    fill_buffer(spline.timestamps, input);
+
+                    if (interpolation != gltf_model::interpolation_type::cubic_spline)
+                    {
+                        fill_buffer(spline.values, output);
+                        return;
+                    }
+
+                    // Cubic spline outputs are (in-tangent, value, out-tangent) triples
+                    using value_type = std::decay_t<decltype(spline.values[0])>;
+                    std::vector<value_type> triples;
+                    fill_buffer(triples, output);
+                    assert(triples.size() == 3 * spline.timestamps.size());
+
+                    std::vector<value_type> in_tangents, out_tangents;
+                    for (std::size_t k = 0; k < spline.timestamps.size(); ++k)
+                    {
+                        in_tangents.push_back(triples[3 * k + 0]);
+                        spline.values.push_back(triples[3 * k + 1]);
+                        out_tangents.push_back(triples[3 * k + 2]);
+                    }
+
+                    if constexpr (std::is_same_v<value_type, glm::quat>)
+                    {
+                        fix_rotations(in_tangents);
+                        fix_rotations(spline.values);
+                        fix_rotations(out_tangents);
+                    }
+
+                    spline.set_tangents(in_tangents, out_tangents);
+                };
+
                 if (path == "translation")
                 {
-                    fill_buffer(bone.translation.timestamps, input);
-                    fill_buffer(bone.translation.values, output);
+                    fill_spline(bone.translation);
                 }
                 else if (path == "rotation")
                 {
-                    fill_buffer(bone.rotation.timestamps, input);
-                    fill_buffer(bone.rotation.values, output);
-                    fix_rotations(bone.rotation.values);
+                    fill_spline(bone.rotation);
+                    if (interpolation != gltf_model::interpolation_type::cubic_spline)
+                        fix_rotations(bone.rotation.values);
                 }
                 else if (path == "scale")
                 {
-                    fill_buffer(bone.scale.timestamps, input);
-                    fill_buffer(bone.scale.values, output);
+                    fill_spline(bone.scale);
                 }
             }
 
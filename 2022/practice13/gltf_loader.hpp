@@ -45,11 +45,30 @@ struct gltf_model
         glm::mat4 inverse_bind_matrix;
     };
 
+    enum class interpolation_type
+    {
+        step,
+        linear,
+        cubic_spline,
+    };
+
     template <typename T>
     struct spline
     {
+        struct cubic_segment
+        {
+            // value(s) = values[i] + s * (c1 + s * (c2 + s * c3)), s in [0, 1]
+            T c1, c2, c3;
+        };
+
+        interpolation_type interpolation = interpolation_type::linear;
         std::vector<float> timestamps;
         std::vector<T> values;
+        std::vector<cubic_segment> segments;
+
+        // Converts per-key glTF tangents into polynomial coefficients, so that
+        // sampling a cubic spline costs the same as sampling a linear one
+        void set_tangents(std::vector<T> const & in_tangents, std::vector<T> const & out_tangents);
 
         T operator()(float time) const;
     };
@@ -89,36 +108,79 @@ struct gltf_model
 
 gltf_model load_gltf(std::experimental::filesystem::path const & path);
 
-template <>
-inline glm::vec3 gltf_model::spline<glm::vec3>::operator()(float time) const
+template <typename T>
+void gltf_model::spline<T>::set_tangents(std::vector<T> const & in_tangents, std::vector<T> const & out_tangents)
 {
-    assert(!values.empty());
+    assert(in_tangents.size() == values.size());
+    assert(out_tangents.size() == values.size());
 
-    auto it = std::lower_bound(timestamps.begin(), timestamps.end(), time);
-    if (it == timestamps.begin())
-        return values.back();
-    if (it == timestamps.end())
-        return values.back();
+    segments.resize(values.size() > 0 ? values.size() - 1 : 0);
+    for (std::size_t i = 0; i < segments.size(); ++i)
+    {
+        float const dt = timestamps[i + 1] - timestamps[i];
 
-    int i = it - timestamps.begin();
+        T const p0 = values[i];
+        T const p1 = values[i + 1];
+        T const m0 = out_tangents[i] * dt;
+        T const m1 = in_tangents[i + 1] * dt;
+
+        segments[i].c1 = m0;
+        segments[i].c2 = p0 * (-3.f) + m0 * (-2.f) + p1 * 3.f - m1;
+        segments[i].c3 = p0 * 2.f + m0 - p1 * 2.f + m1;
+    }
+}
+
+inline glm::vec3 spline_mix(glm::vec3 const & v0, glm::vec3 const & v1, float t)
+{
+    return glm::lerp(v0, v1, t);
+}
+
+inline glm::quat spline_mix(glm::quat const & v0, glm::quat const & v1, float t)
+{
+    return glm::slerp(v0, v1, t);
+}
+
+inline glm::vec3 spline_normalize(glm::vec3 const & v)
+{
+    return v;
+}
 
-    float t = (time - timestamps[i - 1]) / (timestamps[i] - timestamps[i - 1]);
-    return glm::lerp(values[i - 1], values[i], t);
+inline glm::quat spline_normalize(glm::quat const & v)
+{
+    return glm::normalize(v);
 }
 
-template <>
-inline glm::quat gltf_model::spline<glm::quat>::operator()(float time) const
+template <typename T>
+T gltf_model::spline<T>::operator()(float time) const
 {
     assert(!values.empty());
 
-    auto it = std::lower_bound(timestamps.begin(), timestamps.end(), time);
-    if (it == timestamps.begin())
-        return values.back();
+    if (time <= timestamps.front())
+        return values.front();
+
+    auto it = std::upper_bound(timestamps.begin(), timestamps.end(), time);
     if (it == timestamps.end())
         return values.back();
 
     int i = it - timestamps.begin();
 
-    float t = (time - timestamps[i - 1]) / (timestamps[i] - timestamps[i - 1]);
-    return glm::slerp(values[i - 1], values[i], t);
+    switch (interpolation)
+    {
+    case interpolation_type::step:
+        return values[i - 1];
+    case interpolation_type::cubic_spline:
+    {
+        assert(segments.size() + 1 == values.size());
+
+        float s = (time - timestamps[i - 1]) / (timestamps[i] - timestamps[i - 1]);
+        auto const & c = segments[i - 1];
+        return spline_normalize(values[i - 1] + (c.c1 + (c.c2 + c.c3 * s) * s) * s);
+    }
+    case interpolation_type::linear:
+    default:
+    {
+        float t = (time - timestamps[i - 1]) / (timestamps[i] - timestamps[i - 1]);
+        return spline_mix(values[i - 1], values[i], t);
+    }
+    }
 }
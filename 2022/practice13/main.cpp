@@ -16,11 +16,16 @@
 #include <random>
 #include <map>
 #include <cmath>
+#include <limits>
+#include <optional>
+#include <algorithm>
+#include <cstring>
 
 #define GLM_FORCE_SWIZZLE
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/vec3.hpp>
 #include <glm/mat4x4.hpp>
+#include <glm/mat3x4.hpp>
 #include <glm/ext/matrix_transform.hpp>
 #include <glm/ext/matrix_clip_space.hpp>
 #include <glm/ext/scalar_constants.hpp>
@@ -28,7 +33,17 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include "gltf_loader.hpp"
-#include "stb_image.h"
+#include "transform_hierarchy.hpp"
+#include "animation_lod.hpp"
+#include "benchmark.hpp"
+#include "render_queue.hpp"
+#include "gl_state_cache.hpp"
+#include "gl_state_backend.hpp"
+#include "stream_ring.hpp"
+#include "gl_stream_backend.hpp"
+#include "std140.hpp"
+#include "texture_cache.hpp"
+#include "gl_texture_backend.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -45,13 +60,21 @@ void glew_fail(std::string_view message, GLenum error)
     throw std::runtime_error(to_string(message) + reinterpret_cast<const char *>(glewGetErrorString(error)));
 }
 
-const char vertex_shader_source[] =
+constexpr char vertex_shader_source[] =
 R"(#version 330 core
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform mat4x3 bones[64];
+layout (std140) uniform Frame
+{
+    mat4 view;
+    mat4 projection;
+    vec3 light_direction;
+};
+
+layout (std140, row_major) uniform Skeleton
+{
+    mat4 model;
+    mat4x3 bones[64];
+};
 
 layout (location = 0) in vec3 in_position;
 layout (location = 1) in vec3 in_normal;
@@ -78,14 +101,23 @@ void main()
 }
 )";
 
-const char fragment_shader_source[] =
+constexpr char fragment_shader_source[] =
 R"(#version 330 core
 
-uniform sampler2D albedo;
-uniform vec4 color;
-uniform int use_texture;
+layout (std140) uniform Frame
+{
+    mat4 view;
+    mat4 projection;
+    vec3 light_direction;
+};
 
-uniform vec3 light_direction;
+layout (std140) uniform Material
+{
+    vec4 color;
+    int use_texture;
+};
+
+uniform sampler2D albedo;
 
 layout (location = 0) out vec4 out_color;
 
@@ -110,6 +142,51 @@ void main()
 }
 )";
 
+// Mirrors of the uniform blocks, checked against the shader sources at compile time
+
+struct frame_uniforms
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec3 light_direction;
+    float padding;
+};
+
+// The block is row_major, so matrices are stored transposed: bones are mat4x3
+// in the shader and three rows of four floats here
+struct skeleton_uniforms
+{
+    glm::mat4 model;
+    glm::mat3x4 bones[64];
+};
+
+struct material_uniforms
+{
+    glm::vec4 color;
+    std::int32_t use_texture;
+    std::int32_t padding[3];
+};
+
+STD140_CHECK_MEMBER(vertex_shader_source, "Frame", frame_uniforms, view);
+STD140_CHECK_MEMBER(vertex_shader_source, "Frame", frame_uniforms, projection);
+STD140_CHECK_MEMBER(vertex_shader_source, "Frame", frame_uniforms, light_direction);
+STD140_CHECK_SIZE(vertex_shader_source, "Frame", frame_uniforms);
+STD140_CHECK_SIZE(fragment_shader_source, "Frame", frame_uniforms);
+STD140_CHECK_MEMBER(vertex_shader_source, "Skeleton", skeleton_uniforms, model);
+STD140_CHECK_MEMBER(vertex_shader_source, "Skeleton", skeleton_uniforms, bones);
+STD140_CHECK_SIZE(vertex_shader_source, "Skeleton", skeleton_uniforms);
+STD140_CHECK_MEMBER(fragment_shader_source, "Material", material_uniforms, color);
+STD140_CHECK_MEMBER(fragment_shader_source, "Material", material_uniforms, use_texture);
+STD140_CHECK_SIZE(fragment_shader_source, "Material", material_uniforms);
+
+// Uniform buffer binding points of the blocks
+constexpr GLuint frame_binding = 0;
+constexpr GLuint skeleton_binding = 1;
+constexpr GLuint material_binding = 2;
+
+// Beyond this, the least recently bound textures are evicted
+constexpr std::size_t texture_budget = 256 << 20;
+
 GLuint create_shader(GLenum type, const char * source)
 {
     GLuint result = glCreateShader(type);
@@ -149,8 +226,215 @@ GLuint create_program(Shaders ... shaders)
     return result;
 }
 
-int main() try
+std::vector<std::string> const camera_parameters{"distance", "rotation", "view_angle", "interpolation"};
+
+float const camera_height = 0.25f;
+
+// An orbit around the wolf that moves out far enough to slow its animation down, blending from running to walking and back, 10 seconds long
+camera_path scripted_camera_path()
 {
+    camera_path result(camera_parameters);
+    for (int key = 0; key <= 100; ++key) {
+        float const t = key / 10.f;
+        float const phase = glm::pi<float>() * t / 10.f;
+        result.add(t, {0.75f + 6.f * std::sin(phase), glm::pi<float>() * (-1.f / 3.f + t / 5.f), glm::pi<float>() / 8.f, std::abs(std::cos(phase))});
+    }
+    return result;
+}
+
+int main(int argc, char ** argv) try
+{
+    auto const options = parse_benchmark_options(argc, argv);
+
+    const std::string project_root = PROJECT_ROOT;
+    const std::string model_path = project_root + "/wolf/Wolf-Blender-2.82a.gltf";
+
+    auto const input_model = load_gltf(model_path);
+
+    std::vector<std::uint32_t> bone_parents;
+    for (auto const & bone : input_model.bones)
+        bone_parents.push_back(bone.parent);
+
+    transform_hierarchy skeleton(bone_parents);
+
+    animation_lod lod;
+    lod.set_skeleton(bone_parents);
+    {
+        glm::vec3 min(std::numeric_limits<float>::infinity());
+        glm::vec3 max(-std::numeric_limits<float>::infinity());
+        for (auto const & mesh : input_model.meshes)
+        {
+            auto begin = reinterpret_cast<glm::vec3 const *>(input_model.buffer.data() + mesh.position.view.offset);
+            for (auto it = begin; it != begin + mesh.position.count; ++it)
+            {
+                min = glm::min(min, *it);
+                max = glm::max(max, *it);
+            }
+        }
+
+        auto & wolf = lod.instances.emplace_back();
+        wolf.center = (min + max) / 2.f;
+        wolf.radius = glm::length(max - min) / 2.f;
+    }
+
+    // What the render queue sorts meshes by: dense ids of their textures and
+    // colors, and the centers of their bind poses for depth
+    std::vector<std::string> texture_paths;
+    std::vector<glm::vec4> colors;
+
+    struct draw_state
+    {
+        render_queue::pass pass;
+        bool two_sided;
+        // 1 + index into texture_paths, 0 for untextured meshes
+        std::uint32_t texture;
+        // 1 + index into colors for untextured meshes, 0 for textured ones
+        std::uint32_t color;
+        glm::vec3 center;
+    };
+
+    // Per mesh of input_model, empty for meshes with neither a texture nor a color
+    std::vector<std::optional<draw_state>> draw_states;
+    for (auto const & mesh : input_model.meshes)
+    {
+        auto const & material = mesh.material;
+        if (!material.texture_path && !material.color)
+        {
+            draw_states.emplace_back();
+            continue;
+        }
+
+        auto & state = draw_states.emplace_back(draw_state{material.transparent ? render_queue::transparent : render_queue::opaque, material.two_sided, 0, 0, glm::vec3(0.f)});
+
+        if (material.texture_path)
+        {
+            auto it = std::find(texture_paths.begin(), texture_paths.end(), *material.texture_path);
+            if (it == texture_paths.end())
+                it = texture_paths.insert(it, *material.texture_path);
+            state->texture = 1 + (it - texture_paths.begin());
+        }
+        else
+        {
+            auto it = std::find(colors.begin(), colors.end(), *material.color);
+            if (it == colors.end())
+                it = colors.insert(it, *material.color);
+            state->color = 1 + (it - colors.begin());
+        }
+
+        glm::vec3 min(std::numeric_limits<float>::infinity());
+        glm::vec3 max(-std::numeric_limits<float>::infinity());
+        auto begin = reinterpret_cast<glm::vec3 const *>(input_model.buffer.data() + mesh.position.view.offset);
+        for (auto it = begin; it != begin + mesh.position.count; ++it)
+        {
+            min = glm::min(min, *it);
+            max = glm::max(max, *it);
+        }
+        state->center = (min + max) / 2.f;
+    }
+
+    render_queue queue;
+
+    // Fills the queue with the drawn meshes and sorts it
+    auto queue_meshes = [&](glm::mat4 const & view)
+    {
+        queue.clear();
+        for (std::uint32_t i = 0; i < draw_states.size(); ++i)
+        {
+            if (auto const & state = draw_states[i])
+                queue.push(state->pass, state->two_sided, state->texture, state->color, -(view * glm::vec4(state->center, 1.f)).z, i);
+        }
+        queue.sort();
+    };
+
+    std::vector<glm::mat4x3> bones(input_model.bones.size(), glm::mat4x3(1.f));
+
+    // Schedules and evaluates the skeleton of the wolf for a frame
+    auto animate = [&](glm::mat4 const & view, glm::mat4 const & projection, float time, float interpolation)
+    {
+        const gltf_model::animation& run_animation = input_model.animations.at("01_Run");
+        const gltf_model::animation& walk_animation = input_model.animations.at("02_walk");
+
+        lod.schedule(view, projection);
+
+        if (auto const & wolf = lod.instances[0]; wolf.update)
+        {
+            auto evaluation_start = std::chrono::high_resolution_clock::now();
+            std::size_t evaluated_bones = 0;
+
+            for (int i = 0; i < bones.size(); i++) {
+                if (!wolf.update_leaf_bones && lod.leaf_bones[i])
+                    continue;
+
+                auto translation_prep =
+                        glm::lerp(run_animation.bones[i].translation(std::fmod(time, run_animation.max_time)),
+                                  walk_animation.bones[i].translation(std::fmod(time, walk_animation.max_time)),
+                                  interpolation);
+                auto rotation_prep =
+                        glm::slerp(run_animation.bones[i].rotation(std::fmod(time, run_animation.max_time)),
+                                   walk_animation.bones[i].rotation(std::fmod(time, walk_animation.max_time)),
+                                   interpolation);
+                auto scale_prep =
+                        glm::lerp(run_animation.bones[i].scale(std::fmod(time, run_animation.max_time)),
+                                  walk_animation.bones[i].scale(std::fmod(time, walk_animation.max_time)),
+                                  interpolation);
+                skeleton.set_local(i, translation_prep, rotation_prep, scale_prep);
+                ++evaluated_bones;
+            }
+
+            skeleton.update();
+
+            for (int i = 0; i < bones.size(); i++) {
+                bones[i] = glm::mat4(skeleton.world(i)) * input_model.bones[i].inverse_bind_matrix;
+            }
+
+            lod.record_evaluation(evaluated_bones, std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - evaluation_start).count());
+        }
+    };
+
+    if (options.frames > 0)
+    {
+        camera_path const path = options.path.empty() ? scripted_camera_path() : camera_path::load(options.path, camera_parameters);
+
+        benchmark_report report("practice13", options);
+        auto const animation_stage = report.stage("animation");
+        auto const queue_stage = report.stage("render queue");
+        auto const bone_counter = report.counter("evaluated bones");
+        auto const interval_counter = report.counter("update interval");
+
+        // Viewport of the benchmark, in place of the window
+        int const width = 1920, height = 1080;
+
+        for (std::size_t frame = 0; frame < options.frames; ++frame) {
+            float const time = frame * options.dt;
+            auto const camera = path.sample(time);
+
+            glm::mat4 view(1.f);
+            view = glm::translate(view, {0.f, 0.f, -camera[0]});
+            view = glm::rotate(view, camera[2], {1.f, 0.f, 0.f});
+            view = glm::rotate(view, camera[1], {0.f, 1.f, 0.f});
+            view = glm::translate(view, {0.f, -camera_height, 0.f});
+
+            glm::mat4 projection = glm::perspective(glm::pi<float>() / 2.f, (1.f * width) / height, 0.1f, 100.f);
+
+            std::uint64_t const evaluated_bones = lod.stats.evaluated_bones;
+            report.time(animation_stage, [&] {
+                animate(view, projection, time, camera[3]);
+            });
+
+            report.time(queue_stage, [&] {
+                queue_meshes(view);
+            });
+
+            report.add(bone_counter, lod.stats.evaluated_bones - evaluated_bones);
+            report.add(interval_counter, lod.instances[0].update_interval);
+            report.end_frame();
+        }
+
+        report.write(options.report);
+        std::cout << "Benchmark of " << report.frames() << " frames written to " << options.report << std::endl;
+        return EXIT_SUCCESS;
+    }
+
     if (SDL_Init(SDL_INIT_VIDEO) != 0)
         sdl2_fail("SDL_Init: ");
 
@@ -191,19 +475,12 @@ int main() try
     auto fragment_shader = create_shader(GL_FRAGMENT_SHADER, fragment_shader_source);
     auto program = create_program(vertex_shader, fragment_shader);
 
-    GLuint model_location = glGetUniformLocation(program, "model");
-    GLuint view_location = glGetUniformLocation(program, "view");
-    GLuint projection_location = glGetUniformLocation(program, "projection");
     GLuint albedo_location = glGetUniformLocation(program, "albedo");
-    GLuint color_location = glGetUniformLocation(program, "color");
-    GLuint use_texture_location = glGetUniformLocation(program, "use_texture");
-    GLuint light_direction_location = glGetUniformLocation(program, "light_direction");
-    GLuint bones_location = glGetUniformLocation(program, "bones");
 
-    const std::string project_root = PROJECT_ROOT;
-    const std::string model_path = project_root + "/wolf/Wolf-Blender-2.82a.gltf";
+    glUniformBlockBinding(program, glGetUniformBlockIndex(program, "Frame"), frame_binding);
+    glUniformBlockBinding(program, glGetUniformBlockIndex(program, "Skeleton"), skeleton_binding);
+    glUniformBlockBinding(program, glGetUniformBlockIndex(program, "Material"), material_binding);
 
-    auto const input_model = load_gltf(model_path);
     GLuint vbo;
     glGenBuffers(1, &vbo);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
@@ -244,30 +521,49 @@ int main() try
         result.material = mesh.material;
     }
 
-    std::map<std::string, GLuint> textures;
-    for (auto const & mesh : meshes)
+    // Textures decode in the background while the rest of the setup runs
+    gl_texture_backend texture_backend;
+    texture_cache<gl_texture_backend> textures(texture_backend, texture_budget);
+
+    // Indexed by the texture ids of draw_states, minus one
+    std::vector<texture_cache<gl_texture_backend>::handle> texture_handles;
+    for (auto const & texture_path : texture_paths)
+        texture_handles.push_back(textures.request((std::experimental::filesystem::path(model_path).parent_path() / texture_path).string()));
+
+    if (input_model.bones.size() > std::size(skeleton_uniforms{}.bones))
+        throw std::runtime_error("Too many bones for the Skeleton uniform block");
+
+    // All uniforms of a frame are packed into one segment of a uniform buffer
+    // ring, mapped once per frame, and bound by offset: the frame and skeleton
+    // blocks once, a material block whenever the material changes between draws
+    GLint uniform_alignment;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniform_alignment);
+
+    auto aligned_size = [&](std::size_t size)
     {
-        if (!mesh.material.texture_path) continue;
-        if (textures.count(*mesh.material.texture_path) > 0) continue;
+        return (size + uniform_alignment - 1) / uniform_alignment * uniform_alignment;
+    };
 
-        auto path = std::experimental::filesystem::path(model_path).parent_path() / *mesh.material.texture_path;
+    GLuint uniform_buffer;
+    glGenBuffers(1, &uniform_buffer);
 
-        int width, height, channels;
-        auto data = stbi_load(path.c_str(), &width, &height, &channels, 4);
-        assert(data);
+    gl_stream_backend uniform_backend{GL_UNIFORM_BUFFER, uniform_buffer};
+    stream_ring<gl_stream_backend> uniform_ring(uniform_backend,
+        aligned_size(sizeof(frame_uniforms)) + aligned_size(sizeof(skeleton_uniforms)) + meshes.size() * aligned_size(sizeof(material_uniforms)));
 
-        GLuint texture;
-        glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+    glBindBuffer(GL_UNIFORM_BUFFER, uniform_buffer);
+    glBufferData(GL_UNIFORM_BUFFER, uniform_ring.buffer_size(), nullptr, GL_STREAM_DRAW);
 
-        stbi_image_free(data);
+    // Offsets of the material blocks of the queued draws
+    std::vector<std::size_t> material_offsets;
 
-        textures[*mesh.material.texture_path] = texture;
-    }
+    float lod_report_time = 0.f;
+
+    // Per-frame state of the loop goes through the cache; setup above binds directly
+    gl_state_backend state_backend;
+    gl_state_cache<gl_state_backend> state(state_backend);
+
+    textures.finish();
 
     auto last_frame_start = std::chrono::high_resolution_clock::now();
 
@@ -281,10 +577,12 @@ int main() try
     float camera_distance = 0.75f;
 
     float camera_rotation = glm::pi<float>() * (- 1.f / 3.f);
-    float camera_height = 0.25f;
 
     bool paused = false;
 
+    camera_path recorded_path(camera_parameters);
+    float recorded_time = 0.f;
+
     bool running = true;
     while (running)
     {
@@ -344,12 +642,21 @@ int main() try
         interpolation = std::min(interpolation, 1.f);
         interpolation = std::max(interpolation, 0.f);
 
-        glClearColor(0.8f, 0.8f, 1.f, 0.f);
+        if (!options.record.empty() && dt > 0.f) {
+            recorded_time += dt;
+            recorded_path.add(recorded_time, {camera_distance, camera_rotation, view_angle, interpolation});
+        }
+
+        // Uploads and evictions bind and delete textures behind the state cache
+        if (textures.update() > 0)
+            state.invalidate();
+
+        state.clear_color(0.8f, 0.8f, 1.f, 0.f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        glEnable(GL_DEPTH_TEST);
+        state.enable(GL_DEPTH_TEST, true);
 
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        state.blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
         float near = 0.1f;
         float far = 100.f;
@@ -368,92 +675,101 @@ int main() try
 
         glm::vec3 light_direction = glm::normalize(glm::vec3(1.f, 2.f, 3.f));
 
-        float scale = 0.75 + cos(time) * 0.25;
-        std::vector<glm::mat4x3> bones(input_model.bones.size(), glm::mat4x3(scale));
-        const gltf_model::animation& run_animation = input_model.animations.at("01_Run");
-        const gltf_model::animation& walk_animation = input_model.animations.at("02_walk");
+        animate(view, projection, time, interpolation);
 
-        for (int i = 0; i < bones.size(); i++) {
-            auto translation_prep =
-                    glm::lerp(run_animation.bones[i].translation(std::fmod(time, run_animation.max_time)),
-                              walk_animation.bones[i].translation(std::fmod(time, walk_animation.max_time)),
-                              interpolation);
-            auto rotation_prep =
-                    glm::slerp(run_animation.bones[i].rotation(std::fmod(time, run_animation.max_time)),
-                               walk_animation.bones[i].rotation(std::fmod(time, walk_animation.max_time)),
-                               interpolation);
-            auto scale_prep =
-                    glm::lerp(run_animation.bones[i].scale(std::fmod(time, run_animation.max_time)),
-                              walk_animation.bones[i].scale(std::fmod(time, walk_animation.max_time)),
-                              interpolation);
-            /*auto translation = glm::translate(glm::mat4(1.f),
-                                              run_animation.bones[i].translation(std::fmod(time, run_animation.max_time)));
-            auto rotation = glm::toMat4(run_animation.bones[i].rotation(std::fmod(time, run_animation.max_time)));
-            auto scale_an = glm::scale(glm::mat4(1.f),
-                                       run_animation.bones[i].scale(std::fmod(time, run_animation.max_time)));*/
-            auto translation = glm::translate(glm::mat4(1.f), translation_prep);
-            auto rotation = glm::toMat4(rotation_prep);
-            auto scale_an = glm::scale(glm::mat4(1.f), scale_prep);
-            glm::mat4 transform = translation * rotation * scale_an;
-            if (input_model.bones[i].parent != -1)
-                transform = bones[input_model.bones[i].parent] * transform;
-            bones[i] = transform;
+        lod_report_time += dt;
+        if (lod_report_time >= 1.f)
+        {
+            std::cout << "Animation LOD: screen size " << lod.instances[0].screen_size
+                << ", update interval " << lod.instances[0].update_interval
+                << ", saved " << lod.stats.saved_time() * 1000.0 / lod.frame << " ms per frame" << std::endl;
+            std::cout << "Render queue: " << queue.items().size() << " draws, GL state: " << state.last_frame().issued
+                << " calls issued, " << state.last_frame().elided << " elided per frame" << std::endl;
+            std::cout << "Textures: " << textures.totals().resident_textures << " resident, "
+                << textures.totals().resident_bytes / (1 << 20) << " of " << textures.budget() / (1 << 20) << " MiB, "
+                << textures.totals().evictions << " evictions" << std::endl;
+            lod_report_time = 0.f;
         }
 
-        for (int i = 0; i < bones.size(); i++) {
-            bones[i] = bones[i] * input_model.bones[i].inverse_bind_matrix;
-        }
+        queue_meshes(view);
+
+        uniform_ring.begin_frame();
 
-        glUseProgram(program);
-        glUniformMatrix4fv(model_location, 1, GL_FALSE, reinterpret_cast<float *>(&model));
-        glUniformMatrix4fv(view_location, 1, GL_FALSE, reinterpret_cast<float *>(&view));
-        glUniformMatrix4fv(projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&projection));
-        glUniform3fv(light_direction_location, 1, reinterpret_cast<float *>(&light_direction));
-        glUniformMatrix4x3fv(bones_location, bones.size(), GL_FALSE, reinterpret_cast<float *>(bones.data()));
+        auto const frame_block = uniform_ring.allocate(sizeof(frame_uniforms), uniform_alignment);
+        frame_uniforms const frame{view, projection, light_direction, 0.f};
+        std::memcpy(frame_block.data, &frame, sizeof(frame));
 
-        auto draw_meshes = [&](bool transparent)
+        auto const skeleton_block = uniform_ring.allocate(sizeof(skeleton_uniforms), uniform_alignment);
+        skeleton_uniforms skeleton_data;
+        skeleton_data.model = glm::transpose(model);
+        for (std::size_t i = 0; i < bones.size(); ++i)
+            skeleton_data.bones[i] = glm::transpose(bones[i]);
+        std::memcpy(skeleton_block.data, &skeleton_data, sizeof(skeleton_data));
+
+        // Consecutive draws with the same material share a block
+        material_offsets.clear();
+        std::optional<std::pair<std::uint32_t, std::uint32_t>> last_material;
+        for (auto const & item : queue.items())
         {
-            for (auto const & mesh : meshes)
+            auto const & draw = *draw_states[item.draw];
+            std::pair const material{draw.texture, draw.color};
+            if (material != last_material)
             {
-                if (mesh.material.transparent != transparent)
-                    continue;
+                auto const material_block = uniform_ring.allocate(sizeof(material_uniforms), uniform_alignment);
+                material_uniforms const material_data{draw.color != 0 ? colors[draw.color - 1] : glm::vec4(0.f), std::int32_t(draw.texture != 0), {}};
+                std::memcpy(material_block.data, &material_data, sizeof(material_data));
+                material_offsets.push_back(material_block.offset);
+                last_material = material;
+            }
+            else
+                material_offsets.push_back(material_offsets.back());
+        }
 
-                if (mesh.material.two_sided)
-                    glDisable(GL_CULL_FACE);
-                else
-                    glEnable(GL_CULL_FACE);
-
-                if (transparent)
-                    glEnable(GL_BLEND);
-                else
-                    glDisable(GL_BLEND);
-
-                if (mesh.material.texture_path)
-                {
-                    glBindTexture(GL_TEXTURE_2D, textures[*mesh.material.texture_path]);
-                    glUniform1i(use_texture_location, 1);
-                }
-                else if (mesh.material.color)
-                {
-                    glUniform1i(use_texture_location, 0);
-                    glUniform4fv(color_location, 1, reinterpret_cast<const float *>(&(*mesh.material.color)));
-                }
-                else
-                    continue;
+        uniform_ring.finish_writes();
+
+        state.use_program(program);
+        glBindBufferRange(GL_UNIFORM_BUFFER, frame_binding, uniform_buffer, frame_block.offset, sizeof(frame_uniforms));
+        glBindBufferRange(GL_UNIFORM_BUFFER, skeleton_binding, uniform_buffer, skeleton_block.offset, sizeof(skeleton_uniforms));
+
+        // Material blocks are only rebound when the offset changes
+        std::optional<std::size_t> bound_material;
+
+        for (std::size_t i = 0; i < queue.items().size(); ++i)
+        {
+            auto const & item = queue.items()[i];
+            auto const & draw = *draw_states[item.draw];
+            auto const & mesh = meshes[item.draw];
+
+            bool const transparent = (draw.pass == render_queue::transparent);
+            state.enable(GL_BLEND, transparent);
+            state.depth_mask(!transparent);
+            state.enable(GL_CULL_FACE, !draw.two_sided);
 
-                glBindVertexArray(mesh.vao);
-                glDrawElements(GL_TRIANGLES, mesh.indices.count, mesh.indices.type, reinterpret_cast<void *>(mesh.indices.view.offset));
+            if (bound_material != material_offsets[i])
+            {
+                bound_material = material_offsets[i];
+                glBindBufferRange(GL_UNIFORM_BUFFER, material_binding, uniform_buffer, material_offsets[i], sizeof(material_uniforms));
             }
-        };
 
-        draw_meshes(false);
-        glDepthMask(GL_FALSE);
-        draw_meshes(true);
-        glDepthMask(GL_TRUE);
+            if (draw.texture != 0)
+                state.bind_texture(0, GL_TEXTURE_2D, textures.bind(texture_handles[draw.texture - 1]));
+
+            state.bind_vertex_array(mesh.vao);
+            glDrawElements(GL_TRIANGLES, mesh.indices.count, mesh.indices.type, reinterpret_cast<void *>(mesh.indices.view.offset));
+        }
+
+        uniform_ring.end_frame();
+
+        state.depth_mask(true);
+        state.end_frame();
+        textures.end_frame();
 
         SDL_GL_SwapWindow(window);
     }
 
+    if (!options.record.empty())
+        recorded_path.save(options.record);
+
     SDL_GL_DeleteContext(gl_context);
     SDL_DestroyWindow(window);
 }
@@ -0,0 +1,54 @@
+#include "render_queue.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+
+void render_queue::push(pass p, bool two_sided, std::uint32_t texture, std::uint32_t material, float depth, std::uint32_t draw)
+{
+    if (texture > max_texture || material > max_material)
+        throw std::runtime_error("Render queue texture or material id out of range");
+
+    // Bits of non-negative floats order like the floats themselves
+    depth = std::max(depth, 0.f);
+    std::uint32_t depth_bits;
+    std::memcpy(&depth_bits, &depth, sizeof(depth_bits));
+
+    std::uint64_t const state = (std::uint64_t(two_sided) << 30) | (std::uint64_t(texture) << 16) | material;
+
+    std::uint64_t key;
+    if (p == opaque)
+        key = (state << 32) | depth_bits;
+    else
+        key = (std::uint64_t(1) << 63) | (std::uint64_t(~depth_bits & 0x7fffffffu) << 31) | state;
+
+    queue.push_back({key, draw});
+}
+
+void render_queue::sort()
+{
+    scratch.resize(queue.size());
+
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        std::size_t count[256] = {};
+        for (auto const & item : queue)
+            ++count[(item.key >> shift) & 0xff];
+
+        if (std::find(std::begin(count), std::end(count), queue.size()) != std::end(count))
+            continue;
+
+        std::size_t offset = 0;
+        for (auto & c : count)
+        {
+            std::size_t const size = c;
+            c = offset;
+            offset += size;
+        }
+
+        for (auto const & item : queue)
+            scratch[count[(item.key >> shift) & 0xff]++] = item;
+
+        queue.swap(scratch);
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+// Draws of a frame, ordered by 64-bit sort keys. Opaque draws are grouped by
+// state, so that consecutive draws change as little as possible, and go
+// front to back within a state; transparent draws go back to front and only
+// then by state.
+//
+// Key bits, from the most significant:
+//     opaque       pass:1 two_sided:1 texture:14 material:16 depth:32
+//     transparent  pass:1 unused:1 depth:31 two_sided:1 texture:14 material:16
+// Depth is a non-negative float, so its sign bit is dropped from transparent keys.
+struct render_queue
+{
+    enum pass : std::uint32_t
+    {
+        opaque = 0,
+        transparent = 1,
+    };
+
+    static constexpr std::uint32_t max_texture = (1u << 14) - 1;
+    static constexpr std::uint32_t max_material = (1u << 16) - 1;
+
+    struct item
+    {
+        std::uint64_t key;
+        // Caller's index of the draw
+        std::uint32_t draw;
+    };
+
+    void clear() { queue.clear(); }
+
+    // depth is the view-space distance to the draw; textures and materials are
+    // small ids, 0 for "none", and throw if out of range
+    void push(pass p, bool two_sided, std::uint32_t texture, std::uint32_t material, float depth, std::uint32_t draw);
+
+    // Stable LSD radix sort by key, a byte per pass; passes over bytes that
+    // are equal in every key are skipped
+    void sort();
+
+    std::vector<item> const & items() const { return queue; }
+
+private:
+    std::vector<item> queue;
+    std::vector<item> scratch;
+};
@@ -0,0 +1,138 @@
+#include "gltf_loader.hpp"
+#include "check.hpp"
+
+#include <iostream>
+#include <cmath>
+
+namespace
+{
+
+    bool near(glm::vec3 const & a, glm::vec3 const & b, float tolerance = 1e-5f)
+    {
+        return glm::length(a - b) <= tolerance;
+    }
+
+    bool near(glm::quat const & a, glm::quat const & b, float tolerance = 1e-5f)
+    {
+        // q and -q are the same rotation
+        return std::abs(std::abs(glm::dot(a, b)) - 1.f) <= tolerance;
+    }
+
+    // Cubic Hermite spline of the glTF specification, Appendix C: tangents are
+    // per second, so they are scaled by the duration of the segment
+    glm::vec3 reference_cubic(float t0, float t1, glm::vec3 p0, glm::vec3 out_tangent0, glm::vec3 p1, glm::vec3 in_tangent1, float time)
+    {
+        float const td = t1 - t0;
+        float const t = (time - t0) / td;
+        float const t2 = t * t;
+        float const t3 = t2 * t;
+        return (2.f * t3 - 3.f * t2 + 1.f) * p0 + td * (t3 - 2.f * t2 + t) * out_tangent0
+            + (-2.f * t3 + 3.f * t2) * p1 + td * (t3 - t2) * in_tangent1;
+    }
+
+    template <typename T>
+    gltf_model::spline<T> make_spline(gltf_model::interpolation_type interpolation, std::vector<float> timestamps, std::vector<T> values)
+    {
+        gltf_model::spline<T> result;
+        result.interpolation = interpolation;
+        result.timestamps = std::move(timestamps);
+        result.values = std::move(values);
+        return result;
+    }
+
+    void test_step()
+    {
+        auto const spline = make_spline<glm::vec3>(gltf_model::interpolation_type::step, {1.f, 2.f, 4.f},
+            {glm::vec3(1.f, 0.f, 0.f), glm::vec3(0.f, 2.f, 0.f), glm::vec3(0.f, 0.f, 3.f)});
+
+        CHECK(near(spline(0.f), spline.values[0]));
+        CHECK(near(spline(1.f), spline.values[0]));
+        CHECK(near(spline(1.999f), spline.values[0]));
+        CHECK(near(spline(2.f), spline.values[1]));
+        CHECK(near(spline(3.9f), spline.values[1]));
+        CHECK(near(spline(4.f), spline.values[2]));
+        CHECK(near(spline(10.f), spline.values[2]));
+    }
+
+    void test_linear()
+    {
+        auto const translation = make_spline<glm::vec3>(gltf_model::interpolation_type::linear, {0.f, 1.f, 3.f},
+            {glm::vec3(0.f), glm::vec3(2.f, 4.f, -2.f), glm::vec3(4.f, 4.f, 0.f)});
+
+        CHECK(near(translation(-1.f), glm::vec3(0.f)));
+        CHECK(near(translation(0.25f), glm::vec3(0.5f, 1.f, -0.5f)));
+        CHECK(near(translation(1.f), glm::vec3(2.f, 4.f, -2.f)));
+        CHECK(near(translation(2.5f), glm::vec3(3.5f, 4.f, -0.5f)));
+        CHECK(near(translation(5.f), glm::vec3(4.f, 4.f, 0.f)));
+
+        // Rotations interpolate spherically, at constant angular speed
+        auto const rotation = make_spline<glm::quat>(gltf_model::interpolation_type::linear, {0.f, 2.f},
+            {glm::angleAxis(0.f, glm::vec3(0.f, 0.f, 1.f)), glm::angleAxis(glm::radians(90.f), glm::vec3(0.f, 0.f, 1.f))});
+
+        CHECK(near(rotation(0.5f), glm::angleAxis(glm::radians(22.5f), glm::vec3(0.f, 0.f, 1.f))));
+        CHECK(near(rotation(1.f), glm::angleAxis(glm::radians(45.f), glm::vec3(0.f, 0.f, 1.f))));
+        CHECK(near(rotation(3.f), rotation.values[1]));
+    }
+
+    void test_cubic_spline()
+    {
+        // One segment of two seconds: the out-tangent of 1/s moves the value by
+        // 2 units of tangent over the segment
+        {
+            auto spline = make_spline<glm::vec3>(gltf_model::interpolation_type::cubic_spline, {0.f, 2.f},
+                {glm::vec3(0.f), glm::vec3(1.f, 0.f, 0.f)});
+            spline.set_tangents({glm::vec3(0.f), glm::vec3(0.f)}, {glm::vec3(1.f, 0.f, 0.f), glm::vec3(0.f)});
+
+            CHECK(near(spline(1.f), glm::vec3(0.75f, 0.f, 0.f)));
+            CHECK(near(spline(0.5f), glm::vec3(0.4375f, 0.f, 0.f)));
+        }
+
+        // Segments of different durations against the reference formula
+        std::vector<float> const times{0.5f, 1.f, 3.f, 3.25f};
+        std::vector<glm::vec3> const values{glm::vec3(0.f, 1.f, 2.f), glm::vec3(1.f, -1.f, 0.f), glm::vec3(3.f, 2.f, 1.f), glm::vec3(-1.f, 0.f, 4.f)};
+        std::vector<glm::vec3> const in_tangents{glm::vec3(9.f), glm::vec3(1.f, 2.f, -1.f), glm::vec3(-2.f, 0.5f, 3.f), glm::vec3(0.f, 1.f, 1.f)};
+        std::vector<glm::vec3> const out_tangents{glm::vec3(2.f, 0.f, 1.f), glm::vec3(0.5f, -3.f, 2.f), glm::vec3(4.f, 1.f, 0.f), glm::vec3(9.f)};
+
+        auto spline = make_spline<glm::vec3>(gltf_model::interpolation_type::cubic_spline, times, values);
+        spline.set_tangents(in_tangents, out_tangents);
+
+        for (std::size_t k = 0; k + 1 < times.size(); ++k)
+        {
+            for (float s : {0.f, 0.1f, 0.25f, 0.5f, 0.8f, 0.99f})
+            {
+                float const time = times[k] + s * (times[k + 1] - times[k]);
+                auto const expected = reference_cubic(times[k], times[k + 1], values[k], out_tangents[k], values[k + 1], in_tangents[k + 1], time);
+                CHECK(near(spline(time), expected, 1e-4f));
+            }
+        }
+
+        // The in-tangent of the first key and the out-tangent of the last one
+        // are unused, and sampling clamps to the first and last values
+        CHECK(near(spline(0.f), values.front()));
+        CHECK(near(spline(3.25f), values.back()));
+        CHECK(near(spline(100.f), values.back()));
+
+        // Rotations are normalized after evaluating the polynomial
+        auto rotation = make_spline<glm::quat>(gltf_model::interpolation_type::cubic_spline, {0.f, 1.f},
+            {glm::angleAxis(0.f, glm::vec3(0.f, 1.f, 0.f)), glm::angleAxis(glm::radians(120.f), glm::vec3(0.f, 1.f, 0.f))});
+        rotation.set_tangents({glm::quat(0.f, 0.f, 0.f, 0.f), glm::quat(0.f, 0.f, 0.f, 0.f)}, {glm::quat(0.f, 0.f, 0.f, 0.f), glm::quat(0.f, 0.f, 0.f, 0.f)});
+        for (float time : {0.2f, 0.5f, 0.7f})
+            CHECK(std::abs(glm::length(rotation(time)) - 1.f) < 1e-5f);
+        CHECK(near(rotation(-1.f), rotation.values[0]));
+        CHECK(near(rotation(2.f), rotation.values[1]));
+    }
+
+}
+
+int main() try
+{
+    test_step();
+    test_linear();
+    test_cubic_spline();
+    std::cout << "spline: all checks passed" << std::endl;
+}
+catch (std::exception const & e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,260 @@
+#pragma once
+
+#include <string_view>
+#include <stdexcept>
+#include <algorithm>
+#include <cstddef>
+
+// Compile-time std140 layout of uniform blocks, computed from their GLSL
+// declarations, so that C++ structs mirroring the blocks can be checked
+// against the shader source:
+//
+//     STD140_CHECK_MEMBER(vertex_shader_source, "Frame", frame_uniforms, view);
+//     STD140_CHECK_SIZE(vertex_shader_source, "Frame", frame_uniforms);
+//
+// Blocks must be declared with layout (std140), optionally row_major, and
+// hold scalars, vectors, matrices and arrays of them, one member per
+// declaration. Anything else throws, which fails compilation when evaluated
+// in a constant expression.
+namespace std140
+{
+
+    struct member_layout
+    {
+        std::size_t offset = 0;
+        // Of the whole array for arrays
+        std::size_t size = 0;
+        // Zero for non-arrays
+        std::size_t array_stride = 0;
+    };
+
+    namespace detail
+    {
+
+        constexpr std::size_t round_up(std::size_t value, std::size_t alignment)
+        {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+
+        struct type_layout
+        {
+            std::size_t alignment;
+            std::size_t size;
+        };
+
+        constexpr type_layout vector_layout(std::size_t components)
+        {
+            if (components == 2)
+                return {8, 8};
+            if (components == 3)
+                return {16, 12};
+            if (components == 4)
+                return {16, 16};
+            throw std::logic_error("Unsupported std140 vector size");
+        }
+
+        constexpr type_layout type(std::string_view name, bool row_major)
+        {
+            if (name == "float" || name == "int" || name == "uint" || name == "bool")
+                return {4, 4};
+
+            for (std::string_view prefix : {"vec", "ivec", "uvec", "bvec"})
+                if (name.size() == prefix.size() + 1 && name.substr(0, prefix.size()) == prefix)
+                    return vector_layout(name.back() - '0');
+
+            // matC and matCxR, C columns of R rows; stored as an array of columns,
+            // or of rows if row_major, with every vector aligned to a vec4
+            if (name.size() == 4 && name.substr(0, 3) == "mat")
+                return {16, std::size_t(name[3] - '0') * 16};
+            if (name.size() == 6 && name.substr(0, 3) == "mat" && name[4] == 'x')
+                return {16, std::size_t((row_major ? name[5] : name[3]) - '0') * 16};
+
+            throw std::logic_error("Unsupported std140 member type");
+        }
+
+        constexpr bool identifier_char(char c)
+        {
+            return c == '_' || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+        }
+
+        // Identifiers, numbers and single punctuation characters; skips whitespace and comments
+        struct tokenizer
+        {
+            std::string_view source;
+            std::size_t position = 0;
+
+            constexpr std::string_view next()
+            {
+                while (position < source.size())
+                {
+                    char const c = source[position];
+                    if (c == ' ' || c == '\t' || c == '\n' || c == '\r')
+                        ++position;
+                    else if (source.substr(position, 2) == "//")
+                        position = std::min(source.find('\n', position), source.size());
+                    else if (source.substr(position, 2) == "/*")
+                        position = std::min(source.find("*/", position) + 2, source.size());
+                    else
+                        break;
+                }
+
+                std::size_t const begin = position;
+                if (position < source.size() && identifier_char(source[position]))
+                    while (position < source.size() && identifier_char(source[position]))
+                        ++position;
+                else if (position < source.size())
+                    ++position;
+
+                return source.substr(begin, position - begin);
+            }
+
+            constexpr void expect(std::string_view token)
+            {
+                if (next() != token)
+                    throw std::logic_error("Unexpected token in uniform block declaration");
+            }
+        };
+
+        constexpr std::size_t parse_number(std::string_view token)
+        {
+            if (token.empty())
+                throw std::logic_error("Expected array size");
+
+            std::size_t result = 0;
+            for (char c : token)
+            {
+                if (c < '0' || c > '9')
+                    throw std::logic_error("Array sizes must be literal numbers");
+                result = result * 10 + (c - '0');
+            }
+            return result;
+        }
+
+        // Qualifiers of layout(...), after the layout keyword
+        constexpr void parse_layout(tokenizer & tokens, bool & std140, bool & row_major)
+        {
+            tokens.expect("(");
+            for (auto token = tokens.next(); token != ")"; token = tokens.next())
+            {
+                if (token.empty())
+                    throw std::logic_error("Unterminated layout qualifier");
+                if (token == "std140")
+                    std140 = true;
+                else if (token == "row_major")
+                    row_major = true;
+                else if (token == "column_major")
+                    row_major = false;
+            }
+        }
+
+        // Layout of the named member, or of the whole block if member is empty
+        constexpr member_layout find(std::string_view source, std::string_view block, std::string_view member)
+        {
+            tokenizer tokens{source};
+
+            // Qualifiers of the declaration being read
+            bool std140 = false;
+            bool row_major = false;
+
+            for (auto token = tokens.next(); !token.empty(); token = tokens.next())
+            {
+                if (token == "layout")
+                {
+                    parse_layout(tokens, std140, row_major);
+                    continue;
+                }
+
+                if (token == ";")
+                {
+                    std140 = false;
+                    row_major = false;
+                    continue;
+                }
+
+                if (token != "uniform" || tokens.next() != block)
+                    continue;
+
+                if (!std140)
+                    throw std::logic_error("Uniform block is not declared with layout (std140)");
+
+                tokens.expect("{");
+
+                std::size_t offset = 0;
+                for (token = tokens.next(); token != "}"; token = tokens.next())
+                {
+                    bool member_row_major = row_major;
+                    if (token == "layout")
+                    {
+                        bool unused = false;
+                        parse_layout(tokens, unused, member_row_major);
+                        token = tokens.next();
+                    }
+                    while (token == "highp" || token == "mediump" || token == "lowp")
+                        token = tokens.next();
+
+                    auto const type_name = token;
+                    auto const name = tokens.next();
+                    auto const layout = type(type_name, member_row_major);
+
+                    std::size_t array_size = 0;
+                    token = tokens.next();
+                    if (token == "[")
+                    {
+                        array_size = parse_number(tokens.next());
+                        tokens.expect("]");
+                        token = tokens.next();
+                    }
+                    if (token != ";")
+                        throw std::logic_error("Expected one member per declaration");
+
+                    member_layout result;
+                    if (array_size > 0)
+                    {
+                        result.array_stride = round_up(layout.size, 16);
+                        result.offset = round_up(offset, 16);
+                        result.size = result.array_stride * array_size;
+                    }
+                    else
+                    {
+                        result.offset = round_up(offset, layout.alignment);
+                        result.size = layout.size;
+                    }
+
+                    if (name == member)
+                        return result;
+
+                    offset = result.offset + result.size;
+                }
+
+                if (!member.empty())
+                    throw std::logic_error("No such member in the uniform block");
+
+                return {0, round_up(offset, 16), 0};
+            }
+
+            throw std::logic_error("No such uniform block");
+        }
+
+    }
+
+    constexpr member_layout member(std::string_view source, std::string_view block, std::string_view name)
+    {
+        return detail::find(source, block, name);
+    }
+
+    // Rounded up to a vec4, like the size of a std140 structure
+    constexpr std::size_t block_size(std::string_view source, std::string_view block)
+    {
+        return detail::find(source, block, {}).size;
+    }
+
+}
+
+#define STD140_CHECK_MEMBER(source, block, type, name) \
+    static_assert(offsetof(type, name) == std140::member(source, block, #name).offset \
+        && sizeof(type::name) == std140::member(source, block, #name).size, \
+        #type "::" #name " does not match the std140 layout of block " block)
+
+#define STD140_CHECK_SIZE(source, block, type) \
+    static_assert(sizeof(type) == std140::block_size(source, block), \
+        "Size of " #type " does not match the std140 layout of block " block)
@@ -0,0 +1,155 @@
+#include "transform_hierarchy.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+
+transform_hierarchy::transform_hierarchy(std::vector<std::uint32_t> const & parents)
+{
+    std::size_t const count = parents.size();
+
+    std::vector<std::uint32_t> depth(count, no_parent);
+    auto compute_depth = [&](std::uint32_t node)
+    {
+        std::uint32_t d = 0;
+        for (std::uint32_t p = parents[node]; p != no_parent; p = parents[p])
+        {
+            if (++d > count)
+                throw std::runtime_error("Transform hierarchy has a cycle");
+        }
+        return d;
+    };
+
+    std::uint32_t max_depth = 0;
+    for (std::uint32_t i = 0; i < count; ++i)
+    {
+        depth[i] = compute_depth(i);
+        max_depth = std::max(max_depth, depth[i]);
+    }
+
+    std::vector<std::uint32_t> order(count);
+    for (std::uint32_t i = 0; i < count; ++i)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b){ return depth[a] < depth[b]; });
+
+    slot.resize(count);
+    for (std::uint32_t s = 0; s < count; ++s)
+        slot[order[s]] = s;
+
+    std::uint32_t const identity_slot = count;
+
+    parent_slot.resize(count);
+    for (std::uint32_t s = 0; s < count; ++s)
+    {
+        std::uint32_t const p = parents[order[s]];
+        parent_slot[s] = (p == no_parent) ? identity_slot : slot[p];
+    }
+
+    level_begin.assign(count > 0 ? max_depth + 2 : 1, count);
+    for (std::uint32_t s = count; s-- > 0;)
+        level_begin[depth[order[s]]] = s;
+    level_begin[0] = 0;
+
+    tx.assign(count, 0.f); ty.assign(count, 0.f); tz.assign(count, 0.f);
+    qx.assign(count, 0.f); qy.assign(count, 0.f); qz.assign(count, 0.f); qw.assign(count, 1.f);
+    sx.assign(count, 1.f); sy.assign(count, 1.f); sz.assign(count, 1.f);
+
+    // One more flag for the identity slot, always clear
+    dirty.assign(count + 1, 1);
+    dirty.back() = 0;
+    world_transforms.assign(count + 1, glm::mat4x3(1.f));
+}
+
+void transform_hierarchy::set_translation(std::uint32_t node, glm::vec3 const & translation)
+{
+    std::uint32_t const s = slot[node];
+    tx[s] = translation.x;
+    ty[s] = translation.y;
+    tz[s] = translation.z;
+    dirty[s] = 1;
+}
+
+void transform_hierarchy::set_rotation(std::uint32_t node, glm::quat const & rotation)
+{
+    std::uint32_t const s = slot[node];
+    qx[s] = rotation.x;
+    qy[s] = rotation.y;
+    qz[s] = rotation.z;
+    qw[s] = rotation.w;
+    dirty[s] = 1;
+}
+
+void transform_hierarchy::set_scale(std::uint32_t node, glm::vec3 const & scale)
+{
+    std::uint32_t const s = slot[node];
+    sx[s] = scale.x;
+    sy[s] = scale.y;
+    sz[s] = scale.z;
+    dirty[s] = 1;
+}
+
+void transform_hierarchy::set_local(std::uint32_t node, glm::vec3 const & translation, glm::quat const & rotation, glm::vec3 const & scale)
+{
+    set_translation(node, translation);
+    set_rotation(node, rotation);
+    set_scale(node, scale);
+}
+
+void transform_hierarchy::update()
+{
+    std::uint8_t * const d = dirty.data();
+    std::uint32_t const * const ps = parent_slot.data();
+    glm::mat4x3 * const transforms = world_transforms.data();
+
+    for (std::size_t level = 0; level + 1 < level_begin.size(); ++level)
+    {
+        std::uint32_t const begin = level_begin[level];
+        std::uint32_t const end = level_begin[level + 1];
+
+        for (std::uint32_t block = begin; block < end; block += block_size)
+        {
+            std::uint32_t const block_end = std::min<std::uint32_t>(block + block_size, end);
+
+            // Roots read the flag of the identity slot, which is never set
+            std::uint8_t any_dirty = 0;
+            for (std::uint32_t s = block; s < block_end; ++s)
+            {
+                d[s] |= d[ps[s]];
+                any_dirty |= d[s];
+            }
+
+            if (!any_dirty)
+                continue;
+
+            // Every slot of a block with changes is recomputed, and the dirty
+            // flag selects between the new and the old transform, so the loop
+            // body has no data-dependent branches
+            for (std::uint32_t s = block; s < block_end; ++s)
+            {
+                float const x = qx[s], y = qy[s], z = qz[s], w = qw[s];
+
+                glm::vec3 const c0 = glm::vec3(1.f - 2.f * (y * y + z * z), 2.f * (x * y + w * z), 2.f * (x * z - w * y)) * sx[s];
+                glm::vec3 const c1 = glm::vec3(2.f * (x * y - w * z), 1.f - 2.f * (x * x + z * z), 2.f * (y * z + w * x)) * sy[s];
+                glm::vec3 const c2 = glm::vec3(2.f * (x * z + w * y), 2.f * (y * z - w * x), 1.f - 2.f * (x * x + y * y)) * sz[s];
+                glm::vec3 const c3 = glm::vec3(tx[s], ty[s], tz[s]);
+
+                glm::mat4x3 const p = transforms[ps[s]];
+                glm::mat4x3 const computed(
+                    p[0] * c0.x + p[1] * c0.y + p[2] * c0.z,
+                    p[0] * c1.x + p[1] * c1.y + p[2] * c1.z,
+                    p[0] * c2.x + p[1] * c2.y + p[2] * c2.z,
+                    p[0] * c3.x + p[1] * c3.y + p[2] * c3.z + p[3]);
+
+                // All ones for dirty slots; blending the bits keeps the compiler
+                // from turning the select back into a conditional store
+                std::uint32_t const mask = 0u - d[s];
+                float const * const n = &computed[0][0];
+                float * const r = &transforms[s][0][0];
+                for (int i = 0; i < 12; ++i)
+                    r[i] = std::bit_cast<float>((std::bit_cast<std::uint32_t>(n[i]) & mask) | (std::bit_cast<std::uint32_t>(r[i]) & ~mask));
+            }
+        }
+    }
+
+    std::fill(dirty.begin(), dirty.end(), 0);
+}
@@ -0,0 +1,156 @@
+#include "transform_hierarchy.hpp"
+#include "check.hpp"
+
+#include <glm/mat4x4.hpp>
+#include <glm/ext/matrix_transform.hpp>
+
+#include <iostream>
+#include <random>
+#include <algorithm>
+#include <cmath>
+
+// Builds random forests, with parents stored both before and after their
+// children, changes random subsets of the local transforms over several
+// updates, and compares every world transform with a naive recursive
+// evaluation of the same locals.
+namespace
+{
+
+    struct local_transform
+    {
+        glm::vec3 translation{0.f};
+        glm::quat rotation{1.f, 0.f, 0.f, 0.f};
+        glm::vec3 scale{1.f};
+    };
+
+    glm::mat4 reference_world(std::vector<std::uint32_t> const & parents, std::vector<local_transform> const & locals, std::uint32_t node)
+    {
+        auto const & l = locals[node];
+        glm::mat4 const local = glm::translate(glm::mat4(1.f), l.translation) * glm::mat4_cast(l.rotation) * glm::scale(glm::mat4(1.f), l.scale);
+        if (parents[node] == transform_hierarchy::no_parent)
+            return local;
+        return reference_world(parents, locals, parents[node]) * local;
+    }
+
+    // Largest difference over all nodes, relative to the magnitude of the reference
+    float max_error(transform_hierarchy const & hierarchy, std::vector<std::uint32_t> const & parents, std::vector<local_transform> const & locals)
+    {
+        float error = 0.f;
+        for (std::uint32_t node = 0; node < parents.size(); ++node)
+        {
+            glm::mat4 const expected = reference_world(parents, locals, node);
+            glm::mat4x3 const & actual = hierarchy.world(node);
+            for (int c = 0; c < 4; ++c)
+                for (int r = 0; r < 3; ++r)
+                    error = std::max(error, std::abs(actual[c][r] - expected[c][r]) / std::max(1.f, std::abs(expected[c][r])));
+        }
+        return error;
+    }
+
+    void test_random(std::uint32_t seed)
+    {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> uniform(-1.f, 1.f);
+        std::uniform_real_distribution<float> positive(0.5f, 1.5f);
+
+        // Forests of a few roots, shallow and wide or deep and narrow
+        std::uint32_t const count = std::uniform_int_distribution<std::uint32_t>(1, 300)(rng);
+        std::uint32_t const window = std::uniform_int_distribution<std::uint32_t>(1, count)(rng);
+
+        std::vector<std::uint32_t> order(count);
+        for (std::uint32_t i = 0; i < count; ++i)
+            order[i] = i;
+        std::shuffle(order.begin(), order.end(), rng);
+
+        // order[k] gets a parent among the window of nodes created just before it
+        std::vector<std::uint32_t> parents(count, transform_hierarchy::no_parent);
+        for (std::uint32_t k = 1; k < count; ++k)
+            if (std::uniform_int_distribution<int>(0, 15)(rng) != 0)
+                parents[order[k]] = order[k - 1 - std::uniform_int_distribution<std::uint32_t>(0, std::min(k, window) - 1)(rng)];
+
+        auto random_local = [&]
+        {
+            local_transform l;
+            l.translation = {uniform(rng), uniform(rng), uniform(rng)};
+            l.rotation = glm::normalize(glm::quat(uniform(rng), uniform(rng), uniform(rng), uniform(rng)));
+            l.scale = {positive(rng), positive(rng), positive(rng)};
+            return l;
+        };
+
+        transform_hierarchy hierarchy(parents);
+        std::vector<local_transform> locals(count);
+
+        // Untouched nodes start at the identity
+        hierarchy.update();
+        CHECK(max_error(hierarchy, parents, locals) <= 1e-6f);
+
+        for (std::uint32_t node = 0; node < count; ++node)
+        {
+            locals[node] = random_local();
+            hierarchy.set_local(node, locals[node].translation, locals[node].rotation, locals[node].scale);
+        }
+        hierarchy.update();
+        CHECK(max_error(hierarchy, parents, locals) <= 1e-4f);
+
+        for (int round = 0; round < 20; ++round)
+        {
+            // From a single node to most of them, through every setter
+            std::uint32_t const changes = (round % 4 == 0) ? 1 : std::uniform_int_distribution<std::uint32_t>(0, count)(rng);
+            for (std::uint32_t i = 0; i < changes; ++i)
+            {
+                std::uint32_t const node = std::uniform_int_distribution<std::uint32_t>(0, count - 1)(rng);
+                auto const l = random_local();
+                switch (std::uniform_int_distribution<int>(0, 3)(rng))
+                {
+                case 0:
+                    locals[node].translation = l.translation;
+                    hierarchy.set_translation(node, l.translation);
+                    break;
+                case 1:
+                    locals[node].rotation = l.rotation;
+                    hierarchy.set_rotation(node, l.rotation);
+                    break;
+                case 2:
+                    locals[node].scale = l.scale;
+                    hierarchy.set_scale(node, l.scale);
+                    break;
+                default:
+                    locals[node] = l;
+                    hierarchy.set_local(node, l.translation, l.rotation, l.scale);
+                    break;
+                }
+            }
+
+            hierarchy.update();
+            CHECK(max_error(hierarchy, parents, locals) <= 1e-4f);
+        }
+    }
+
+    void test_cycle()
+    {
+        bool thrown = false;
+        try
+        {
+            transform_hierarchy hierarchy({1, 2, 0});
+        }
+        catch (std::runtime_error const &)
+        {
+            thrown = true;
+        }
+        CHECK(thrown);
+    }
+
+}
+
+int main() try
+{
+    for (std::uint32_t seed = 0; seed < 200; ++seed)
+        test_random(seed);
+    test_cycle();
+    std::cout << "transform_hierarchy: all checks passed" << std::endl;
+}
+catch (std::exception const & e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
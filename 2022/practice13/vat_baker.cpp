@@ -0,0 +1,217 @@
+#include "vat_baker.hpp"
+
+#include <glm/gtc/packing.hpp>
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/geometric.hpp>
+
+#include <fstream>
+#include <stdexcept>
+#include <cmath>
+
+namespace
+{
+
+    glm::vec3 read_texel(baked_animation const & baked, std::uint32_t layer, std::uint32_t frame, std::uint32_t vertex)
+    {
+        auto const & info = baked.info;
+        std::size_t const x = vertex % info.width;
+        std::size_t const y = frame * info.rows_per_frame + vertex / info.width;
+        std::size_t const index = 3 * ((layer * std::size_t(baked.height()) + y) * info.width + x);
+
+        return {
+            glm::unpackHalf1x16(baked.texels[index + 0]),
+            glm::unpackHalf1x16(baked.texels[index + 1]),
+            glm::unpackHalf1x16(baked.texels[index + 2]),
+        };
+    }
+
+    float frame_time(baked_animation const & baked, std::uint32_t frame)
+    {
+        return std::min(frame / baked.info.frame_rate, baked.info.duration);
+    }
+
+}
+
+glm::vec3 baked_animation::position(std::uint32_t frame, std::uint32_t vertex) const
+{
+    return read_texel(*this, 0, frame, vertex);
+}
+
+glm::vec3 baked_animation::normal(std::uint32_t frame, std::uint32_t vertex) const
+{
+    return read_texel(*this, 1, frame, vertex);
+}
+
+transform_hierarchy make_skeleton(gltf_model const & model)
+{
+    std::vector<std::uint32_t> parents;
+    for (auto const & bone : model.bones)
+        parents.push_back(bone.parent);
+    return transform_hierarchy(parents);
+}
+
+void compute_bone_matrices(gltf_model const & model, gltf_model::animation const & animation, float time, transform_hierarchy & skeleton,
+    std::vector<glm::mat4x3> & result)
+{
+    result.resize(model.bones.size());
+
+    for (std::uint32_t i = 0; i < model.bones.size(); ++i)
+    {
+        auto const & bone = animation.bones[i];
+        skeleton.set_local(i, bone.translation(time), bone.rotation(time), bone.scale(time));
+    }
+
+    skeleton.update();
+
+    for (std::uint32_t i = 0; i < model.bones.size(); ++i)
+        result[i] = glm::mat4(skeleton.world(i)) * model.bones[i].inverse_bind_matrix;
+}
+
+void skin_vertices(gltf_model const & model, std::vector<glm::mat4x3> const & bones, std::vector<glm::vec3> & positions, std::vector<glm::vec3> & normals)
+{
+    positions.clear();
+    normals.clear();
+
+    for (auto const & mesh : model.meshes)
+    {
+        assert(mesh.position.type == 0x1406); // GL_FLOAT
+        assert(mesh.normal.type == 0x1406);
+        assert(mesh.weights.type == 0x1406);
+
+        auto const * position = reinterpret_cast<glm::vec3 const *>(model.buffer.data() + mesh.position.view.offset);
+        auto const * normal = reinterpret_cast<glm::vec3 const *>(model.buffer.data() + mesh.normal.view.offset);
+        auto const * weights = reinterpret_cast<glm::vec4 const *>(model.buffer.data() + mesh.weights.view.offset);
+        auto const * joints = model.buffer.data() + mesh.joints.view.offset;
+
+        auto joint = [&](std::size_t vertex, int k) -> std::uint32_t
+        {
+            if (mesh.joints.type == 0x1401) // GL_UNSIGNED_BYTE
+                return reinterpret_cast<std::uint8_t const *>(joints)[4 * vertex + k];
+            if (mesh.joints.type == 0x1403) // GL_UNSIGNED_SHORT
+                return reinterpret_cast<std::uint16_t const *>(joints)[4 * vertex + k];
+            throw std::runtime_error("Unsupported joint index type");
+        };
+
+        for (std::size_t v = 0; v < mesh.position.count; ++v)
+        {
+            glm::mat4x3 m(0.f);
+            for (int k = 0; k < 4; ++k)
+                m += bones[joint(v, k)] * weights[v][k];
+
+            positions.push_back(m * glm::vec4(position[v], 1.f));
+            normals.push_back(glm::normalize(glm::mat3(m) * normal[v]));
+        }
+    }
+}
+
+baked_animation bake_animation(gltf_model const & model, gltf_model::animation const & animation, float frame_rate, std::uint32_t max_width)
+{
+    baked_animation result;
+
+    std::uint32_t vertex_count = 0;
+    for (auto const & mesh : model.meshes)
+    {
+        result.mesh_base_vertex.push_back(vertex_count);
+        vertex_count += mesh.position.count;
+    }
+
+    auto & info = result.info;
+    info.vertex_count = vertex_count;
+    info.width = std::min(vertex_count, max_width);
+    info.rows_per_frame = (vertex_count + info.width - 1) / info.width;
+    info.frame_rate = frame_rate;
+    info.duration = animation.max_time;
+    // Include both ends of the clip, so that playback can interpolate up to max_time
+    info.frame_count = static_cast<std::uint32_t>(std::ceil(animation.max_time * frame_rate)) + 1;
+
+    std::size_t const layer_size = std::size_t(info.width) * result.height() * 3;
+    result.texels.assign(2 * layer_size, 0);
+
+    auto skeleton = make_skeleton(model);
+    std::vector<glm::mat4x3> bones;
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+
+    for (std::uint32_t frame = 0; frame < info.frame_count; ++frame)
+    {
+        compute_bone_matrices(model, animation, frame_time(result, frame), skeleton, bones);
+        skin_vertices(model, bones, positions, normals);
+
+        std::size_t const frame_offset = std::size_t(frame) * info.rows_per_frame * info.width * 3;
+        for (std::uint32_t v = 0; v < vertex_count; ++v)
+        {
+            std::uint16_t * p = result.texels.data() + frame_offset + 3 * v;
+            std::uint16_t * n = p + layer_size;
+
+            for (int c = 0; c < 3; ++c)
+            {
+                p[c] = glm::packHalf1x16(positions[v][c]);
+                n[c] = glm::packHalf1x16(normals[v][c]);
+            }
+        }
+    }
+
+    return result;
+}
+
+float baked_animation_error(baked_animation const & baked, gltf_model const & model, gltf_model::animation const & animation)
+{
+    auto skeleton = make_skeleton(model);
+    std::vector<glm::mat4x3> bones;
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+
+    float error = 0.f;
+    for (std::uint32_t frame = 0; frame < baked.info.frame_count; ++frame)
+    {
+        compute_bone_matrices(model, animation, frame_time(baked, frame), skeleton, bones);
+        skin_vertices(model, bones, positions, normals);
+
+        for (std::uint32_t v = 0; v < baked.info.vertex_count; ++v)
+        {
+            error = std::max(error, glm::length(baked.position(frame, v) - positions[v]));
+            error = std::max(error, glm::length(baked.normal(frame, v) - normals[v]));
+        }
+    }
+
+    return error;
+}
+
+void save_baked_animation(baked_animation const & baked, std::experimental::filesystem::path const & path)
+{
+    std::ofstream output(path, std::ios::binary);
+    if (!output)
+        throw std::runtime_error("Failed to open " + path.string());
+
+    std::uint32_t const mesh_count = baked.mesh_base_vertex.size();
+
+    output.write(reinterpret_cast<char const *>(&baked.info), sizeof(baked.info));
+    output.write(reinterpret_cast<char const *>(&mesh_count), sizeof(mesh_count));
+    output.write(reinterpret_cast<char const *>(baked.mesh_base_vertex.data()), mesh_count * sizeof(baked.mesh_base_vertex[0]));
+    output.write(reinterpret_cast<char const *>(baked.texels.data()), baked.texels.size() * sizeof(baked.texels[0]));
+}
+
+baked_animation load_baked_animation(std::experimental::filesystem::path const & path)
+{
+    std::ifstream input(path, std::ios::binary);
+    if (!input)
+        throw std::runtime_error("Failed to open " + path.string());
+
+    baked_animation result;
+
+    std::uint32_t mesh_count;
+    input.read(reinterpret_cast<char *>(&result.info), sizeof(result.info));
+    input.read(reinterpret_cast<char *>(&mesh_count), sizeof(mesh_count));
+
+    result.mesh_base_vertex.resize(mesh_count);
+    input.read(reinterpret_cast<char *>(result.mesh_base_vertex.data()), mesh_count * sizeof(result.mesh_base_vertex[0]));
+
+    result.texels.resize(2 * std::size_t(result.info.width) * result.height() * 3);
+    input.read(reinterpret_cast<char *>(result.texels.data()), result.texels.size() * sizeof(result.texels[0]));
+
+    // Catches truncated files and files baked with another texel layout
+    if (!input || input.peek() != std::ifstream::traits_type::eof())
+        throw std::runtime_error("Unexpected size of " + path.string());
+
+    return result;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "gltf_loader.hpp"
+#include "transform_hierarchy.hpp"
+
+#include <vector>
+#include <cstdint>
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x3.hpp>
+
+// Vertex animation texture: skinned positions and normals of every vertex of
+// every mesh of a model, sampled at a fixed frame rate over one animation clip.
+// The data is laid out as a two-layer RGB16F 2D array image: layer 0 holds
+// positions, layer 1 holds normals. A frame occupies rows_per_frame rows of
+// width texels; vertex v of frame f is texel (v % width, f * rows_per_frame + v / width).
+// Rows are 6 * width bytes, so uploads need GL_UNPACK_ALIGNMENT 2 for odd widths.
+struct baked_animation
+{
+    struct header
+    {
+        std::uint32_t width;
+        std::uint32_t rows_per_frame;
+        std::uint32_t frame_count;
+        std::uint32_t vertex_count;
+        float frame_rate;
+        float duration;
+    };
+
+    header info;
+
+    // Index of the first vertex of each mesh of the model
+    std::vector<std::uint32_t> mesh_base_vertex;
+
+    // Half floats, layer-major, then row-major, 3 channels per texel
+    std::vector<std::uint16_t> texels;
+
+    std::uint32_t height() const { return info.rows_per_frame * info.frame_count; }
+
+    glm::vec3 position(std::uint32_t frame, std::uint32_t vertex) const;
+    glm::vec3 normal(std::uint32_t frame, std::uint32_t vertex) const;
+};
+
+// Hierarchy of the bones of the model, in the order of model.bones
+transform_hierarchy make_skeleton(gltf_model const & model);
+
+// Bone matrices (including inverse bind matrices) of an animation at a given
+// time, evaluated through the skeleton like the runtime does
+void compute_bone_matrices(gltf_model const & model, gltf_model::animation const & animation, float time, transform_hierarchy & skeleton,
+    std::vector<glm::mat4x3> & result);
+
+// Skins all vertices of all meshes of the model, in mesh order, with the
+// math of the skinning vertex shader
+void skin_vertices(gltf_model const & model, std::vector<glm::mat4x3> const & bones, std::vector<glm::vec3> & positions, std::vector<glm::vec3> & normals);
+
+baked_animation bake_animation(gltf_model const & model, gltf_model::animation const & animation, float frame_rate, std::uint32_t max_width = 4096);
+
+// Largest difference between the baked data and CPU skinning of the same frames
+float baked_animation_error(baked_animation const & baked, gltf_model const & model, gltf_model::animation const & animation);
+
+void save_baked_animation(baked_animation const & baked, std::experimental::filesystem::path const & path);
+baked_animation load_baked_animation(std::experimental::filesystem::path const & path);
@@ -0,0 +1,164 @@
+#include "vat_baker.hpp"
+#include "check.hpp"
+
+#include <glm/gtc/quaternion.hpp>
+#include <glm/ext/matrix_transform.hpp>
+
+#include <iostream>
+#include <filesystem>
+#include <algorithm>
+#include <cmath>
+
+// Bakes the wolf clips and compares every texel against a reference that
+// shares no code with the baker past the splines: bone transforms are
+// composed by recursion over the parents, and vertices are skinned with a
+// scalar loop. Half floats keep 11 significant bits, so coordinates of the
+// order of one may be off by about 5e-4.
+namespace
+{
+
+    constexpr float max_position_error = 1e-3f;
+    constexpr float max_normal_error = 1e-3f;
+
+    glm::mat4 reference_global(gltf_model const & model, gltf_model::animation const & animation, float time, std::uint32_t bone)
+    {
+        auto const & channels = animation.bones[bone];
+        glm::mat4 local = glm::translate(glm::mat4(1.f), channels.translation(time))
+            * glm::mat4_cast(channels.rotation(time))
+            * glm::scale(glm::mat4(1.f), channels.scale(time));
+
+        std::uint32_t const parent = model.bones[bone].parent;
+        if (parent == std::uint32_t(-1))
+            return local;
+        return reference_global(model, animation, time, parent) * local;
+    }
+
+    // Positions and normals of all vertices of all meshes, in mesh order
+    void reference_skin(gltf_model const & model, gltf_model::animation const & animation, float time,
+        std::vector<glm::vec3> & positions, std::vector<glm::vec3> & normals)
+    {
+        std::vector<glm::mat4> bones;
+        for (std::uint32_t i = 0; i < model.bones.size(); ++i)
+            bones.push_back(reference_global(model, animation, time, i) * model.bones[i].inverse_bind_matrix);
+
+        positions.clear();
+        normals.clear();
+        for (auto const & mesh : model.meshes)
+        {
+            auto const * position = reinterpret_cast<float const *>(model.buffer.data() + mesh.position.view.offset);
+            auto const * normal = reinterpret_cast<float const *>(model.buffer.data() + mesh.normal.view.offset);
+            auto const * weights = reinterpret_cast<float const *>(model.buffer.data() + mesh.weights.view.offset);
+            auto const * joints = model.buffer.data() + mesh.joints.view.offset;
+
+            for (std::size_t v = 0; v < mesh.position.count; ++v)
+            {
+                float p[3] = {}, n[3] = {};
+                for (int k = 0; k < 4; ++k)
+                {
+                    std::uint32_t const joint = (mesh.joints.type == 0x1401) // GL_UNSIGNED_BYTE
+                        ? reinterpret_cast<std::uint8_t const *>(joints)[4 * v + k]
+                        : reinterpret_cast<std::uint16_t const *>(joints)[4 * v + k];
+                    float const w = weights[4 * v + k];
+
+                    for (int r = 0; r < 3; ++r)
+                    {
+                        float sp = bones[joint][3][r];
+                        float sn = 0.f;
+                        for (int c = 0; c < 3; ++c)
+                        {
+                            sp += bones[joint][c][r] * position[3 * v + c];
+                            sn += bones[joint][c][r] * normal[3 * v + c];
+                        }
+                        p[r] += w * sp;
+                        n[r] += w * sn;
+                    }
+                }
+
+                float const length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                positions.push_back({p[0], p[1], p[2]});
+                normals.push_back({n[0] / length, n[1] / length, n[2] / length});
+            }
+        }
+    }
+
+    void test_against_reference(gltf_model const & model)
+    {
+        std::vector<glm::vec3> positions, normals;
+
+        for (auto const & [name, animation] : model.animations)
+        {
+            // A low frame rate keeps the test fast, a narrow image wraps every frame over several rows
+            float const frame_rate = 5.f;
+            auto const baked = bake_animation(model, animation, frame_rate, 1000);
+
+            CHECK(baked.info.rows_per_frame == (baked.info.vertex_count + 999) / 1000);
+            CHECK(baked.texels.size() == 2 * std::size_t(baked.info.width) * baked.height() * 3);
+            CHECK(baked.info.frame_count >= 2);
+
+            float position_error = 0.f, normal_error = 0.f;
+            for (std::uint32_t frame = 0; frame < baked.info.frame_count; ++frame)
+            {
+                // The last frame is clamped to the end of the clip
+                float const time = std::min(frame / frame_rate, animation.max_time);
+                reference_skin(model, animation, time, positions, normals);
+                CHECK(positions.size() == baked.info.vertex_count);
+
+                for (std::uint32_t v = 0; v < baked.info.vertex_count; ++v)
+                {
+                    position_error = std::max(position_error, glm::length(baked.position(frame, v) - positions[v]));
+                    normal_error = std::max(normal_error, glm::length(baked.normal(frame, v) - normals[v]));
+                }
+            }
+
+            std::cout << name << ": position error " << position_error << ", normal error " << normal_error << std::endl;
+            CHECK(position_error <= max_position_error);
+            CHECK(normal_error <= max_normal_error);
+        }
+    }
+
+    void test_save_load(gltf_model const & model)
+    {
+        auto const & animation = model.animations.begin()->second;
+        auto const baked = bake_animation(model, animation, 2.f);
+
+        auto const path = std::filesystem::temp_directory_path() / "practice13_vat_baker_test.vat";
+        save_baked_animation(baked, path.string());
+        auto const loaded = load_baked_animation(path.string());
+
+        CHECK(loaded.info.width == baked.info.width && loaded.info.rows_per_frame == baked.info.rows_per_frame);
+        CHECK(loaded.info.frame_count == baked.info.frame_count && loaded.info.vertex_count == baked.info.vertex_count);
+        CHECK(loaded.info.frame_rate == baked.info.frame_rate && loaded.info.duration == baked.info.duration);
+        CHECK(loaded.mesh_base_vertex == baked.mesh_base_vertex);
+        CHECK(loaded.texels == baked.texels);
+
+        // A file of another size is rejected instead of being misread
+        std::filesystem::resize_file(path, std::filesystem::file_size(path) + 2);
+        bool rejected = false;
+        try
+        {
+            load_baked_animation(path.string());
+        }
+        catch (std::runtime_error const &)
+        {
+            rejected = true;
+        }
+        std::filesystem::remove(path);
+        CHECK(rejected);
+    }
+
+}
+
+int main() try
+{
+    auto const model = load_gltf(std::string(PROJECT_ROOT) + "/wolf/Wolf-Blender-2.82a.gltf");
+    CHECK(!model.animations.empty());
+
+    test_against_reference(model);
+    test_save_load(model);
+    std::cout << "vat_baker: all checks passed" << std::endl;
+}
+catch (std::exception const & e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,272 @@
+#include "benchmark.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <stdexcept>
+
+std::string benchmark_options::extra_value(std::string const & name, std::string const & fallback) const
+{
+    auto it = extra.find(name);
+    return it != extra.end() ? it->second : fallback;
+}
+
+benchmark_options parse_benchmark_options(int argc, char ** argv, std::vector<benchmark_option> const & extra_options)
+{
+    benchmark_options options;
+
+    auto const is_extra = [&](std::string const & arg)
+    {
+        return std::any_of(extra_options.begin(), extra_options.end(), [&](benchmark_option const & option){ return option.name == arg; });
+    };
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string const arg = argv[i];
+        if (i + 1 == argc)
+            throw std::runtime_error("Missing value of " + arg);
+        std::string const value = argv[++i];
+
+        try
+        {
+            if (arg == "--benchmark")
+                options.frames = std::stoul(value);
+            else if (arg == "--dt")
+                options.dt = std::stof(value);
+            else if (arg == "--path")
+                options.path = value;
+            else if (arg == "--report")
+                options.report = value;
+            else if (arg == "--record")
+                options.record = value;
+            else if (is_extra(arg))
+                options.extra[arg] = value;
+            else
+            {
+                std::string usage = "Unknown argument " + arg + ", expected --benchmark, --dt, --path, --report or --record";
+                for (auto const & option : extra_options)
+                    usage += "\n    " + option.name + " <value>: " + option.help;
+                throw std::runtime_error(usage);
+            }
+        }
+        catch (std::logic_error const &)
+        {
+            throw std::runtime_error("Bad value of " + arg + ": " + value);
+        }
+    }
+
+    if (!(options.dt > 0.f))
+        throw std::runtime_error("Benchmark time step must be positive");
+
+    return options;
+}
+
+camera_path::camera_path(std::vector<std::string> parameters)
+    : names(std::move(parameters))
+{}
+
+camera_path camera_path::load(std::string const & path, std::vector<std::string> const & expected_parameters)
+{
+    std::ifstream file(path);
+    if (!file)
+        throw std::runtime_error("Failed to open " + path);
+
+    std::string line;
+    std::getline(file, line);
+    std::istringstream header(line);
+    std::vector<std::string> parameters;
+    for (std::string name; header >> name;)
+        parameters.push_back(name);
+
+    if (parameters != expected_parameters)
+        throw std::runtime_error("Camera path " + path + " has unexpected parameters");
+
+    camera_path result(std::move(parameters));
+    std::vector<float> values(result.names.size());
+    while (std::getline(file, line))
+    {
+        if (line.empty())
+            continue;
+
+        std::istringstream keyframe(line);
+        float time;
+        keyframe >> time;
+        for (auto & value : values)
+            keyframe >> value;
+        if (!keyframe)
+            throw std::runtime_error("Malformed keyframe in " + path + ": " + line);
+
+        result.add(time, values);
+    }
+
+    if (result.times.empty())
+        throw std::runtime_error("Camera path " + path + " is empty");
+
+    return result;
+}
+
+void camera_path::save(std::string const & path) const
+{
+    std::ofstream file(path);
+    if (!file)
+        throw std::runtime_error("Failed to open " + path);
+
+    for (std::size_t i = 0; i < names.size(); ++i)
+        file << (i > 0 ? " " : "") << names[i];
+    file << '\n';
+
+    file.precision(9);
+    for (std::size_t k = 0; k < times.size(); ++k)
+    {
+        file << times[k];
+        for (std::size_t i = 0; i < names.size(); ++i)
+            file << ' ' << values[k * names.size() + i];
+        file << '\n';
+    }
+}
+
+void camera_path::add(float time, std::vector<float> const & keyframe)
+{
+    if (keyframe.size() != names.size())
+        throw std::runtime_error("Camera keyframe has a wrong number of values");
+    if (!times.empty() && !(time > times.back()))
+        throw std::runtime_error("Camera keyframe times must increase");
+
+    times.push_back(time);
+    values.insert(values.end(), keyframe.begin(), keyframe.end());
+}
+
+std::vector<float> camera_path::sample(float time) const
+{
+    std::size_t const n = names.size();
+    if (times.size() < 2)
+        return times.empty() ? std::vector<float>(n, 0.f) : values;
+
+    // Loops over [times.front(), times.back()]
+    float const length = times.back() - times.front();
+    time = times.front() + std::fmod(std::max(time - times.front(), 0.f), length);
+
+    std::size_t const k = std::min<std::size_t>(std::upper_bound(times.begin(), times.end(), time) - times.begin(), times.size() - 1);
+    float const t = std::clamp((time - times[k - 1]) / (times[k] - times[k - 1]), 0.f, 1.f);
+
+    std::vector<float> result(n);
+    for (std::size_t i = 0; i < n; ++i)
+        result[i] = values[(k - 1) * n + i] * (1.f - t) + values[k * n + i] * t;
+    return result;
+}
+
+benchmark_report::benchmark_report(std::string name, benchmark_options const & options)
+    : name(std::move(name))
+    , dt(options.dt)
+    , camera_path_source(options.path.empty() ? "scripted" : options.path)
+{}
+
+std::uint32_t benchmark_report::stage(std::string const & name)
+{
+    stage_names.push_back(name);
+    current.push_back(0.f);
+    samples.emplace_back();
+    return stage_names.size() - 1;
+}
+
+std::uint32_t benchmark_report::counter(std::string const & name)
+{
+    counter_names.push_back(name);
+    counter_totals.push_back(0.0);
+    return counter_names.size() - 1;
+}
+
+void benchmark_report::end_frame()
+{
+    for (std::size_t i = 0; i < current.size(); ++i)
+    {
+        samples[i].push_back(current[i]);
+        current[i] = 0.f;
+    }
+    ++frame_count;
+}
+
+namespace
+{
+
+    void write_string(std::ostream & os, std::string const & s)
+    {
+        os << '"';
+        for (char c : s)
+        {
+            if (c == '"' || c == '\\')
+                os << '\\' << c;
+            else if (static_cast<unsigned char>(c) < 0x20)
+                os << ' ';
+            else
+                os << c;
+        }
+        os << '"';
+    }
+
+    void write_stage(std::ostream & os, std::vector<float> samples)
+    {
+        if (samples.empty())
+        {
+            os << "{}";
+            return;
+        }
+
+        double const total = std::accumulate(samples.begin(), samples.end(), 0.0);
+        std::sort(samples.begin(), samples.end());
+        auto const percentile = [&](double q)
+        {
+            std::size_t const rank = static_cast<std::size_t>(std::ceil(q * samples.size()));
+            return samples[std::clamp<std::size_t>(rank, 1, samples.size()) - 1];
+        };
+
+        os << "{\"mean\":" << total / samples.size() << ",\"p50\":" << percentile(0.5) << ",\"p95\":" << percentile(0.95)
+            << ",\"p99\":" << percentile(0.99) << ",\"max\":" << samples.back() << ",\"total\":" << total << "}";
+    }
+
+}
+
+void benchmark_report::write(std::string const & path) const
+{
+    std::ofstream os(path);
+    if (!os)
+        throw std::runtime_error("Failed to open " + path);
+
+    double const wall_time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    os.setf(std::ios::fixed, std::ios::floatfield);
+    os.precision(3);
+
+    os << "{\n\"benchmark\":";
+    write_string(os, name);
+    os << ",\n\"frames\":" << frame_count << ",\n\"dt\":" << dt << ",\n\"camera_path\":";
+    write_string(os, camera_path_source);
+    os << ",\n\"wall_time_ms\":" << wall_time;
+
+    // Milliseconds per frame
+    std::vector<float> frame(frame_count, 0.f);
+    os << ",\n\"stages\":{";
+    for (std::size_t i = 0; i < stage_names.size(); ++i)
+    {
+        for (std::size_t f = 0; f < frame_count; ++f)
+            frame[f] += samples[i][f];
+
+        os << (i > 0 ? "," : "") << "\n";
+        write_string(os, stage_names[i]);
+        os << ":";
+        write_stage(os, samples[i]);
+    }
+    os << "\n},\n\"frame\":";
+    write_stage(os, frame);
+
+    os << ",\n\"counters\":{";
+    for (std::size_t i = 0; i < counter_names.size(); ++i)
+    {
+        os << (i > 0 ? "," : "") << "\n";
+        write_string(os, counter_names[i]);
+        os << ":" << (frame_count > 0 ? counter_totals[i] / frame_count : 0.0);
+    }
+    os << "\n}\n}\n";
+}
@@ -0,0 +1,90 @@
+#include "frame_profiler.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+rolling_stats::rolling_stats(std::size_t history_size)
+	: samples(std::max<std::size_t>(history_size, 1))
+{}
+
+void rolling_stats::add(float sample)
+{
+	samples[next] = sample;
+	next = (next + 1) % samples.size();
+	size = std::min(size + 1, samples.size());
+}
+
+float rolling_stats::average() const
+{
+	if (size == 0)
+		return 0.f;
+	return std::accumulate(samples.begin(), samples.begin() + size, 0.f) / size;
+}
+
+float rolling_stats::min() const
+{
+	if (size == 0)
+		return 0.f;
+	return *std::min_element(samples.begin(), samples.begin() + size);
+}
+
+float rolling_stats::max() const
+{
+	if (size == 0)
+		return 0.f;
+	return *std::max_element(samples.begin(), samples.begin() + size);
+}
+
+namespace
+{
+
+	void write_string(std::ostream & os, std::string const & s)
+	{
+		os << '"';
+		for (char c : s)
+		{
+			if (c == '"' || c == '\\')
+				os << '\\' << c;
+			else if (static_cast<unsigned char>(c) < 0x20)
+				os << ' ';
+			else
+				os << c;
+		}
+		os << '"';
+	}
+
+	void write_event(std::ostream & os, std::string const & name, int thread, double begin, double end)
+	{
+		os << "{\"name\":";
+		write_string(os, name);
+		os << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread << ",\"ts\":" << begin << ",\"dur\":" << end - begin << "}";
+	}
+
+}
+
+void write_chrome_trace(std::ostream & os, std::vector<profiler_event> const & events, std::vector<std::string> const & names)
+{
+	// Microseconds with nanosecond resolution
+	auto const flags = os.flags();
+	auto const precision = os.precision(3);
+	os.setf(std::ios::fixed, std::ios::floatfield);
+
+	os << "{\"traceEvents\":[\n";
+	os << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n";
+	os << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}";
+
+	for (auto const & event : events)
+	{
+		os << ",\n";
+		write_event(os, names[event.scope], 1, event.cpu_begin, event.cpu_end);
+		if (event.gpu_begin >= 0.0)
+		{
+			os << ",\n";
+			write_event(os, names[event.scope], 2, event.gpu_begin, event.gpu_end);
+		}
+	}
+
+	os << "\n]}\n";
+	os.precision(precision);
+	os.flags(flags);
+}
@@ -0,0 +1,242 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <chrono>
+#include <ostream>
+#include <utility>
+#include <cstdint>
+
+// Summary of the last samples of a scope, in milliseconds
+struct rolling_stats
+{
+	explicit rolling_stats(std::size_t history_size);
+
+	void add(float sample);
+
+	std::size_t count() const { return size; }
+	float average() const;
+	float min() const;
+	float max() const;
+
+private:
+	std::vector<float> samples;
+	std::size_t next = 0;
+	std::size_t size = 0;
+};
+
+struct profiler_event
+{
+	std::uint32_t scope;
+	std::uint32_t depth;
+
+	// Microseconds; GPU times are negative if the scope was not timed on the GPU
+	double cpu_begin, cpu_end;
+	double gpu_begin = -1.0, gpu_end = -1.0;
+};
+
+// Writes events in the Chrome trace event format (chrome://tracing, Perfetto), with CPU and GPU as separate threads
+void write_chrome_trace(std::ostream & os, std::vector<profiler_event> const & events, std::vector<std::string> const & names);
+
+// Nested CPU and GPU scope markers. GPU scopes are timed with a pair of
+// timestamp queries from a fixed ring; results are polled once per frame and
+// are never waited for. If the GPU falls so far behind that the ring is full,
+// new scopes are timed on the CPU only.
+//
+// The backend performs the actual API calls and must provide
+//     query_type create_query();
+//     void destroy_query(query_type query);
+//     void timestamp(query_type query);
+//     bool available(query_type query);
+//     std::uint64_t result(query_type query); // nanoseconds
+// Queries become available in the order their timestamps were issued.
+template <typename Backend>
+struct frame_profiler
+{
+	using query_type = decltype(std::declval<Backend &>().create_query());
+
+	frame_profiler(Backend & backend, std::size_t query_count = 256, std::size_t history_size = 120, std::size_t trace_capacity = 1 << 16)
+		: backend(backend)
+		, history_size(history_size)
+		, trace_capacity(trace_capacity)
+		, queries(query_count)
+		, busy(query_count, false)
+	{
+		for (auto & query : queries)
+			query = backend.create_query();
+		trace.reserve(trace_capacity);
+	}
+
+	~frame_profiler()
+	{
+		for (auto query : queries)
+			backend.destroy_query(query);
+	}
+
+	frame_profiler(frame_profiler const &) = delete;
+	frame_profiler & operator = (frame_profiler const &) = delete;
+
+	std::uint32_t scope_id(std::string const & name)
+	{
+		auto [it, inserted] = ids.try_emplace(name, names.size());
+		if (inserted)
+		{
+			names.push_back(name);
+			cpu.emplace_back(history_size);
+			gpu.emplace_back(history_size);
+		}
+		return it->second;
+	}
+
+	void begin(std::uint32_t scope, bool gpu_timed = true)
+	{
+		open_marker marker{scope, now(), no_query};
+		if (gpu_timed)
+		{
+			if (head - tail + 2 <= queries.size())
+			{
+				marker.query = head;
+				head += 2;
+				busy[marker.query % queries.size()] = true;
+				busy[(marker.query + 1) % queries.size()] = true;
+				backend.timestamp(queries[marker.query % queries.size()]);
+			}
+			else
+				++dropped_gpu_scopes;
+		}
+		open.push_back(marker);
+	}
+
+	// Returns the CPU time of the scope in milliseconds, to feed other statistics from the same clock
+	float end()
+	{
+		open_marker const marker = open.back();
+		open.pop_back();
+
+		profiler_event event;
+		event.scope = marker.scope;
+		event.depth = open.size();
+		event.cpu_begin = marker.cpu_begin;
+		event.cpu_end = now();
+
+		float const cpu_time = (event.cpu_end - event.cpu_begin) / 1000.0;
+		cpu[event.scope].add(cpu_time);
+
+		if (marker.query == no_query)
+			record(event);
+		else
+		{
+			backend.timestamp(queries[(marker.query + 1) % queries.size()]);
+			pending.push_back({event, marker.query});
+		}
+		return cpu_time;
+	}
+
+	struct scoped_marker
+	{
+		frame_profiler & profiler;
+
+		~scoped_marker() { profiler.end(); }
+	};
+
+	[[nodiscard]] scoped_marker scope(std::uint32_t scope, bool gpu_timed = true)
+	{
+		begin(scope, gpu_timed);
+		return {*this};
+	}
+
+	// Collects finished GPU results without waiting for unfinished ones
+	void end_frame()
+	{
+		std::size_t done = 0;
+		for (; done < pending.size(); ++done)
+		{
+			auto & [event, query] = pending[done];
+			query_type const begin_query = queries[query % queries.size()];
+			query_type const end_query = queries[(query + 1) % queries.size()];
+			if (!backend.available(end_query))
+				break;
+
+			std::uint64_t const gpu_begin = backend.result(begin_query);
+			std::uint64_t const gpu_end = backend.result(end_query);
+
+			// The GPU clock is unrelated to the CPU one; align the first GPU scope with its CPU start
+			if (!gpu_origin_set)
+			{
+				gpu_origin = gpu_begin / 1000.0 - event.cpu_begin;
+				gpu_origin_set = true;
+			}
+			event.gpu_begin = gpu_begin / 1000.0 - gpu_origin;
+			event.gpu_end = gpu_end / 1000.0 - gpu_origin;
+
+			gpu[event.scope].add((gpu_end - gpu_begin) / 1e6);
+			record(event);
+
+			busy[query % queries.size()] = false;
+			busy[(query + 1) % queries.size()] = false;
+		}
+		pending.erase(pending.begin(), pending.begin() + done);
+
+		// Nested scopes finish out of allocation order, so slots are released from the tail only
+		while (tail < head && !busy[tail % queries.size()])
+			++tail;
+	}
+
+	std::string const & name(std::uint32_t scope) const { return names[scope]; }
+	std::size_t scope_count() const { return names.size(); }
+
+	rolling_stats const & cpu_stats(std::uint32_t scope) const { return cpu[scope]; }
+	rolling_stats const & gpu_stats(std::uint32_t scope) const { return gpu[scope]; }
+
+	void write_chrome_trace(std::ostream & os) const { ::write_chrome_trace(os, trace, names); }
+
+	// GPU scopes that were timed on the CPU only because the query ring was full
+	std::size_t dropped_gpu_scopes = 0;
+
+private:
+	static constexpr std::uint64_t no_query = ~std::uint64_t(0);
+
+	struct open_marker
+	{
+		std::uint32_t scope;
+		double cpu_begin;
+		std::uint64_t query;
+	};
+
+	double now() const
+	{
+		return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	void record(profiler_event const & event)
+	{
+		if (trace.size() < trace_capacity)
+			trace.push_back(event);
+	}
+
+	Backend & backend;
+	std::size_t const history_size;
+	std::size_t const trace_capacity;
+
+	std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+
+	// Ring of queries, slots [tail, head) are in use; every GPU scope takes two consecutive ones
+	std::vector<query_type> queries;
+	std::vector<bool> busy;
+	std::uint64_t head = 0;
+	std::uint64_t tail = 0;
+
+	std::vector<open_marker> open;
+	std::vector<std::pair<profiler_event, std::uint64_t>> pending;
+
+	double gpu_origin = 0.0;
+	bool gpu_origin_set = false;
+
+	std::unordered_map<std::string, std::uint32_t> ids;
+	std::vector<std::string> names;
+	std::vector<rolling_stats> cpu;
+	std::vector<rolling_stats> gpu;
+
+	std::vector<profiler_event> trace;
+};
@@ -0,0 +1,276 @@
+#include "frame_profiler.hpp"
+#include "check.hpp"
+
+#include <rapidjson/document.h>
+
+#include <iostream>
+#include <sstream>
+#include <limits>
+
+// Runs frame_profiler against a fake timer backend whose queries become
+// available a configurable number of timestamps late, and checks nested and
+// CPU-only scopes, that a full query ring drops scopes instead of waiting for
+// the GPU, that slots are released from the tail only, and that the trace is
+// valid JSON.
+namespace
+{
+
+	// Every timestamp advances the GPU clock by a fixed step. The last
+	// `latency` timestamps issued are not available yet; reading one of them
+	// would stall a real GPU, so it fails the test.
+	struct fake_timer_backend
+	{
+		static constexpr std::uint64_t step = 1000; // nanoseconds
+		static constexpr std::size_t never = std::numeric_limits<std::size_t>::max();
+
+		std::size_t latency = 0;
+
+		std::size_t created = 0;
+		std::size_t destroyed = 0;
+		std::size_t timestamps = 0;
+
+		std::size_t create_query()
+		{
+			serials.push_back(not_issued);
+			return created++;
+		}
+
+		void destroy_query(std::size_t query)
+		{
+			CHECK(query < created);
+			++destroyed;
+		}
+
+		void timestamp(std::size_t query)
+		{
+			CHECK(query < created);
+			serials[query] = timestamps++;
+		}
+
+		bool available(std::size_t query)
+		{
+			CHECK(serials[query] != not_issued);
+			return latency != never && serials[query] + latency < timestamps;
+		}
+
+		std::uint64_t result(std::size_t query)
+		{
+			CHECK(available(query));
+			return (serials[query] + 1) * step;
+		}
+
+	private:
+		static constexpr std::size_t not_issued = std::numeric_limits<std::size_t>::max();
+
+		std::vector<std::size_t> serials;
+	};
+
+	constexpr float step_ms = fake_timer_backend::step / 1e6f;
+
+	bool near(float a, float b)
+	{
+		return std::abs(a - b) <= 1e-6f;
+	}
+
+	struct trace_event
+	{
+		std::string name;
+		int thread;
+		double begin, end;
+	};
+
+	// Parses the output of write_chrome_trace, skipping the thread name metadata
+	std::vector<trace_event> parse_trace(std::string const & json)
+	{
+		rapidjson::Document document;
+		document.Parse(json.c_str());
+		CHECK(!document.HasParseError());
+		CHECK(document.IsObject() && document.HasMember("traceEvents") && document["traceEvents"].IsArray());
+
+		std::vector<trace_event> result;
+		for (auto const & event : document["traceEvents"].GetArray())
+		{
+			CHECK(event["ph"].IsString());
+			if (std::string(event["ph"].GetString()) == "M")
+				continue;
+
+			CHECK(std::string(event["ph"].GetString()) == "X");
+			CHECK(event["ts"].IsNumber() && event["dur"].IsNumber() && event["dur"].GetDouble() >= 0.0);
+			double const begin = event["ts"].GetDouble();
+			result.push_back({event["name"].GetString(), event["tid"].GetInt(), begin, begin + event["dur"].GetDouble()});
+		}
+		return result;
+	}
+
+	std::vector<trace_event> trace(frame_profiler<fake_timer_backend> const & profiler)
+	{
+		std::ostringstream os;
+		profiler.write_chrome_trace(os);
+		return parse_trace(os.str());
+	}
+
+	void test_nested()
+	{
+		fake_timer_backend backend;
+		{
+			frame_profiler<fake_timer_backend> profiler(backend, 8);
+			CHECK(backend.created == 8);
+
+			auto const outer = profiler.scope_id("outer");
+			auto const inner = profiler.scope_id("inner \"quoted\"\n");
+			CHECK(profiler.scope_id("outer") == outer);
+
+			{
+				auto outer_marker = profiler.scope(outer);
+				auto inner_marker = profiler.scope(inner);
+			}
+			CHECK(backend.timestamps == 4);
+			profiler.end_frame();
+
+			// outer spans its own timestamps and the two of inner
+			CHECK(profiler.cpu_stats(outer).count() == 1 && profiler.cpu_stats(inner).count() == 1);
+			CHECK(profiler.gpu_stats(outer).count() == 1 && profiler.gpu_stats(inner).count() == 1);
+			CHECK(near(profiler.gpu_stats(outer).average(), 3 * step_ms));
+			CHECK(near(profiler.gpu_stats(inner).average(), step_ms));
+			CHECK(profiler.dropped_gpu_scopes == 0);
+
+			auto const events = trace(profiler);
+			CHECK(events.size() == 4);
+
+			trace_event const * cpu[2] = {}, * gpu[2] = {};
+			for (auto const & event : events)
+			{
+				int const index = event.name == "outer" ? 0 : 1;
+				(event.thread == 1 ? cpu : gpu)[index] = &event;
+			}
+			for (auto spans : {cpu, gpu})
+			{
+				CHECK(spans[0] && spans[1]);
+				CHECK(spans[0]->begin <= spans[1]->begin && spans[1]->end <= spans[0]->end);
+			}
+
+			// The GPU clock is aligned with the CPU one at the first GPU scope that finished
+			CHECK(std::abs(gpu[1]->begin - cpu[1]->begin) < 1e-3);
+		}
+		CHECK(backend.destroyed == backend.created);
+	}
+
+	void test_cpu_only()
+	{
+		fake_timer_backend backend;
+		frame_profiler<fake_timer_backend> profiler(backend, 8);
+		auto const scope = profiler.scope_id("cpu");
+
+		for (int frame = 0; frame < 3; ++frame)
+		{
+			{
+				auto marker = profiler.scope(scope, false);
+			}
+			profiler.end_frame();
+		}
+
+		// end() hands out the same CPU time the profiler keeps
+		profiler.begin(scope, false);
+		float const time = profiler.end();
+		CHECK(time >= 0.f && profiler.cpu_stats(scope).max() >= time);
+
+		CHECK(backend.timestamps == 0);
+		CHECK(profiler.cpu_stats(scope).count() == 4);
+		CHECK(profiler.gpu_stats(scope).count() == 0);
+		CHECK(profiler.dropped_gpu_scopes == 0);
+
+		auto const events = trace(profiler);
+		CHECK(events.size() == 4);
+		for (auto const & event : events)
+			CHECK(event.thread == 1 && event.name == "cpu");
+	}
+
+	void test_ring_exhaustion()
+	{
+		fake_timer_backend backend;
+		backend.latency = fake_timer_backend::never;
+
+		// Room for two GPU scopes
+		frame_profiler<fake_timer_backend> profiler(backend, 4);
+		auto const scope = profiler.scope_id("scope");
+
+		for (int frame = 0; frame < 3; ++frame)
+		{
+			for (int i = 0; i < 3; ++i)
+				auto marker = profiler.scope(scope);
+			profiler.end_frame();
+		}
+
+		// The GPU never finished anything: the first two scopes hold the ring,
+		// the rest are timed on the CPU and nothing was waited for
+		CHECK(backend.timestamps == 4);
+		CHECK(profiler.dropped_gpu_scopes == 7);
+		CHECK(profiler.cpu_stats(scope).count() == 9);
+		CHECK(profiler.gpu_stats(scope).count() == 0);
+
+		// Once the GPU catches up, the ring is free again
+		backend.latency = 0;
+		profiler.end_frame();
+		CHECK(profiler.gpu_stats(scope).count() == 2);
+
+		for (int i = 0; i < 2; ++i)
+			auto marker = profiler.scope(scope);
+		profiler.end_frame();
+		CHECK(profiler.dropped_gpu_scopes == 7);
+		CHECK(profiler.gpu_stats(scope).count() == 4);
+	}
+
+	void test_tail_release()
+	{
+		fake_timer_backend backend;
+		frame_profiler<fake_timer_backend> profiler(backend, 4);
+		auto const outer = profiler.scope_id("outer");
+		auto const inner = profiler.scope_id("inner");
+
+		// outer takes slots 0 and 1, inner 2 and 3; the end timestamp of outer is issued last
+		{
+			auto outer_marker = profiler.scope(outer);
+			auto inner_marker = profiler.scope(inner);
+		}
+
+		// inner finishes first and is released, but outer still holds the tail
+		backend.latency = 1;
+		profiler.end_frame();
+		CHECK(profiler.gpu_stats(inner).count() == 1);
+		CHECK(profiler.gpu_stats(outer).count() == 0);
+
+		{
+			auto marker = profiler.scope(inner);
+		}
+		CHECK(profiler.dropped_gpu_scopes == 1);
+
+		// Releasing outer frees both scopes at once
+		backend.latency = 0;
+		profiler.end_frame();
+		CHECK(profiler.gpu_stats(outer).count() == 1);
+
+		{
+			auto outer_marker = profiler.scope(outer);
+			auto inner_marker = profiler.scope(inner);
+		}
+		CHECK(profiler.dropped_gpu_scopes == 1);
+		profiler.end_frame();
+		CHECK(profiler.gpu_stats(outer).count() == 2);
+		CHECK(profiler.gpu_stats(inner).count() == 2);
+	}
+
+}
+
+int main() try
+{
+	test_nested();
+	test_cpu_only();
+	test_ring_exhaustion();
+	test_tail_release();
+	std::cout << "frame_profiler: all checks passed" << std::endl;
+}
+catch (std::exception const & e)
+{
+	std::cerr << e.what() << std::endl;
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,184 @@
+#include "frame_stats.hpp"
+
+#include <bit>
+#include <cmath>
+#include <stdexcept>
+
+std::uint32_t latency_histogram::bucket(std::uint32_t microseconds)
+{
+	// Values below 2 * sub_bucket_count are exact, above that every power of
+	// two gets sub_bucket_count buckets
+	if (microseconds < 2 * sub_bucket_count)
+		return microseconds;
+
+	std::uint32_t const shift = std::bit_width(microseconds) - sub_bucket_bits - 1;
+	return 2 * sub_bucket_count + (shift - 1) * sub_bucket_count + ((microseconds >> shift) - sub_bucket_count);
+}
+
+std::uint32_t latency_histogram::bucket_max(std::uint32_t bucket)
+{
+	if (bucket < 2 * sub_bucket_count)
+		return bucket;
+
+	std::uint32_t const shift = (bucket - 2 * sub_bucket_count) / sub_bucket_count + 1;
+	std::uint64_t const sub = (bucket - 2 * sub_bucket_count) % sub_bucket_count + sub_bucket_count;
+	return static_cast<std::uint32_t>(((sub + 1) << shift) - 1);
+}
+
+void latency_histogram::clear()
+{
+	for (auto & count : counts)
+		count.store(0, std::memory_order_relaxed);
+}
+
+void latency_histogram::accumulate(std::array<std::uint64_t, bucket_count> & totals) const
+{
+	for (std::uint32_t i = 0; i < bucket_count; ++i)
+		totals[i] += counts[i].load(std::memory_order_relaxed);
+}
+
+frame_stats::frame_stats(std::string const & dump_path, float window_seconds, std::size_t window_count)
+	: window_seconds(window_seconds)
+	, window_count(std::max<std::size_t>(window_count, 1))
+{
+	channel("frame");
+
+	if (dump_path.empty())
+		return;
+
+	dump.open(dump_path);
+	if (!dump)
+		throw std::runtime_error("Failed to open " + dump_path);
+
+	writer = std::thread([this]{ writer_loop(); });
+}
+
+frame_stats::~frame_stats()
+{
+	stopping.store(true, std::memory_order_release);
+	if (writer.joinable())
+		writer.join();
+}
+
+std::uint32_t frame_stats::channel(std::string const & name)
+{
+	for (std::uint32_t i = 0; i < channels.size(); ++i)
+		if (channels[i].name == name)
+			return i;
+
+	channels.push_back({name, std::make_unique<latency_histogram[]>(window_count)});
+	return channels.size() - 1;
+}
+
+bool frame_stats::end_frame(float dt)
+{
+	record(frame_channel, dt * 1000.f);
+
+	window_time += dt;
+	if (window_time < window_seconds)
+		return false;
+
+	// A long stall completes a single window rather than skipping over several
+	window_time = std::fmod(window_time, window_seconds);
+	++completed_windows;
+
+	if (writer.joinable())
+	{
+		if (!pending.load(std::memory_order_acquire))
+		{
+			snapshot.resize(2 * channels.size());
+			for (std::uint32_t i = 0; i < channels.size(); ++i)
+			{
+				snapshot[2 * i] = summary(i, 1);
+				snapshot[2 * i + 1] = summary(i, window_count);
+			}
+			snapshot_window = completed_windows;
+			pending.store(true, std::memory_order_release);
+		}
+		else
+			++skipped_dumps;
+	}
+
+	// Threads still recording into the previous window are unaffected
+	std::size_t const next = (current.load(std::memory_order_relaxed) + 1) % window_count;
+	for (auto & c : channels)
+		c.windows[next].clear();
+	current.store(next, std::memory_order_relaxed);
+	return true;
+}
+
+percentile_summary frame_stats::summary(std::uint32_t channel, std::size_t windows) const
+{
+	std::array<std::uint64_t, latency_histogram::bucket_count> totals{};
+
+	auto const & c = channels[channel];
+	std::size_t const last = current.load(std::memory_order_relaxed);
+	for (std::size_t i = 0; i < std::min(windows, window_count); ++i)
+		c.windows[(last + window_count - i) % window_count].accumulate(totals);
+
+	percentile_summary result;
+	for (auto count : totals)
+		result.count += count;
+	if (result.count == 0)
+		return result;
+
+	auto const percentile = [&](double q)
+	{
+		std::uint64_t const rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(std::ceil(q * result.count)));
+		std::uint64_t seen = 0;
+		for (std::uint32_t i = 0; i < totals.size(); ++i)
+		{
+			seen += totals[i];
+			if (seen >= rank)
+				return latency_histogram::bucket_max(i) / 1000.f;
+		}
+		return 0.f;
+	};
+
+	result.p50 = percentile(0.50);
+	result.p95 = percentile(0.95);
+	result.p99 = percentile(0.99);
+	result.max = percentile(1.0);
+	return result;
+}
+
+void frame_stats::writer_loop()
+{
+	auto const write_summary = [this](percentile_summary const & s)
+	{
+		dump << "{\"count\":" << s.count << ",\"p50\":" << s.p50 << ",\"p95\":" << s.p95
+			<< ",\"p99\":" << s.p99 << ",\"max\":" << s.max << "}";
+	};
+
+	dump.setf(std::ios::fixed, std::ios::floatfield);
+	dump.precision(3);
+
+	while (true)
+	{
+		if (pending.load(std::memory_order_acquire))
+		{
+			// One JSON object per line: the last window and the whole sliding window, in milliseconds
+			dump << "{\"window\":" << snapshot_window << ",\"channels\":{";
+			for (std::uint32_t i = 0; i < snapshot.size() / 2; ++i)
+			{
+				if (i > 0)
+					dump << ",";
+				dump << "\"" << channels[i].name << "\":{\"last\":";
+				write_summary(snapshot[2 * i]);
+				dump << ",\"sliding\":";
+				write_summary(snapshot[2 * i + 1]);
+				dump << "}";
+			}
+			dump << "}}\n";
+			dump.flush();
+
+			pending.store(false, std::memory_order_release);
+			continue;
+		}
+
+		if (stopping.load(std::memory_order_acquire))
+			break;
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	}
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <string>
+#include <fstream>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+
+// Histogram of durations in microseconds with logarithmic buckets, each
+// power of two split into 32 linear sub-buckets, so that any recorded value
+// is known to within about 3% up to about an hour. Recording is a relaxed
+// atomic increment and may happen on any thread.
+struct latency_histogram
+{
+	static constexpr std::uint32_t sub_bucket_bits = 5;
+	static constexpr std::uint32_t sub_bucket_count = 1 << sub_bucket_bits;
+	static constexpr std::uint32_t bucket_count = 2 * sub_bucket_count + (32 - sub_bucket_bits - 1) * sub_bucket_count;
+
+	static std::uint32_t bucket(std::uint32_t microseconds);
+
+	// Largest value that falls into the bucket
+	static std::uint32_t bucket_max(std::uint32_t bucket);
+
+	void record(std::uint32_t microseconds)
+	{
+		counts[bucket(microseconds)].fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void clear();
+
+	// Adds the counts to totals
+	void accumulate(std::array<std::uint64_t, bucket_count> & totals) const;
+
+private:
+	std::array<std::atomic<std::uint32_t>, bucket_count> counts{};
+};
+
+struct percentile_summary
+{
+	std::uint64_t count = 0;
+
+	// Milliseconds
+	float p50 = 0.f;
+	float p95 = 0.f;
+	float p99 = 0.f;
+	float max = 0.f;
+};
+
+// Frame time statistics over sliding windows, with a breakdown by subsystem.
+// Time is split into windows of window_seconds; summaries cover the last
+// window_count of them. Each time a window is completed, the summaries of
+// all channels are handed to a writer thread that appends them as a JSON
+// line to the dump file, so the frame loop never waits for the file.
+struct frame_stats
+{
+	// Channel 0 is the frame time; an empty path disables the dump
+	frame_stats(std::string const & dump_path, float window_seconds = 1.f, std::size_t window_count = 10);
+	~frame_stats();
+
+	frame_stats(frame_stats const &) = delete;
+	frame_stats & operator = (frame_stats const &) = delete;
+
+	static constexpr std::uint32_t frame_channel = 0;
+
+	// Channels must be registered before recording starts
+	std::uint32_t channel(std::string const & name);
+
+	// Lock-free, may be called from any thread
+	void record(std::uint32_t channel, float milliseconds)
+	{
+		auto & c = channels[channel];
+		c.windows[current.load(std::memory_order_relaxed)].record(static_cast<std::uint32_t>(std::min(milliseconds * 1000.f, 4e9f)));
+	}
+
+	struct scoped_timer
+	{
+		frame_stats & stats;
+		std::uint32_t channel;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		~scoped_timer()
+		{
+			stats.record(channel, std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+		}
+	};
+
+	[[nodiscard]] scoped_timer time(std::uint32_t channel) { return {*this, channel}; }
+
+	// Records the frame time and advances the window; call once per frame from the frame thread.
+	// Returns whether the frame completed a window
+	bool end_frame(float dt);
+
+	// Over the last `windows` windows, including the current one
+	percentile_summary summary(std::uint32_t channel, std::size_t windows) const;
+
+	std::string const & name(std::uint32_t channel) const { return channels[channel].name; }
+	std::size_t channel_count() const { return channels.size(); }
+
+	// Dumps skipped because the writer was still busy with the previous one
+	std::size_t skipped_dumps = 0;
+
+private:
+	struct channel_data
+	{
+		std::string name;
+		std::unique_ptr<latency_histogram[]> windows;
+	};
+
+	void writer_loop();
+
+	float const window_seconds;
+	std::size_t const window_count;
+
+	std::deque<channel_data> channels;
+	std::atomic<std::size_t> current{0};
+	float window_time = 0.f;
+	std::uint64_t completed_windows = 0;
+
+	std::ofstream dump;
+
+	// Handed over to the writer while pending is set
+	std::vector<percentile_summary> snapshot;
+	std::uint64_t snapshot_window = 0;
+	std::atomic<bool> pending{false};
+	std::atomic<bool> stopping{false};
+	std::thread writer;
+};
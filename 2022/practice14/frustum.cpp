@@ -1,6 +1,9 @@
 #include "frustum.hpp"
 
 #include <glm/geometric.hpp>
+#include <glm/common.hpp>
+
+#include <algorithm>
 
 frustum::frustum(glm::mat4 const & view_projection)
 {
@@ -44,4 +47,48 @@ frustum::frustum(glm::mat4 const & view_projection)
 		e(2, 6),
 		e(3, 7),
 	};
+
+	glm::mat4 t = glm::transpose(view_projection);
+	planes = {
+		t[3] + t[0],
+		t[3] - t[0],
+		t[3] + t[1],
+		t[3] - t[1],
+		t[3] + t[2],
+		t[3] - t[2],
+	};
+
+	auto range = [&](glm::vec3 const & n) -> std::pair<float, float>
+	{
+		float lo = glm::dot(vertices[0], n);
+		float hi = lo;
+		for (auto const & v : vertices)
+		{
+			lo = std::min(lo, glm::dot(v, n));
+			hi = std::max(hi, glm::dot(v, n));
+		}
+		return {lo, hi};
+	};
+
+	min = max = vertices[0];
+	for (auto const & v : vertices)
+	{
+		min = glm::min(min, v);
+		max = glm::max(max, v);
+	}
+
+	for (std::size_t i = 0; i < 5; ++i)
+		face_ranges[i] = range(face_normals[i]);
+
+	// Crosses of the x, y and z axes with an edge direction, spelled out
+	for (std::size_t j = 0; j < 6; ++j)
+	{
+		glm::vec3 const & d = edge_directions[j];
+		axis_edge_normals[j] = {0.f, -d.z, d.y};
+		axis_edge_normals[6 + j] = {d.z, 0.f, -d.x};
+		axis_edge_normals[12 + j] = {-d.y, d.x, 0.f};
+	}
+
+	for (std::size_t i = 0; i < 18; ++i)
+		axis_edge_ranges[i] = range(axis_edge_normals[i]);
 }
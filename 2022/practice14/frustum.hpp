@@ -4,6 +4,7 @@
 #include <glm/mat4x4.hpp>
 
 #include <array>
+#include <utility>
 
 struct frustum
 {
@@ -11,5 +12,17 @@ struct frustum
 	std::array<glm::vec3, 5> face_normals;
 	std::array<glm::vec3, 6> edge_directions;
 
+	// Plane equations (normal, offset), with normals pointing inside
+	std::array<glm::vec4, 6> planes;
+
+	// Projections of the vertices, computed once for the separating axis tests
+	// in intersect.hpp: the coordinate ranges, the ranges along the face
+	// normals, and the ranges along the crosses of the coordinate axes with
+	// the edge directions, which are all the edge axes an aabb can add
+	glm::vec3 min, max;
+	std::array<std::pair<float, float>, 5> face_ranges;
+	std::array<glm::vec3, 18> axis_edge_normals;
+	std::array<std::pair<float, float>, 18> axis_edge_ranges;
+
 	frustum(glm::mat4 const & view_projection);
 };
@@ -0,0 +1,92 @@
+#include "frustum_culling.hpp"
+#include "aabb.hpp"
+#include "intersect.hpp"
+
+#include <cmath>
+
+void aabb_batch::clear()
+{
+	cx.clear(); cy.clear(); cz.clear();
+	ex.clear(); ey.clear(); ez.clear();
+	count = 0;
+}
+
+void aabb_batch::add(glm::vec3 const & min, glm::vec3 const & max)
+{
+	glm::vec3 const c = (min + max) / 2.f;
+	glm::vec3 const e = (max - min) / 2.f;
+
+	std::size_t const padded = (count + width) / width * width;
+	if (cx.size() < padded)
+	{
+		// Padding boxes are empty and placed at the origin; their results are ignored
+		for (auto * v : {&cx, &cy, &cz, &ex, &ey, &ez})
+			v->resize(padded, 0.f);
+	}
+
+	cx[count] = c.x; cy[count] = c.y; cz[count] = c.z;
+	ex[count] = e.x; ey[count] = e.y; ez[count] = e.z;
+	++count;
+}
+
+void classify(aabb_batch const & boxes, frustum const & f, std::vector<cull_result> & result)
+{
+	constexpr std::size_t W = aabb_batch::width;
+
+	std::size_t const padded = boxes.cx.size();
+	result.resize(padded);
+
+	float const * __restrict cx = boxes.cx.data();
+	float const * __restrict cy = boxes.cy.data();
+	float const * __restrict cz = boxes.cz.data();
+	float const * __restrict ex = boxes.ex.data();
+	float const * __restrict ey = boxes.ey.data();
+	float const * __restrict ez = boxes.ez.data();
+
+	for (std::size_t base = 0; base < padded; base += W)
+	{
+		// Bit 0: some plane has the box fully behind it; bit 1: some plane cuts the box
+		std::uint8_t outside[W] = {};
+		std::uint8_t straddles[W] = {};
+
+		for (auto const & p : f.planes)
+		{
+			float const ax = std::abs(p.x), ay = std::abs(p.y), az = std::abs(p.z);
+
+			for (std::size_t k = 0; k < W; ++k)
+			{
+				std::size_t const i = base + k;
+				float const d = p.x * cx[i] + p.y * cy[i] + p.z * cz[i] + p.w;
+				float const r = ax * ex[i] + ay * ey[i] + az * ez[i];
+
+				outside[k] |= (d < -r);
+				straddles[k] |= (d < r);
+			}
+		}
+
+		for (std::size_t k = 0; k < W; ++k)
+		{
+			result[base + k] = outside[k] ? cull_result::outside
+				: straddles[k] ? cull_result::intersecting
+				: cull_result::inside;
+		}
+	}
+
+	result.resize(boxes.size());
+}
+
+void cull(aabb_batch const & boxes, frustum const & f, bool exact, std::vector<cull_result> & scratch, std::vector<std::uint32_t> & visible)
+{
+	classify(boxes, f, scratch);
+
+	for (std::size_t i = 0; i < scratch.size(); ++i)
+	{
+		if (scratch[i] == cull_result::outside)
+			continue;
+
+		if (exact && scratch[i] == cull_result::intersecting && !intersect(aabb(boxes.min(i), boxes.max(i)), f))
+			continue;
+
+		visible.push_back(i);
+	}
+}
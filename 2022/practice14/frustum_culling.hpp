@@ -0,0 +1,48 @@
+#pragma once
+
+#include "frustum.hpp"
+
+#include <glm/vec3.hpp>
+
+#include <vector>
+#include <cstdint>
+
+// Axis-aligned boxes stored as separate center and extent arrays, padded to
+// a multiple of the batch width, so that the plane test below processes a
+// whole batch of boxes per iteration with no gathers
+struct aabb_batch
+{
+	static constexpr std::size_t width = 8;
+
+	std::vector<float> cx, cy, cz;
+	std::vector<float> ex, ey, ez;
+
+	std::size_t size() const { return count; }
+
+	void clear();
+	void add(glm::vec3 const & min, glm::vec3 const & max);
+
+	glm::vec3 min(std::size_t i) const { return {cx[i] - ex[i], cy[i] - ey[i], cz[i] - ez[i]}; }
+	glm::vec3 max(std::size_t i) const { return {cx[i] + ex[i], cy[i] + ey[i], cz[i] + ez[i]}; }
+
+private:
+	std::size_t count = 0;
+};
+
+enum class cull_result : std::uint8_t
+{
+	outside = 0,
+	intersecting = 1,
+	inside = 2,
+};
+
+// Classifies every box against the six frustum planes
+void classify(aabb_batch const & boxes, frustum const & f, std::vector<cull_result> & result);
+
+// Appends indices of the boxes that intersect the frustum. The plane test is
+// conservative near frustum edges and corners; with exact set, boxes it
+// classifies as intersecting are refined with the separating axis test, so
+// the result matches intersect(aabb, frustum). The classification of every
+// box goes to the caller-owned scratch buffer, which keeps its capacity
+// from one call to the next.
+void cull(aabb_batch const & boxes, frustum const & f, bool exact, std::vector<cull_result> & scratch, std::vector<std::uint32_t> & visible);
@@ -0,0 +1,224 @@
+#include "gl_state_cache.hpp"
+#include "check.hpp"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <utility>
+#include <initializer_list>
+
+// Runs gl_state_cache against a backend that records the calls it receives,
+// and checks which calls are issued and elided and how they are counted
+namespace
+{
+
+	// OpenGL enums, without including OpenGL
+	constexpr unsigned int gl_texture_2d = 0x0DE1;
+	constexpr unsigned int gl_texture_cube_map = 0x8513;
+	constexpr unsigned int gl_depth_test = 0x0B71;
+	constexpr unsigned int gl_blend = 0x0BE2;
+	constexpr unsigned int gl_src_alpha = 0x0302;
+	constexpr unsigned int gl_one_minus_src_alpha = 0x0303;
+	constexpr unsigned int gl_one = 1;
+
+	struct recording_backend
+	{
+		std::vector<std::string> calls;
+
+		void use_program(unsigned int program) { record("use_program", {program}); }
+		void bind_vertex_array(unsigned int vertex_array) { record("bind_vertex_array", {vertex_array}); }
+		void active_texture(unsigned int unit) { record("active_texture", {unit}); }
+		void bind_texture(unsigned int target, unsigned int texture) { record("bind_texture", {target, texture}); }
+		void enable(unsigned int capability, bool enabled) { record(enabled ? "enable" : "disable", {capability}); }
+		void blend_func(unsigned int source, unsigned int destination) { record("blend_func", {source, destination}); }
+		void depth_mask(bool enabled) { record("depth_mask", {enabled}); }
+
+		void clear_color(float r, float g, float b, float a)
+		{
+			calls.push_back("clear_color " + std::to_string(r) + " " + std::to_string(g) + " " + std::to_string(b) + " " + std::to_string(a));
+		}
+
+		// Returns the calls since the last take()
+		std::vector<std::string> take()
+		{
+			return std::exchange(calls, {});
+		}
+
+	private:
+		void record(std::string call, std::initializer_list<unsigned int> arguments)
+		{
+			for (unsigned int argument : arguments)
+				call += " " + std::to_string(argument);
+			calls.push_back(std::move(call));
+		}
+	};
+
+	using calls = std::vector<std::string>;
+
+	template <typename Statistics>
+	bool counts(Statistics const & statistics, std::uint64_t issued, std::uint64_t elided)
+	{
+		return statistics.issued == issued && statistics.elided == elided;
+	}
+
+	void test_repeated_binds()
+	{
+		recording_backend backend;
+		gl_state_cache<recording_backend> state(backend);
+
+		for (int i = 0; i < 3; ++i)
+		{
+			state.use_program(1);
+			state.bind_vertex_array(4);
+		}
+		CHECK((backend.take() == calls{"use_program 1", "bind_vertex_array 4"}));
+		CHECK(counts(state.frame(), 2, 4));
+
+		// Binding zero is a change like any other
+		state.use_program(0);
+		state.bind_vertex_array(0);
+		state.bind_vertex_array(0);
+		CHECK((backend.take() == calls{"use_program 0", "bind_vertex_array 0"}));
+		CHECK(counts(state.frame(), 4, 5));
+	}
+
+	void test_lazy_active_texture()
+	{
+		recording_backend backend;
+		gl_state_cache<recording_backend> state(backend);
+
+		// The unit switch is issued and counted only together with a binding that changes
+		state.bind_texture(0, gl_texture_2d, 5);
+		state.bind_texture(0, gl_texture_2d, 5);
+		CHECK((backend.take() == calls{"active_texture 0", "bind_texture 3553 5"}));
+		CHECK(counts(state.frame(), 2, 1));
+
+		state.bind_texture(1, gl_texture_2d, 6);
+		state.bind_texture(1, gl_texture_2d, 7);
+		CHECK((backend.take() == calls{"active_texture 1", "bind_texture 3553 6", "bind_texture 3553 7"}));
+		CHECK(counts(state.frame(), 5, 1));
+
+		// Unit 0 still has texture 5, so the active unit stays 1
+		state.bind_texture(0, gl_texture_2d, 5);
+		CHECK(backend.take().empty());
+		CHECK(counts(state.frame(), 5, 2));
+
+		// Targets of a unit are bound separately
+		state.bind_texture(1, gl_texture_cube_map, 7);
+		state.bind_texture(0, gl_texture_cube_map, 8);
+		CHECK((backend.take() == calls{"bind_texture 34067 7", "active_texture 0", "bind_texture 34067 8"}));
+		CHECK(counts(state.frame(), 8, 2));
+	}
+
+	void test_enable_toggles()
+	{
+		recording_backend backend;
+		gl_state_cache<recording_backend> state(backend);
+
+		state.enable(gl_depth_test, true);
+		state.enable(gl_depth_test, true);
+		state.enable(gl_depth_test, false);
+		state.enable(gl_depth_test, false);
+		state.enable(gl_depth_test, true);
+
+		// Unknown until set, so disabling is issued too
+		state.enable(gl_blend, false);
+		state.enable(gl_blend, false);
+		CHECK((backend.take() == calls{"enable 2929", "disable 2929", "enable 2929", "disable 3042"}));
+		CHECK(counts(state.frame(), 4, 3));
+
+		state.blend_func(gl_src_alpha, gl_one_minus_src_alpha);
+		state.blend_func(gl_src_alpha, gl_one_minus_src_alpha);
+		state.blend_func(gl_src_alpha, gl_one);
+		state.depth_mask(false);
+		state.depth_mask(false);
+		state.depth_mask(true);
+		CHECK((backend.take() == calls{"blend_func 770 771", "blend_func 770 1", "depth_mask 0", "depth_mask 1"}));
+		CHECK(counts(state.frame(), 8, 5));
+	}
+
+	void test_clear_color()
+	{
+		recording_backend backend;
+		gl_state_cache<recording_backend> state(backend);
+
+		state.clear_color(0.f, 0.f, 0.f, 0.f);
+		state.clear_color(0.f, 0.f, 0.f, 0.f);
+		state.clear_color(0.8f, 0.8f, 1.f, 0.f);
+		state.clear_color(0.8f, 0.8f, 1.f, 0.f);
+		state.clear_color(0.8f, 0.8f, 1.f, 1.f);
+		CHECK(backend.take().size() == 3);
+		CHECK(counts(state.frame(), 3, 2));
+	}
+
+	void test_end_frame()
+	{
+		recording_backend backend;
+		gl_state_cache<recording_backend> state(backend);
+
+		state.use_program(1);
+		state.use_program(1);
+		state.end_frame();
+		CHECK((backend.take() == calls{"use_program 1"}));
+		CHECK(counts(state.last_frame(), 1, 1));
+		CHECK(counts(state.frame(), 0, 0));
+
+		// State carries over to the next frame
+		state.use_program(1);
+		state.clear_color(1.f, 1.f, 1.f, 1.f);
+		CHECK((backend.take() == calls{"clear_color 1.000000 1.000000 1.000000 1.000000"}));
+		CHECK(counts(state.frame(), 1, 1));
+		CHECK(counts(state.last_frame(), 1, 1));
+
+		state.end_frame();
+		CHECK(counts(state.last_frame(), 1, 1));
+		state.end_frame();
+		CHECK(counts(state.last_frame(), 0, 0));
+	}
+
+	void test_invalidate()
+	{
+		recording_backend backend;
+		gl_state_cache<recording_backend> state(backend);
+
+		auto const set_all = [&]
+		{
+			state.use_program(1);
+			state.bind_vertex_array(2);
+			state.bind_texture(0, gl_texture_2d, 3);
+			state.enable(gl_depth_test, true);
+			state.blend_func(gl_src_alpha, gl_one_minus_src_alpha);
+			state.depth_mask(true);
+			state.clear_color(0.f, 0.f, 0.f, 0.f);
+		};
+
+		set_all();
+		auto const first = backend.take();
+		CHECK(first.size() == 8);
+		set_all();
+		CHECK(backend.take().empty());
+
+		// Everything is issued again, including the unit switch; counters are kept
+		state.invalidate();
+		set_all();
+		CHECK(backend.take() == first);
+		CHECK(counts(state.frame(), 16, 7));
+	}
+
+}
+
+int main() try
+{
+	test_repeated_binds();
+	test_lazy_active_texture();
+	test_enable_toggles();
+	test_clear_color();
+	test_end_frame();
+	test_invalidate();
+	std::cout << "gl_state_cache: all checks passed" << std::endl;
+}
+catch (std::exception const & e)
+{
+	std::cerr << e.what() << std::endl;
+	return EXIT_FAILURE;
+}
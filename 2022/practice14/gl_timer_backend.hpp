@@ -0,0 +1,40 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstdint>
+
+// frame_profiler backend for OpenGL 3.3 timestamp queries
+struct gl_timer_backend
+{
+	GLuint create_query()
+	{
+		GLuint query;
+		glGenQueries(1, &query);
+		return query;
+	}
+
+	void destroy_query(GLuint query)
+	{
+		glDeleteQueries(1, &query);
+	}
+
+	void timestamp(GLuint query)
+	{
+		glQueryCounter(query, GL_TIMESTAMP);
+	}
+
+	bool available(GLuint query)
+	{
+		GLint result;
+		glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &result);
+		return result == GL_TRUE;
+	}
+
+	std::uint64_t result(GLuint query)
+	{
+		GLuint64 time;
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &time);
+		return time;
+	}
+};
@@ -0,0 +1,99 @@
+#include "image_diff.hpp"
+
+#include <glm/vec3.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+	// Weights of the YIQ distance, after Kotsarenko and Ramos, "Measuring perceived color difference using YIQ NTSC transmission color space"
+	constexpr float max_yiq_delta = 35215.f;
+
+	glm::vec3 to_yiq(std::uint8_t const * rgba)
+	{
+		float const alpha = rgba[3] / 255.f;
+		float const r = 255.f + (rgba[0] - 255.f) * alpha;
+		float const g = 255.f + (rgba[1] - 255.f) * alpha;
+		float const b = 255.f + (rgba[2] - 255.f) * alpha;
+
+		return {
+			r * 0.29889531f + g * 0.58662247f + b * 0.11448223f,
+			r * 0.59597799f - g * 0.27417610f - b * 0.32180189f,
+			r * 0.21147017f - g * 0.52261711f + b * 0.31114694f,
+		};
+	}
+
+	float yiq_delta(glm::vec3 const & a, glm::vec3 const & b)
+	{
+		glm::vec3 const d = a - b;
+		return 0.5053f * d.x * d.x + 0.299f * d.y * d.y + 0.1957f * d.z * d.z;
+	}
+
+}
+
+image_diff_result compare_images(int width, int height, std::uint8_t const * expected, std::uint8_t const * actual,
+	image_diff_options const & options)
+{
+	std::size_t const pixel_count = std::size_t(width) * height;
+
+	std::vector<glm::vec3> expected_yiq(pixel_count), actual_yiq(pixel_count);
+	for (std::size_t i = 0; i < pixel_count; ++i)
+	{
+		expected_yiq[i] = to_yiq(expected + i * 4);
+		actual_yiq[i] = to_yiq(actual + i * 4);
+	}
+
+	float const limit = max_yiq_delta * options.threshold * options.threshold;
+
+	// Whether pixel (x, y) of one image matches any pixel around (x, y) of the other one
+	auto const matches_nearby = [&](std::vector<glm::vec3> const & image, std::vector<glm::vec3> const & other, int x, int y)
+	{
+		glm::vec3 const & color = image[std::size_t(y) * width + x];
+		for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, height - 1); ++ny)
+			for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, width - 1); ++nx)
+				if (yiq_delta(color, other[std::size_t(ny) * width + nx]) <= limit)
+					return true;
+		return false;
+	};
+
+	image_diff_result result;
+	result.diff.resize(pixel_count * 4);
+
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			std::size_t const i = std::size_t(y) * width + x;
+			float const delta = yiq_delta(expected_yiq[i], actual_yiq[i]);
+			result.max_delta = std::max(result.max_delta, std::sqrt(delta / max_yiq_delta));
+
+			std::uint8_t * out = result.diff.data() + i * 4;
+			out[3] = 255;
+
+			if (delta <= limit)
+			{
+				std::uint8_t const grey = static_cast<std::uint8_t>(255.f - (255.f - std::clamp(expected_yiq[i].x, 0.f, 255.f)) * 0.1f);
+				out[0] = out[1] = out[2] = grey;
+			}
+			else if (options.shift_tolerance && matches_nearby(actual_yiq, expected_yiq, x, y) && matches_nearby(expected_yiq, actual_yiq, x, y))
+			{
+				++result.tolerated;
+				out[0] = 255;
+				out[1] = 255;
+				out[2] = 0;
+			}
+			else
+			{
+				++result.different;
+				out[0] = 255;
+				out[1] = 0;
+				out[2] = 0;
+			}
+		}
+	}
+
+	result.passed = result.different <= options.max_different * pixel_count;
+	return result;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+// Perceptual comparison of RGBA8 images. Colors are blended over white and
+// compared by a weighted distance in YIQ space, which follows perceived
+// brightness and hue better than RGB; a pixel differs if the distance exceeds
+// threshold (0 to 1) of the largest possible one.
+//
+// Rasterization changes often move edges by a pixel. With shift_tolerance, a
+// differing pixel is tolerated if each image has a matching pixel in the
+// 3x3 neighbourhood of the other one; tolerated pixels don't fail the
+// comparison but are shown in the diff image.
+struct image_diff_options
+{
+	float threshold = 0.1f;
+	bool shift_tolerance = true;
+	// Largest fraction of differing pixels that still passes
+	float max_different = 0.001f;
+};
+
+struct image_diff_result
+{
+	std::size_t different = 0;
+	std::size_t tolerated = 0;
+	// Largest per-pixel distance, in the units of threshold
+	float max_delta = 0.f;
+	bool passed = false;
+
+	// RGBA8: the expected image faded to grey, differing pixels red, tolerated ones yellow
+	std::vector<std::uint8_t> diff;
+};
+
+// Images must have the same size
+image_diff_result compare_images(int width, int height, std::uint8_t const * expected, std::uint8_t const * actual,
+	image_diff_options const & options = {});
@@ -0,0 +1,346 @@
+#include "instance_bvh.hpp"
+#include "aabb.hpp"
+#include "intersect.hpp"
+
+#include <glm/common.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+namespace
+{
+
+	enum class box_class
+	{
+		outside,
+		intersecting,
+		inside,
+	};
+
+	constexpr std::uint8_t all_planes = 0x3f;
+	constexpr std::uint8_t no_plane = 0xff;
+
+	// Tests the planes in mask, starting with the hinted one; planes the box is
+	// fully inside of are removed from mask, the rejecting plane is stored in hint
+	box_class classify(frustum const & f, glm::vec3 const & min, glm::vec3 const & max,
+		std::uint8_t & mask, std::uint8_t * hint, std::size_t & tests)
+	{
+		glm::vec3 const c = (min + max) / 2.f;
+		glm::vec3 const e = (max - min) / 2.f;
+
+		// Returns false if the box is outside of plane i
+		auto test = [&](std::uint8_t i)
+		{
+			glm::vec4 const & p = f.planes[i];
+			float const d = p.x * c.x + p.y * c.y + p.z * c.z + p.w;
+			float const r = std::abs(p.x) * e.x + std::abs(p.y) * e.y + std::abs(p.z) * e.z;
+
+			++tests;
+			if (d < -r)
+				return false;
+			if (d >= r)
+				mask &= ~(1 << i);
+			return true;
+		};
+
+		std::uint8_t const first = hint ? *hint : no_plane;
+		if (first != no_plane && (mask & (1 << first)) && !test(first))
+			return box_class::outside;
+
+		for (std::uint8_t i = 0; i < f.planes.size(); ++i)
+		{
+			if (i == first || !(mask & (1 << i)))
+				continue;
+
+			if (!test(i))
+			{
+				if (hint)
+					*hint = i;
+				return box_class::outside;
+			}
+		}
+
+		return mask ? box_class::intersecting : box_class::inside;
+	}
+
+	float half_area(glm::vec3 const & min, glm::vec3 const & max)
+	{
+		glm::vec3 const d = glm::max(max - min, glm::vec3(0.f));
+		return d.x * d.y + d.y * d.z + d.z * d.x;
+	}
+
+	constexpr float inf = std::numeric_limits<float>::infinity();
+
+}
+
+void instance_bvh::build(std::vector<glm::vec3> const & min, std::vector<glm::vec3> const & max)
+{
+	instance_min = min;
+	instance_max = max;
+
+	std::uint32_t const count = min.size();
+
+	indices.resize(count);
+	for (std::uint32_t i = 0; i < count; ++i)
+		indices[i] = i;
+
+	std::vector<glm::vec3> centroids(count);
+	for (std::uint32_t i = 0; i < count; ++i)
+		centroids[i] = (min[i] + max[i]) / 2.f;
+
+	nodes.clear();
+	nodes.reserve(count > 0 ? 2 * ((count + max_leaf_size - 1) / max_leaf_size) : 1);
+	nodes.push_back({glm::vec3(inf), 0, glm::vec3(-inf), count, 0});
+
+	// Children are always created after their parent
+	std::vector<std::uint32_t> stack{0};
+	while (!stack.empty())
+	{
+		std::uint32_t const node_index = stack.back();
+		stack.pop_back();
+
+		build_node(node_index, centroids);
+		if (nodes[node_index].left != 0)
+		{
+			stack.push_back(nodes[node_index].left);
+			stack.push_back(nodes[node_index].left + 1);
+		}
+	}
+
+	refit(min, max);
+}
+
+void instance_bvh::build_node(std::uint32_t node_index, std::vector<glm::vec3> const & centroids)
+{
+	std::uint32_t const begin = nodes[node_index].begin;
+	std::uint32_t const end = nodes[node_index].end;
+
+	if (end - begin <= max_leaf_size)
+		return;
+
+	glm::vec3 cmin(inf), cmax(-inf);
+	for (std::uint32_t i = begin; i < end; ++i)
+	{
+		cmin = glm::min(cmin, centroids[indices[i]]);
+		cmax = glm::max(cmax, centroids[indices[i]]);
+	}
+
+	glm::vec3 const extent = cmax - cmin;
+	int axis = 0;
+	if (extent.y > extent[axis]) axis = 1;
+	if (extent.z > extent[axis]) axis = 2;
+
+	std::uint32_t middle = begin;
+
+	if (extent[axis] > 0.f)
+	{
+		struct bin
+		{
+			glm::vec3 min{inf};
+			glm::vec3 max{-inf};
+			std::uint32_t count = 0;
+		};
+
+		bin bins[bin_count];
+		float const scale = bin_count / extent[axis];
+
+		auto bin_of = [&](std::uint32_t instance)
+		{
+			int b = static_cast<int>((centroids[instance][axis] - cmin[axis]) * scale);
+			return std::min<std::uint32_t>(b, bin_count - 1);
+		};
+
+		for (std::uint32_t i = begin; i < end; ++i)
+		{
+			auto & b = bins[bin_of(indices[i])];
+			b.min = glm::min(b.min, instance_min[indices[i]]);
+			b.max = glm::max(b.max, instance_max[indices[i]]);
+			++b.count;
+		}
+
+		// Cost of splitting after bin k is area(left) * count(left) + area(right) * count(right)
+		float right_cost[bin_count];
+		{
+			glm::vec3 rmin(inf), rmax(-inf);
+			std::uint32_t rcount = 0;
+			for (std::uint32_t k = bin_count; k-- > 1;)
+			{
+				rmin = glm::min(rmin, bins[k].min);
+				rmax = glm::max(rmax, bins[k].max);
+				rcount += bins[k].count;
+				right_cost[k] = half_area(rmin, rmax) * rcount;
+			}
+		}
+
+		float best_cost = inf;
+		std::uint32_t best_split = 0;
+		{
+			glm::vec3 lmin(inf), lmax(-inf);
+			std::uint32_t lcount = 0;
+			for (std::uint32_t k = 0; k + 1 < bin_count; ++k)
+			{
+				lmin = glm::min(lmin, bins[k].min);
+				lmax = glm::max(lmax, bins[k].max);
+				lcount += bins[k].count;
+
+				float const cost = half_area(lmin, lmax) * lcount + right_cost[k + 1];
+				if (lcount > 0 && lcount < end - begin && cost < best_cost)
+				{
+					best_cost = cost;
+					best_split = k;
+				}
+			}
+		}
+
+		if (best_cost < inf)
+		{
+			auto it = std::partition(indices.begin() + begin, indices.begin() + end,
+				[&](std::uint32_t instance){ return bin_of(instance) <= best_split; });
+			middle = it - indices.begin();
+		}
+	}
+
+	// All centroids coincide or fall into one bin: split the range in half
+	if (middle == begin || middle == end)
+	{
+		middle = begin + (end - begin) / 2;
+		std::nth_element(indices.begin() + begin, indices.begin() + middle, indices.begin() + end,
+			[&](std::uint32_t a, std::uint32_t b){ return centroids[a][axis] < centroids[b][axis]; });
+	}
+
+	std::uint32_t const left = nodes.size();
+	nodes.push_back({glm::vec3(inf), begin, glm::vec3(-inf), middle, 0});
+	nodes.push_back({glm::vec3(inf), middle, glm::vec3(-inf), end, 0});
+	nodes[node_index].left = left;
+}
+
+void instance_bvh::update_bounds(node & n) const
+{
+	n.min = glm::vec3(inf);
+	n.max = glm::vec3(-inf);
+
+	if (n.left != 0)
+	{
+		for (std::uint32_t c = n.left; c < n.left + 2; ++c)
+		{
+			n.min = glm::min(n.min, nodes[c].min);
+			n.max = glm::max(n.max, nodes[c].max);
+		}
+		return;
+	}
+
+	for (std::uint32_t i = n.begin; i < n.end; ++i)
+	{
+		n.min = glm::min(n.min, instance_min[indices[i]]);
+		n.max = glm::max(n.max, instance_max[indices[i]]);
+	}
+}
+
+void instance_bvh::refit(std::vector<glm::vec3> const & min, std::vector<glm::vec3> const & max)
+{
+	if (&instance_min != &min)
+		instance_min = min;
+	if (&instance_max != &max)
+		instance_max = max;
+
+	for (std::size_t i = nodes.size(); i-- > 0;)
+		update_bounds(nodes[i]);
+}
+
+void instance_bvh::split(std::size_t min_roots, std::vector<std::uint32_t> & roots) const
+{
+	roots.clear();
+	if (nodes.empty() || indices.empty())
+		return;
+
+	roots.push_back(0);
+
+	std::vector<std::uint32_t> next;
+	while (roots.size() < min_roots)
+	{
+		next.clear();
+		for (std::uint32_t r : roots)
+		{
+			if (nodes[r].left != 0)
+			{
+				next.push_back(nodes[r].left);
+				next.push_back(nodes[r].left + 1);
+			}
+			else
+				next.push_back(r);
+		}
+
+		if (next.size() == roots.size())
+			break;
+
+		roots.swap(next);
+	}
+}
+
+void instance_bvh::coherence_state::reset(instance_bvh const & bvh)
+{
+	node_plane.assign(bvh.nodes.size(), no_plane);
+	instance_plane.assign(bvh.instance_min.size(), no_plane);
+}
+
+std::size_t instance_bvh::cull(frustum const & f, bool exact, std::vector<std::uint32_t> & visible, std::uint32_t root,
+	coherence_state * coherence, bool plane_masks) const
+{
+	std::size_t tests = 0;
+
+	if (nodes.empty() || indices.empty())
+		return tests;
+
+	struct entry
+	{
+		std::uint32_t node;
+		std::uint8_t mask;
+	};
+
+	entry stack[64];
+	std::size_t stack_size = 0;
+	stack[stack_size++] = {root, all_planes};
+
+	while (stack_size > 0)
+	{
+		auto [node_index, mask] = stack[--stack_size];
+		node const & n = nodes[node_index];
+
+		auto const c = classify(f, n.min, n.max, mask, coherence ? &coherence->node_plane[node_index] : nullptr, tests);
+		if (c == box_class::outside)
+			continue;
+
+		if (c == box_class::inside)
+		{
+			visible.insert(visible.end(), indices.begin() + n.begin, indices.begin() + n.end);
+			continue;
+		}
+
+		if (!plane_masks)
+			mask = all_planes;
+
+		if (n.left != 0 && stack_size + 2 <= std::size(stack))
+		{
+			stack[stack_size++] = {n.left + 1, mask};
+			stack[stack_size++] = {n.left, mask};
+			continue;
+		}
+
+		// A leaf, or a subtree too deep for the stack: test its instances one by one
+		for (std::uint32_t i = n.begin; i < n.end; ++i)
+		{
+			std::uint32_t const instance = indices[i];
+			std::uint8_t instance_mask = mask;
+			auto const ci = classify(f, instance_min[instance], instance_max[instance], instance_mask,
+				coherence ? &coherence->instance_plane[instance] : nullptr, tests);
+			if (ci == box_class::outside)
+				continue;
+			if (exact && ci == box_class::intersecting && !intersect(aabb(instance_min[instance], instance_max[instance]), f))
+				continue;
+			visible.push_back(instance);
+		}
+	}
+
+	return tests;
+}
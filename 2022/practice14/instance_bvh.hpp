@@ -0,0 +1,71 @@
+#pragma once
+
+#include "frustum.hpp"
+
+#include <glm/vec3.hpp>
+
+#include <vector>
+#include <cstdint>
+
+// Bounding volume hierarchy over instance boxes, built with a binned surface
+// area heuristic. Every node covers a contiguous range of the instance
+// permutation, so a subtree that is fully inside the frustum is accepted by
+// copying its range without visiting its children.
+struct instance_bvh
+{
+	struct node
+	{
+		glm::vec3 min;
+		std::uint32_t begin;
+		glm::vec3 max;
+		std::uint32_t end;
+		// Index of the left child, the right child follows it; 0 for leaves
+		std::uint32_t left;
+	};
+
+	// Culling state kept between frames: the plane that last rejected each
+	// node and each instance is tested first, since under small camera motion
+	// it is likely to reject them again
+	struct coherence_state
+	{
+		std::vector<std::uint8_t> node_plane;
+		std::vector<std::uint8_t> instance_plane;
+
+		void reset(instance_bvh const & bvh);
+	};
+
+	static constexpr std::uint32_t max_leaf_size = 4;
+	static constexpr std::uint32_t bin_count = 16;
+
+	std::vector<node> nodes;
+
+	// Instance indices in tree order
+	std::vector<std::uint32_t> indices;
+
+	// Instance boxes, in instance order
+	std::vector<glm::vec3> instance_min;
+	std::vector<glm::vec3> instance_max;
+
+	void build(std::vector<glm::vec3> const & min, std::vector<glm::vec3> const & max);
+
+	// Updates instance boxes and node bounds, keeping the topology
+	void refit(std::vector<glm::vec3> const & min, std::vector<glm::vec3> const & max);
+
+	// Appends indices of instances whose boxes intersect the frustum; with
+	// exact set, instance boxes cut by a frustum plane are refined with the
+	// separating axis test. With plane_masks set, children skip the planes
+	// their parent is fully inside of; without, every node is tested against
+	// all planes, which only serves as a baseline. With a coherence state,
+	// concurrent calls must use disjoint subtrees. Returns the number of
+	// box-plane tests performed.
+	std::size_t cull(frustum const & f, bool exact, std::vector<std::uint32_t> & visible, std::uint32_t root = 0,
+		coherence_state * coherence = nullptr, bool plane_masks = true) const;
+
+	// Splits the tree into at least min_roots subtrees where possible; the
+	// subtrees are listed in tree order and cover consecutive instance ranges
+	void split(std::size_t min_roots, std::vector<std::uint32_t> & roots) const;
+
+private:
+	void build_node(std::uint32_t node_index, std::vector<glm::vec3> const & centroids);
+	void update_bounds(node & n) const;
+};
@@ -1,7 +1,14 @@
 #pragma once
 
+#include "aabb.hpp"
+#include "obb.hpp"
+#include "sphere.hpp"
+#include "frustum.hpp"
+
 #include <glm/vec3.hpp>
 #include <glm/geometric.hpp>
+#include <glm/common.hpp>
+#include <glm/vector_relational.hpp>
 
 #include <limits>
 #include <utility>
@@ -61,3 +68,156 @@ bool intersect(Body1 const & b1, Body2 const & b2)
 
 	return true;
 }
+
+// Specializations of the separating axis test for known body pairs. They
+// test the same axes as the generic version, minus those that are zero or
+// repeated for these shapes, and project boxes through their center and
+// half extents instead of through all eight vertices. Frustum projections
+// onto its own face normals and onto the aabb edge axes are precomputed
+// by the frustum, the others depend on the body.
+
+namespace intersect_detail
+{
+
+	// The interval center +- radius against a projection range
+	inline bool separated(std::pair<float, float> const & range, float center, float radius)
+	{
+		return (center + radius < range.first) || (center - radius > range.second);
+	}
+
+	// Projection of the frustum onto n, compared with the interval center +- radius
+	inline bool separated(frustum const & f, glm::vec3 const & n, float center, float radius)
+	{
+		return separated(project(f, n), center, radius);
+	}
+
+	// Along the frustum face normals; radius(n) is the half width of the body
+	// projection onto n
+	template <typename Radius>
+	bool separated_by_faces(frustum const & f, glm::vec3 const & center, Radius const & radius)
+	{
+		for (std::size_t i = 0; i < f.face_normals.size(); ++i)
+		{
+			glm::vec3 const & n = f.face_normals[i];
+			if (separated(f.face_ranges[i], glm::dot(center, n), radius(n)))
+				return true;
+		}
+
+		return false;
+	}
+
+}
+
+// Both face normal sets are the coordinate axes and all edge cross products
+// are axes or zero, so only the three axis intervals remain
+inline bool intersect(aabb const & b1, aabb const & b2)
+{
+	return glm::all(glm::lessThanEqual(b1.min, b2.max)) && glm::all(glm::lessThanEqual(b2.min, b1.max));
+}
+
+inline bool intersect(aabb const & b, frustum const & f)
+{
+	// Along the box axes, the frustum projects onto the coordinate ranges of its vertices
+	if (glm::any(glm::lessThan(f.max, b.min)) || glm::any(glm::greaterThan(f.min, b.max)))
+		return false;
+
+	glm::vec3 const center = (b.min + b.max) / 2.f;
+	glm::vec3 const extent = (b.max - b.min) / 2.f;
+	auto const radius = [&](glm::vec3 const & n){ return glm::dot(extent, glm::abs(n)); };
+
+	if (intersect_detail::separated_by_faces(f, center, radius))
+		return false;
+
+	for (std::size_t i = 0; i < f.axis_edge_normals.size(); ++i)
+	{
+		glm::vec3 const & n = f.axis_edge_normals[i];
+		if (intersect_detail::separated(f.axis_edge_ranges[i], glm::dot(center, n), radius(n)))
+			return false;
+	}
+
+	return true;
+}
+
+inline bool intersect(frustum const & f, aabb const & b)
+{
+	return intersect(b, f);
+}
+
+inline bool intersect(obb const & b, frustum const & f)
+{
+	auto const radius = [&](glm::vec3 const & n)
+	{
+		return b.half_extents.x * std::abs(glm::dot(b.face_normals[0], n))
+			+ b.half_extents.y * std::abs(glm::dot(b.face_normals[1], n))
+			+ b.half_extents.z * std::abs(glm::dot(b.face_normals[2], n));
+	};
+
+	for (std::size_t i = 0; i < 3; ++i)
+	{
+		glm::vec3 const & n = b.face_normals[i];
+		if (intersect_detail::separated(f, n, glm::dot(b.center, n), b.half_extents[i]))
+			return false;
+	}
+
+	if (intersect_detail::separated_by_faces(f, b.center, radius))
+		return false;
+
+	for (auto const & a : b.edge_directions)
+	{
+		for (auto const & e : f.edge_directions)
+		{
+			glm::vec3 const n = glm::cross(a, e);
+			if (intersect_detail::separated(f, n, glm::dot(b.center, n), radius(n)))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+inline bool intersect(frustum const & f, obb const & b)
+{
+	return intersect(b, f);
+}
+
+// A sphere and a convex polyhedron are separated along a face normal, along
+// the direction from the center to a vertex, or along the direction from the
+// center to its closest point on an edge
+inline bool intersect(sphere const & s, frustum const & f)
+{
+	auto const radius = [&](glm::vec3 const & n){ return s.radius * glm::length(n); };
+	auto const separated = [&](glm::vec3 const & n)
+	{
+		return intersect_detail::separated(f, n, glm::dot(s.center, n), radius(n));
+	};
+
+	if (intersect_detail::separated_by_faces(f, s.center, radius))
+		return false;
+
+	for (auto const & v : f.vertices)
+		if (separated(v - s.center))
+			return false;
+
+	// Frustum edges join vertices whose indices differ in one bit
+	for (std::size_t i = 0; i < 8; ++i)
+	{
+		for (std::size_t bit = 1; bit < 8; bit <<= 1)
+		{
+			if (i & bit)
+				continue;
+
+			glm::vec3 const & a = f.vertices[i];
+			glm::vec3 const d = f.vertices[i | bit] - a;
+			float const t = glm::clamp(glm::dot(s.center - a, d) / glm::dot(d, d), 0.f, 1.f);
+			if (separated(a + d * t - s.center))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+inline bool intersect(frustum const & f, sphere const & s)
+{
+	return intersect(s, f);
+}
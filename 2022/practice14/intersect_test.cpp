@@ -0,0 +1,215 @@
+#include "intersect.hpp"
+#include "check.hpp"
+
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <iostream>
+#include <random>
+#include <functional>
+
+// Compares the specialized separating axis tests with the generic one over
+// random pairs, including touching boxes, boxes that are flat or points, and
+// boxes and frustums with parallel edges. Spheres have no generic test and are
+// compared with the exact distance from the sphere center to the frustum.
+//
+// Box-frustum and sphere-frustum pairs may disagree only on the boundary,
+// where rounding decides: then growing the body a little must make them
+// intersect and shrinking it must separate them.
+namespace
+{
+
+	// Closest point on triangle abc to p, see Ericson, "Real-Time Collision Detection", 5.1.5
+	glm::vec3 closest_point(glm::vec3 const & p, glm::vec3 const & a, glm::vec3 const & b, glm::vec3 const & c)
+	{
+		glm::vec3 const ab = b - a;
+		glm::vec3 const ac = c - a;
+		glm::vec3 const ap = p - a;
+
+		float const d1 = glm::dot(ab, ap);
+		float const d2 = glm::dot(ac, ap);
+		if (d1 <= 0.f && d2 <= 0.f)
+			return a;
+
+		glm::vec3 const bp = p - b;
+		float const d3 = glm::dot(ab, bp);
+		float const d4 = glm::dot(ac, bp);
+		if (d3 >= 0.f && d4 <= d3)
+			return b;
+
+		float const vc = d1 * d4 - d3 * d2;
+		if (vc <= 0.f && d1 >= 0.f && d3 <= 0.f)
+			return a + ab * (d1 / (d1 - d3));
+
+		glm::vec3 const cp = p - c;
+		float const d5 = glm::dot(ab, cp);
+		float const d6 = glm::dot(ac, cp);
+		if (d6 >= 0.f && d5 <= d6)
+			return c;
+
+		float const vb = d5 * d2 - d1 * d6;
+		if (vb <= 0.f && d2 >= 0.f && d6 <= 0.f)
+			return a + ac * (d2 / (d2 - d6));
+
+		float const va = d3 * d6 - d5 * d4;
+		if (va <= 0.f && (d4 - d3) >= 0.f && (d5 - d6) >= 0.f)
+			return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+		float const denominator = 1.f / (va + vb + vc);
+		return a + ab * (vb * denominator) + ac * (vc * denominator);
+	}
+
+	// Exact distance from p to the solid frustum
+	float distance(frustum const & f, glm::vec3 const & p)
+	{
+		bool inside = true;
+		for (auto const & plane : f.planes)
+			inside = inside && glm::dot(glm::vec3(plane), p) + plane.w >= 0.f;
+		if (inside)
+			return 0.f;
+
+		// Faces as quads of vertex indices, whose bits select the x, y and z sides
+		static int const faces[6][4] = {
+			{0, 2, 6, 4}, {1, 3, 7, 5},
+			{0, 1, 5, 4}, {2, 3, 7, 6},
+			{0, 1, 3, 2}, {4, 5, 7, 6},
+		};
+
+		float result = std::numeric_limits<float>::infinity();
+		for (auto const & q : faces)
+		{
+			auto const & v = f.vertices;
+			result = std::min(result, glm::length(p - closest_point(p, v[q[0]], v[q[1]], v[q[2]])));
+			result = std::min(result, glm::length(p - closest_point(p, v[q[0]], v[q[2]], v[q[3]])));
+		}
+		return result;
+	}
+
+	// reference_scaled(s) tests the body grown (s > 1) or shrunk (s < 1)
+	void check_agreement(bool specialized, bool reference, std::function<bool(float)> const & reference_scaled,
+		std::size_t & boundary_cases)
+	{
+		if (specialized == reference)
+			return;
+
+		CHECK(reference_scaled(1.001f));
+		CHECK(!reference_scaled(0.999f));
+		++boundary_cases;
+	}
+
+}
+
+int main() try
+{
+	std::default_random_engine rng(7);
+	std::uniform_real_distribution<float> uniform(-1.f, 1.f);
+	std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+	auto const random_vec3 = [&](float scale) { return scale * glm::vec3(uniform(rng), uniform(rng), uniform(rng)); };
+
+	// One in four extents is zero, so that some boxes are flat, lines or points
+	auto const random_extents = [&]
+	{
+		glm::vec3 e;
+		for (int a = 0; a < 3; ++a)
+			e[a] = (unit(rng) < 0.25f) ? 0.f : 2.f * unit(rng);
+		return e;
+	};
+
+	// Every fourth rotation keeps the axes of the world, so that box and frustum edges can be parallel
+	auto const random_axes = [&](int i)
+	{
+		if (i % 4 == 0)
+			return glm::mat3(1.f);
+		return glm::mat3_cast(glm::normalize(glm::quat(uniform(rng), uniform(rng), uniform(rng), uniform(rng))));
+	};
+
+	// Perspective and orthographic, looking at the origin from a random direction
+	auto const random_frustum = [&](int i)
+	{
+		glm::vec3 const eye = random_vec3(8.f) + glm::vec3(0.f, 0.f, 0.1f);
+		glm::vec3 const up = (i % 3 == 0) ? glm::vec3(0.f, 1.f, 0.f) : glm::normalize(random_vec3(1.f) + glm::vec3(0.f, 2.f, 0.f));
+		glm::mat4 const view = glm::lookAt(eye, glm::vec3(0.f), up);
+		float const near = 0.1f + unit(rng);
+		float const far = near + 1.f + 10.f * unit(rng);
+		if (i % 5 == 0)
+			return frustum(glm::ortho(-2.f, 2.f, -1.5f, 1.5f, near, far) * view);
+		return frustum(glm::perspective(glm::radians(20.f + 100.f * unit(rng)), 0.5f + 2.f * unit(rng), near, far) * view);
+	};
+
+	int const iterations = 20000;
+	std::size_t intersecting = 0, boundary_cases = 0;
+
+	for (int i = 0; i < iterations; ++i)
+	{
+		// Box against box, with every fourth pair touching along an axis exactly
+		{
+			glm::vec3 const min1 = random_vec3(3.f), max1 = min1 + random_extents();
+			glm::vec3 min2 = random_vec3(3.f), max2 = min2 + random_extents();
+			if (i % 4 == 0)
+			{
+				int const a = i / 4 % 3;
+				float const size = max2[a] - min2[a];
+				min2[a] = max1[a];
+				max2[a] = min2[a] + size;
+			}
+
+			aabb const b1(min1, max1), b2(min2, max2);
+			bool const specialized = intersect(b1, b2);
+			CHECK((specialized == intersect<aabb, aabb>(b1, b2)));
+			CHECK(specialized == intersect(b2, b1));
+			intersecting += specialized;
+		}
+
+		frustum const f = random_frustum(i);
+
+		// Box against frustum, with every fourth box touching a frustum corner with one of its own
+		{
+			glm::vec3 center = random_vec3(6.f);
+			glm::vec3 const extents = random_extents();
+			if (i % 4 == 1)
+				center = f.vertices[i / 4 % 8] + glm::vec3(extents.x, -extents.y, extents.z);
+			auto const box = [&](float scale) { return aabb(center - scale * extents, center + scale * extents); };
+
+			bool const specialized = intersect(box(1.f), f);
+			CHECK(specialized == intersect(f, box(1.f)));
+			check_agreement(specialized, intersect<aabb, frustum>(box(1.f), f),
+				[&](float scale) { return intersect<aabb, frustum>(box(scale), f); }, boundary_cases);
+			intersecting += specialized;
+		}
+
+		// Oriented box against frustum
+		{
+			glm::vec3 const center = random_vec3(6.f), extents = random_extents() / 2.f;
+			glm::mat3 const axes = random_axes(i);
+			auto const box = [&](float scale) { return obb(center, axes, scale * extents); };
+
+			bool const specialized = intersect(box(1.f), f);
+			CHECK(specialized == intersect(f, box(1.f)));
+			check_agreement(specialized, intersect<obb, frustum>(box(1.f), f),
+				[&](float scale) { return intersect<obb, frustum>(box(scale), f); }, boundary_cases);
+			intersecting += specialized;
+		}
+
+		// Sphere against frustum, with every fourth sphere a point
+		{
+			glm::vec3 const center = random_vec3(8.f);
+			float const radius = (i % 4 == 0) ? 0.f : 3.f * unit(rng);
+			float const d = distance(f, center);
+
+			bool const specialized = intersect(sphere{center, radius}, f);
+			CHECK(specialized == intersect(f, sphere{center, radius}));
+			check_agreement(specialized, d <= radius,
+				[&](float scale) { return d <= scale * radius + (scale - 1.f) * 0.01f; }, boundary_cases);
+			intersecting += specialized;
+		}
+	}
+
+	std::cout << 4 * iterations << " pairs agree, " << intersecting << " intersecting, " << boundary_cases << " on the boundary" << std::endl;
+}
+catch (std::exception const & e)
+{
+	std::cerr << e.what() << std::endl;
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "instance_bvh.hpp"
+#include "worker_pool.hpp"
+
+#include <glm/vec3.hpp>
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+
+// Parallel culling and LOD bucketing. The BVH is split into subtrees, which
+// cover consecutive instance ranges; workers take subtrees from a shared
+// counter, cull them and sort the visible instances into per-subtree LOD bins.
+// The bins are then merged with prefix sums into one contiguous buffer, grouped
+// by LOD. Within a LOD instances follow tree order, independently of the
+// thread count and of which thread processed which subtree.
+struct lod_bucketing
+{
+	// Instance positions, LOD l occupies [lod_offsets[l], lod_offsets[l + 1])
+	std::vector<glm::vec3> instances;
+	std::vector<std::uint32_t> lod_offsets;
+
+	// Subtrees per thread, more of them balance the load better
+	std::size_t tasks_per_thread = 4;
+
+	// Optional culling state kept between runs
+	instance_bvh::coherence_state * coherence = nullptr;
+
+	// Box-plane tests performed by the last run
+	std::size_t plane_tests = 0;
+
+	// select(instance) returns the LOD of a visible instance; LODs outside [0, lod_count) are dropped
+	template <typename Selector>
+	void run(worker_pool & pool, instance_bvh const & bvh, frustum const & f, bool exact,
+		std::vector<glm::vec3> const & positions, std::size_t lod_count, Selector const & select);
+
+private:
+	std::vector<std::uint32_t> roots;
+
+	// bins[task * lod_count + lod]
+	std::vector<std::vector<glm::vec3>> bins;
+	std::vector<std::uint32_t> bin_offsets;
+
+	std::vector<std::vector<std::uint32_t>> visible;
+};
+
+template <typename Selector>
+void lod_bucketing::run(worker_pool & pool, instance_bvh const & bvh, frustum const & f, bool exact,
+	std::vector<glm::vec3> const & positions, std::size_t lod_count, Selector const & select)
+{
+	bvh.split(pool.size() * tasks_per_thread, roots);
+
+	std::size_t const task_count = roots.size();
+	bins.resize(task_count * lod_count);
+	bin_offsets.resize(task_count * lod_count);
+	visible.resize(pool.size());
+
+	std::atomic<std::size_t> next_task{0};
+	std::atomic<std::size_t> tests{0};
+	pool.run([&](std::size_t thread_index)
+	{
+		auto & scratch = visible[thread_index];
+
+		for (std::size_t task; (task = next_task.fetch_add(1, std::memory_order_relaxed)) < task_count;)
+		{
+			for (std::size_t lod = 0; lod < lod_count; ++lod)
+				bins[task * lod_count + lod].clear();
+
+			scratch.clear();
+			tests.fetch_add(bvh.cull(f, exact, scratch, roots[task], coherence), std::memory_order_relaxed);
+
+			for (std::uint32_t instance : scratch)
+			{
+				int const lod = select(instance);
+				if (lod >= 0 && lod < static_cast<int>(lod_count))
+					bins[task * lod_count + lod].push_back(positions[instance]);
+			}
+		}
+	});
+
+	plane_tests = tests;
+
+	// Exclusive prefix sum over (lod, task), so that every LOD is contiguous
+	lod_offsets.assign(lod_count + 1, 0);
+	std::uint32_t offset = 0;
+	for (std::size_t lod = 0; lod < lod_count; ++lod)
+	{
+		lod_offsets[lod] = offset;
+		for (std::size_t task = 0; task < task_count; ++task)
+		{
+			bin_offsets[task * lod_count + lod] = offset;
+			offset += bins[task * lod_count + lod].size();
+		}
+	}
+	lod_offsets[lod_count] = offset;
+
+	instances.resize(offset);
+
+	next_task = 0;
+	pool.run([&](std::size_t)
+	{
+		for (std::size_t task; (task = next_task.fetch_add(1, std::memory_order_relaxed)) < task_count;)
+		{
+			for (std::size_t lod = 0; lod < lod_count; ++lod)
+			{
+				auto const & bin = bins[task * lod_count + lod];
+				std::copy(bin.begin(), bin.end(), instances.begin() + bin_offsets[task * lod_count + lod]);
+			}
+		}
+	});
+}
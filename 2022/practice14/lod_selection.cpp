@@ -0,0 +1,186 @@
+#include "lod_selection.hpp"
+
+#include <glm/geometric.hpp>
+
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+namespace
+{
+
+	// Closest point on triangle abc to p, see Ericson, "Real-Time Collision Detection", 5.1.5
+	glm::vec3 closest_point(glm::vec3 const & p, glm::vec3 const & a, glm::vec3 const & b, glm::vec3 const & c)
+	{
+		glm::vec3 const ab = b - a;
+		glm::vec3 const ac = c - a;
+		glm::vec3 const ap = p - a;
+
+		float const d1 = glm::dot(ab, ap);
+		float const d2 = glm::dot(ac, ap);
+		if (d1 <= 0.f && d2 <= 0.f)
+			return a;
+
+		glm::vec3 const bp = p - b;
+		float const d3 = glm::dot(ab, bp);
+		float const d4 = glm::dot(ac, bp);
+		if (d3 >= 0.f && d4 <= d3)
+			return b;
+
+		float const vc = d1 * d4 - d3 * d2;
+		if (vc <= 0.f && d1 >= 0.f && d3 <= 0.f)
+			return a + ab * (d1 / (d1 - d3));
+
+		glm::vec3 const cp = p - c;
+		float const d5 = glm::dot(ab, cp);
+		float const d6 = glm::dot(ac, cp);
+		if (d6 >= 0.f && d5 <= d6)
+			return c;
+
+		float const vb = d5 * d2 - d1 * d6;
+		if (vb <= 0.f && d2 >= 0.f && d6 <= 0.f)
+			return a + ac * (d2 / (d2 - d6));
+
+		float const va = d3 * d6 - d5 * d4;
+		if (va <= 0.f && (d4 - d3) >= 0.f && (d5 - d6) >= 0.f)
+			return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+		float const denominator = 1.f / (va + vb + vc);
+		return a + ab * (vb * denominator) + ac * (vc * denominator);
+	}
+
+	float one_sided_error(std::vector<glm::vec3> const & points,
+		std::vector<glm::vec3> const & positions, std::vector<std::uint32_t> const & indices)
+	{
+		float result = 0.f;
+		for (auto const & p : points)
+		{
+			float nearest = std::numeric_limits<float>::infinity();
+			for (std::size_t i = 0; i + 2 < indices.size(); i += 3)
+			{
+				glm::vec3 const q = closest_point(p, positions[indices[i]], positions[indices[i + 1]], positions[indices[i + 2]]);
+				nearest = std::min(nearest, glm::dot(p - q, p - q));
+			}
+			result = std::max(result, nearest);
+		}
+		return std::sqrt(result);
+	}
+
+	std::uint64_t fnv1a(std::string_view data)
+	{
+		std::uint64_t hash = 14695981039346656037ull;
+		for (unsigned char c : data)
+			hash = (hash ^ c) * 1099511628211ull;
+		return hash;
+	}
+
+}
+
+float lod_geometric_error(
+	std::vector<glm::vec3> const & reference_positions, std::vector<std::uint32_t> const & reference_indices,
+	std::vector<glm::vec3> const & lod_positions, std::vector<std::uint32_t> const & lod_indices)
+{
+	return std::max(
+		one_sided_error(reference_positions, lod_positions, lod_indices),
+		one_sided_error(lod_positions, reference_positions, reference_indices));
+}
+
+std::vector<float> load_lod_errors(std::string const & path, std::string_view model_data, std::size_t lod_count)
+{
+	std::ifstream file(path);
+
+	std::uint64_t hash = 0;
+	if (!(file >> std::hex >> hash >> std::dec) || hash != fnv1a(model_data))
+		return {};
+
+	std::vector<float> errors;
+	for (float error; file >> error;)
+		errors.push_back(error);
+
+	if (!file.eof() || errors.size() != lod_count)
+		return {};
+
+	return errors;
+}
+
+void save_lod_errors(std::string const & path, std::string_view model_data, std::vector<float> const & errors)
+{
+	std::ofstream file(path);
+	if (!file)
+		throw std::runtime_error("Failed to open " + path);
+
+	file << std::hex << fnv1a(model_data) << std::dec << '\n';
+	file.precision(9);
+	for (float error : errors)
+		file << error << '\n';
+
+	if (!file)
+		throw std::runtime_error("Failed to write " + path);
+}
+
+void lod_selection::add_lod(float geometric_error, std::uint32_t triangle_count)
+{
+	// Coarser LODs never claim to be more accurate than finer ones
+	if (!errors.empty())
+		geometric_error = std::max(geometric_error, errors.back());
+
+	errors.push_back(geometric_error);
+	triangle_counts.push_back(triangle_count);
+}
+
+void lod_selection::begin_frame(float fov_y, int viewport_height, glm::vec3 const & camera_position, std::size_t instance_count)
+{
+	this->camera_position = camera_position;
+	pixels_per_unit = viewport_height / (2.f * std::tan(fov_y / 2.f));
+
+	if (current.size() != instance_count)
+		current.assign(instance_count, -1);
+
+	triangles = 0;
+}
+
+int lod_selection::select(std::uint32_t instance, glm::vec3 const & center, float radius)
+{
+	// Largest world-space error that projects within the budget at the nearest point of the instance
+	float const distance = std::max(glm::distance(camera_position, center) - radius, 1e-3f);
+	float const threshold = pixel_error * scale * distance / pixels_per_unit;
+
+	int const previous = current[instance];
+	int lod = std::max(previous, 0);
+
+	while (lod > 0 && errors[lod] > threshold)
+		--lod;
+
+	float const coarsen_threshold = (previous < 0) ? threshold : threshold * (1.f - hysteresis);
+	while (lod + 1 < static_cast<int>(errors.size()) && errors[lod + 1] <= coarsen_threshold)
+		++lod;
+
+	current[instance] = lod;
+	triangles.fetch_add(triangle_counts[lod], std::memory_order_relaxed);
+	return lod;
+}
+
+void lod_selection::end_frame()
+{
+	last_triangles = triangles.load();
+
+	if (triangle_budget == 0)
+	{
+		scale = 1.f;
+		return;
+	}
+
+	if (last_triangles > triangle_budget)
+		scale = std::min(scale * 1.25f, 1024.f);
+	else if (last_triangles * 5 < triangle_budget * 4)
+		scale = std::max(scale / 1.1f, 1.f);
+}
+
+void lod_selection::reset()
+{
+	current.clear();
+	scale = 1.f;
+	last_triangles = 0;
+}
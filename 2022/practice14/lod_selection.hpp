@@ -0,0 +1,76 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <atomic>
+#include <cstdint>
+
+// Symmetric Hausdorff distance between two triangle meshes, measured from
+// the vertices of each mesh to the triangles of the other one
+float lod_geometric_error(
+	std::vector<glm::vec3> const & reference_positions, std::vector<std::uint32_t> const & reference_indices,
+	std::vector<glm::vec3> const & lod_positions, std::vector<std::uint32_t> const & lod_indices);
+
+// Geometric errors of every LOD of a model, cached in a text file next to it
+// since measuring them takes most of a second: the FNV-1a hash of the model
+// data, then one error per line. Loading returns an empty vector if the file
+// is missing or was written for other data or another LOD count; saving throws
+// if the file can't be written.
+std::vector<float> load_lod_errors(std::string const & path, std::string_view model_data, std::size_t lod_count);
+void save_lod_errors(std::string const & path, std::string_view model_data, std::vector<float> const & errors);
+
+// Screen-space error LOD selection. Every LOD has a world-space geometric
+// error; an instance uses the coarsest LOD whose error, projected at the
+// instance's nearest distance, stays within pixel_error pixels.
+//
+// Switching to a coarser LOD additionally requires its error to be below
+// (1 - hysteresis) of the budget, so instances near a boundary keep their LOD
+// instead of alternating every frame.
+//
+// With a triangle budget, the pixel error is scaled up while the previous
+// frame drew more triangles than the budget and relaxed back once it fits,
+// so the budget is met within a few frames.
+struct lod_selection
+{
+	float pixel_error = 1.f;
+	float hysteresis = 0.25f;
+
+	// 0 disables the budget
+	std::uint64_t triangle_budget = 0;
+
+	// LODs must be added from the finest to the coarsest
+	void add_lod(float geometric_error, std::uint32_t triangle_count);
+
+	std::size_t lod_count() const { return errors.size(); }
+
+	void begin_frame(float fov_y, int viewport_height, glm::vec3 const & camera_position, std::size_t instance_count);
+
+	// May be called concurrently for different instances
+	int select(std::uint32_t instance, glm::vec3 const & center, float radius);
+
+	void end_frame();
+
+	// Forgets the LODs of previous frames and the budget scale, so that the
+	// next frames select LODs as if they were the first ones
+	void reset();
+
+	// Current multiplier of pixel_error imposed by the triangle budget
+	float budget_scale() const { return scale; }
+	std::uint64_t last_triangle_count() const { return last_triangles; }
+
+private:
+	std::vector<float> errors;
+	std::vector<std::uint32_t> triangle_counts;
+
+	std::vector<std::int8_t> current;
+
+	glm::vec3 camera_position;
+	float pixels_per_unit = 0.f;
+	float scale = 1.f;
+
+	std::atomic<std::uint64_t> triangles{0};
+	std::uint64_t last_triangles = 0;
+};
@@ -16,6 +16,12 @@
 #include <random>
 #include <map>
 #include <cmath>
+#include <atomic>
+#include <algorithm>
+#include <numeric>
+#include <array>
+#include <optional>
+#include <thread>
 
 #include <glm/vec3.hpp>
 #include <glm/mat4x4.hpp>
@@ -30,6 +36,26 @@
 #include "aabb.hpp"
 #include "frustum.hpp"
 #include "intersect.hpp"
+#include "transform_hierarchy.hpp"
+#include "frustum_culling.hpp"
+#include "instance_bvh.hpp"
+#include "lod_bucketing.hpp"
+#include "stream_ring.hpp"
+#include "gl_stream_backend.hpp"
+#include "occlusion_culling.hpp"
+#include "lod_selection.hpp"
+#include "spatial_grid.hpp"
+#include "frame_profiler.hpp"
+#include "frame_stats.hpp"
+#include "gl_timer_backend.hpp"
+#include "gl_state_cache.hpp"
+#include "gl_state_backend.hpp"
+#include "benchmark.hpp"
+#include "software_rasterizer.hpp"
+#include "png_writer.hpp"
+#include "image_diff.hpp"
+#include "texture_cache.hpp"
+#include "gl_texture_backend.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -131,8 +157,575 @@ GLuint create_program(Shaders ... shaders)
     return result;
 }
 
-int main() try
+std::vector<std::string> const camera_parameters{"x", "y", "z", "rotation"};
+
+// A slow walk through the grid while looking around, 10 seconds long
+camera_path scripted_camera_path()
+{
+    camera_path result(camera_parameters);
+    for (int key = 0; key <= 100; ++key) {
+        float const t = key / 10.f;
+        result.add(t, {4.f * std::sin(t * 0.3f), 1.5f, 20.f - 4.f * t, 0.8f * std::sin(t * 0.7f)});
+    }
+    return result;
+}
+
+glm::mat4 camera_view(std::vector<float> const & camera)
+{
+    glm::mat4 view(1.f);
+    view = glm::rotate(view, camera[3], {0.f, 1.f, 0.f});
+    return glm::translate(view, -glm::vec3(camera[0], camera[1], camera[2]));
+}
+
+struct golden_scene
+{
+    std::string name;
+    // Values of camera_parameters
+    std::vector<float> camera;
+};
+
+// Fixed views of the golden image test: along the grid, across it, from its side and close to the nearest bunnies
+std::vector<golden_scene> const golden_scenes{
+    {"entrance", {0.f, 1.5f, 20.f, 0.f}},
+    {"diagonal", {-20.f, 3.f, 20.f, glm::pi<float>() / 4.f}},
+    {"side", {17.f, 1.f, 0.f, -glm::pi<float>() / 2.f}},
+    {"close-up", {0.5f, 0.4f, 1.6f, 0.f}},
+};
+
+// Frames of LOD selection before a golden scene is rendered, enough for the triangle budget to settle
+int const golden_warmup_frames = 16;
+
+// Beyond this, the least recently bound textures are evicted
+std::size_t const texture_budget = 256 << 20;
+
+int main(int argc, char ** argv) try
 {
+    auto const options = parse_benchmark_options(argc, argv, {
+        {"--image", "render the last benchmark frame on the CPU into a PNG"},
+        {"--golden", "render the golden scenes on the CPU and compare them with the images in the directory"},
+        {"--update-golden", "render the golden scenes into the directory"},
+        {"--threads", "largest thread count of the LOD bucketing scaling benchmark, all hardware threads by default"},
+        {"--occlusion", "on to cull instances hidden behind boxes inside the nearest ones, off by default"},
+    });
+
+    std::string const image_path = options.extra_value("--image");
+    bool const update_golden = options.extra.count("--update-golden") > 0;
+    std::string const golden_directory = options.extra_value(update_golden ? "--update-golden" : "--golden");
+
+    std::size_t scaling_threads = std::max(1u, std::thread::hardware_concurrency());
+    if (auto const value = options.extra_value("--threads"); !value.empty()) {
+        try {
+            scaling_threads = std::stoul(value);
+        } catch (std::logic_error const &) {
+            scaling_threads = 0;
+        }
+        if (scaling_threads == 0)
+            throw std::runtime_error("Bad value of --threads: " + value);
+    }
+
+    // Off until it culls more than it costs: instances of the grid rarely hide each other completely
+    bool occlusion_enabled = false;
+    if (auto const value = options.extra_value("--occlusion", "off"); value == "on")
+        occlusion_enabled = true;
+    else if (value != "off")
+        throw std::runtime_error("Bad value of --occlusion: " + value);
+
+    const std::string project_root = PROJECT_ROOT;
+    const std::string model_path = project_root + "/bunny/bunny.gltf";
+
+    auto const input_model = load_gltf(model_path);
+
+    // Node 0 is the grid root, nodes 1..1024 are the bunny instances
+    std::vector<std::uint32_t> grid_parents(1 + 32 * 32, 0);
+    grid_parents[0] = transform_hierarchy::no_parent;
+
+    transform_hierarchy grid(grid_parents);
+    for (int x = -16; x < 16; ++x) {
+        for (int z = -16; z < 16; ++z) {
+            grid.set_translation(1 + (x + 16) * 32 + (z + 16), glm::vec3(x, 0.f, z));
+        }
+    }
+
+    grid.update();
+
+    // Box i belongs to grid node i + 1
+    aabb_batch instance_boxes;
+    std::vector<glm::vec3> instance_min, instance_max, instance_positions;
+    for (std::uint32_t i = 1; i < grid.size(); ++i) {
+        glm::vec3 const position = grid.world(i)[3];
+        instance_positions.push_back(position);
+        instance_boxes.add(input_model.meshes[0].min + position, input_model.meshes[0].max + position);
+        instance_min.push_back(input_model.meshes[0].min + position);
+        instance_max.push_back(input_model.meshes[0].max + position);
+    }
+
+    instance_bvh bvh;
+    bvh.build(instance_min, instance_max);
+
+    // Instance boxes for picking with the mouse; a bunny fits in a cell
+    spatial_grid picking_grid(2.f * glm::length(input_model.meshes[0].max - input_model.meshes[0].min), instance_positions.size(), 1 << 12);
+    std::vector<std::uint32_t> picking_instance(instance_positions.size());
+    for (std::uint32_t i = 0; i < instance_positions.size(); ++i)
+        picking_instance[picking_grid.insert(instance_min[i], instance_max[i])] = i;
+
+    worker_pool workers;
+    lod_bucketing buckets;
+
+    // CPU copies of every LOD, for error measurement and occlusion
+    std::vector<std::vector<glm::vec3>> lod_positions(input_model.meshes.size());
+    std::vector<std::vector<std::uint32_t>> lod_indices(input_model.meshes.size());
+    for (std::size_t lod = 0; lod < input_model.meshes.size(); ++lod)
+    {
+        auto const & mesh = input_model.meshes[lod];
+        if (mesh.position.type != GL_FLOAT || mesh.indices.type != GL_UNSIGNED_SHORT)
+            throw std::runtime_error("Unsupported LOD mesh format");
+
+        lod_positions[lod].resize(mesh.position.count);
+        std::copy_n(input_model.buffer.data() + mesh.position.view.offset, mesh.position.count * sizeof(glm::vec3),
+                    reinterpret_cast<char *>(lod_positions[lod].data()));
+
+        auto const indices = reinterpret_cast<std::uint16_t const *>(input_model.buffer.data() + mesh.indices.view.offset);
+        lod_indices[lod].assign(indices, indices + mesh.indices.count);
+    }
+
+    lod_selection lods;
+    lods.pixel_error = 1.f;
+    lods.triangle_budget = 1000000;
+    {
+        std::string const cache_path = project_root + "/bunny/bunny.lod_errors";
+        std::string_view const model_data(input_model.buffer.data(), input_model.buffer.size());
+
+        auto errors = load_lod_errors(cache_path, model_data, input_model.meshes.size());
+        if (errors.empty()) {
+            auto start = std::chrono::high_resolution_clock::now();
+            for (std::size_t lod = 0; lod < input_model.meshes.size(); ++lod)
+                errors.push_back((lod == 0) ? 0.f : lod_geometric_error(lod_positions[0], lod_indices[0], lod_positions[lod], lod_indices[lod]));
+            auto end = std::chrono::high_resolution_clock::now();
+            std::cout << "LOD errors measured in " << std::chrono::duration<float, std::milli>(end - start).count() << " ms" << std::endl;
+
+            try {
+                save_lod_errors(cache_path, model_data, errors);
+            } catch (std::exception const & e) {
+                std::cerr << e.what() << ", LOD errors will be measured again next time" << std::endl;
+            }
+        }
+
+        for (std::size_t lod = 0; lod < input_model.meshes.size(); ++lod) {
+            lods.add_lod(errors[lod], lod_indices[lod].size() / 3);
+            std::cout << "LOD " << lod << ": " << lod_indices[lod].size() / 3 << " triangles, error " << errors[lod] << std::endl;
+        }
+    }
+
+    float const instance_radius = glm::length(input_model.meshes[0].max - input_model.meshes[0].min) / 2.f;
+
+    // The nearest instances occlude with a box inside the full-detail mesh: 12
+    // triangles instead of thousands, and unlike simplified LODs, which bulge
+    // out of the surface in places, it never hides what is actually visible
+    aabb const occluder_box = inner_box(lod_positions.front(), lod_indices.front());
+
+    std::size_t const occluder_count = 64;
+    occlusion_culling occlusion;
+    std::vector<std::uint32_t> occluder_order(instance_positions.size());
+
+    instance_bvh::coherence_state cull_coherence;
+    cull_coherence.reset(bvh);
+    buckets.coherence = &cull_coherence;
+
+    // CPU work of a frame; stage(index, work) runs every part, indexing scene_stages
+    std::array<std::string, 3> const scene_stages{"animate", "occlusion", "cull and LOD"};
+
+    struct scene_statistics
+    {
+        std::size_t tested = 0;
+        std::size_t culled = 0;
+    };
+
+    auto update_scene = [&](auto && stage, glm::vec3 const & camera_position, glm::mat4 const & view_projection, int viewport_height)
+    {
+        stage(0, [&] {
+            grid.update();
+        });
+
+        stage(1, [&] {
+            if (!occlusion_enabled)
+                return;
+
+            std::iota(occluder_order.begin(), occluder_order.end(), 0);
+            std::size_t const occluders = std::min(occluder_count, occluder_order.size());
+            std::partial_sort(occluder_order.begin(), occluder_order.begin() + occluders, occluder_order.end(),
+                              [&](std::uint32_t i, std::uint32_t j) {
+                return glm::distance(camera_position, instance_positions[i]) < glm::distance(camera_position, instance_positions[j]);
+            });
+
+            occlusion.begin(view_projection);
+            for (std::size_t k = 0; k < occluders; ++k) {
+                glm::vec3 const & position = instance_positions[occluder_order[k]];
+                occlusion.add_box_occluder(occluder_box.min + position, occluder_box.max + position);
+            }
+            occlusion.finish(workers);
+        });
+
+        std::atomic<std::size_t> tested{0}, culled{0};
+        stage(2, [&] {
+            lods.begin_frame(glm::pi<float>() / 2.f, viewport_height, camera_position, instance_positions.size());
+
+            buckets.run(workers, bvh, frustum(view_projection), true, instance_positions, lods.lod_count(), [&](std::uint32_t i) {
+                tested.fetch_add(1, std::memory_order_relaxed);
+                if (occlusion_enabled && !occlusion.visible(instance_min[i], instance_max[i])) {
+                    culled.fetch_add(1, std::memory_order_relaxed);
+                    return -1;
+                }
+                return lods.select(i, (instance_min[i] + instance_max[i]) / 2.f, instance_radius);
+            });
+
+            lods.end_frame();
+        });
+
+        return scene_statistics{tested, culled};
+    };
+
+    // CPU reference rendering of the LOD buckets of the last update_scene, for --image and the golden scenes.
+    // Golden scenes are always untextured, so that they don't depend on the texture being present
+    raster_texture reference_texture;
+    std::vector<raster_mesh> reference_lods;
+    if (!image_path.empty()) {
+        auto const & mesh = input_model.meshes[0];
+        auto const texture_path = std::experimental::filesystem::path(model_path).parent_path() / *mesh.material.texture_path;
+
+        int channels;
+        if (auto data = stbi_load(texture_path.c_str(), &reference_texture.width, &reference_texture.height, &channels, 4)) {
+            reference_texture.pixels.assign(data, data + std::size_t(reference_texture.width) * reference_texture.height * 4);
+            stbi_image_free(data);
+        } else {
+            std::cerr << "Failed to load " << texture_path << ", the reference renderer draws untextured" << std::endl;
+        }
+    }
+    if (!image_path.empty() || !golden_directory.empty()) {
+        for (auto const & lod : input_model.meshes)
+            reference_lods.push_back(make_raster_mesh(input_model, lod));
+    }
+
+    // Untextured if texture is null
+    auto render_reference = [&](software_rasterizer & rasterizer, glm::mat4 const & view_projection, raster_texture const * texture) {
+        rasterizer.begin(view_projection, glm::normalize(glm::vec3(1.f, 2.f, 3.f)), {0.8f, 0.8f, 1.f, 1.f});
+        for (std::size_t lod = 0; lod < reference_lods.size(); ++lod)
+            rasterizer.draw(reference_lods[lod], texture, glm::vec4(1.f), glm::mat4(1.f),
+                            buckets.instances.data() + buckets.lod_offsets[lod], buckets.lod_offsets[lod + 1] - buckets.lod_offsets[lod]);
+        rasterizer.finish(workers);
+    };
+
+    if (!golden_directory.empty())
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+
+        int const width = 960, height = 540;
+        glm::mat4 const projection = glm::perspective(glm::pi<float>() / 2.f, (1.f * width) / height, 0.1f, 100.f);
+
+        // Rendering already uses every thread, so scenes are rendered one after another
+        software_rasterizer rasterizer(width, height);
+        std::vector<std::vector<std::uint8_t>> images;
+        for (auto const & scene : golden_scenes) {
+            glm::vec3 const camera_position{scene.camera[0], scene.camera[1], scene.camera[2]};
+            glm::mat4 const view_projection = projection * camera_view(scene.camera);
+
+            lods.reset();
+            for (int frame = 0; frame < golden_warmup_frames; ++frame)
+                update_scene([](std::uint32_t, auto && work) { work(); }, camera_position, view_projection, height);
+
+            render_reference(rasterizer, view_projection, nullptr);
+            images.push_back(rasterizer.color());
+        }
+
+        if (update_golden)
+            std::experimental::filesystem::create_directories(golden_directory);
+
+        // Goldens are loaded, compared and diff images written in parallel
+        std::vector<std::string> results(golden_scenes.size());
+        std::vector<char> passed(golden_scenes.size(), 0);
+        std::atomic<std::size_t> next_scene{0};
+        workers.run([&](std::size_t) {
+            for (std::size_t i; (i = next_scene.fetch_add(1)) < golden_scenes.size();) try {
+                auto const base = (std::experimental::filesystem::path(golden_directory) / golden_scenes[i].name).string();
+
+                if (update_golden) {
+                    write_png(base + ".png", width, height, images[i].data());
+                    results[i] = "updated";
+                    passed[i] = 1;
+                    continue;
+                }
+
+                int golden_width, golden_height, channels;
+                auto data = stbi_load((base + ".png").c_str(), &golden_width, &golden_height, &channels, 4);
+                if (!data)
+                    throw std::runtime_error("no golden image " + base + ".png, create it with --update-golden");
+                if (golden_width != width || golden_height != height) {
+                    stbi_image_free(data);
+                    throw std::runtime_error("golden image is " + std::to_string(golden_width) + "x" + std::to_string(golden_height));
+                }
+
+                // Files go from top to bottom, rendered images from bottom to top
+                std::vector<std::uint8_t> golden(images[i].size());
+                std::size_t const row_size = std::size_t(width) * 4;
+                for (int y = 0; y < height; ++y)
+                    std::copy_n(data + (height - 1 - y) * row_size, row_size, golden.begin() + y * row_size);
+                stbi_image_free(data);
+
+                auto const diff = compare_images(width, height, golden.data(), images[i].data());
+                if (diff.different + diff.tolerated > 0)
+                    write_png(base + ".diff.png", width, height, diff.diff.data());
+                if (!diff.passed)
+                    write_png(base + ".actual.png", width, height, images[i].data());
+
+                results[i] = std::to_string(diff.different) + " different and " + std::to_string(diff.tolerated)
+                        + " shifted pixels, max delta " + std::to_string(diff.max_delta);
+                passed[i] = diff.passed;
+            } catch (std::exception const & e) {
+                results[i] = e.what();
+            }
+        });
+
+        bool all_passed = true;
+        for (std::size_t i = 0; i < golden_scenes.size(); ++i) {
+            std::cout << golden_scenes[i].name << ": " << (passed[i] ? "passed" : "FAILED") << ", " << results[i] << std::endl;
+            all_passed = all_passed && passed[i];
+        }
+
+        auto end = std::chrono::high_resolution_clock::now();
+        std::cout << golden_scenes.size() << " golden scenes in " << std::chrono::duration<float, std::milli>(end - start).count() << " ms" << std::endl;
+        return all_passed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (options.frames > 0)
+    {
+        camera_path const path = options.path.empty() ? scripted_camera_path() : camera_path::load(options.path, camera_parameters);
+
+        benchmark_report report("practice14", options);
+        std::array<std::uint32_t, 3> stages;
+        for (std::size_t i = 0; i < stages.size(); ++i)
+            stages[i] = report.stage(scene_stages[i]);
+        auto const tested_counter = report.counter("frustum-visible instances");
+        auto const culled_counter = report.counter("occluded instances");
+        auto const triangle_counter = report.counter("triangles");
+
+        // Viewport of the benchmark, in place of the window
+        int const width = 1920, height = 1080;
+
+        // Plane culling of all instance boxes, one by one with the separating
+        // axis test and batched, from a fixed camera
+        {
+            glm::mat4 view = glm::translate(glm::mat4(1.f), glm::vec3(0.f, -1.5f, -3.f));
+            glm::mat4 projection = glm::perspective(glm::pi<float>() / 2.f, (1.f * width) / height, 0.1f, 100.f);
+            frustum frust(projection * view);
+
+            int const iterations = 100;
+            std::vector<std::uint32_t> sat_visible, batch_visible;
+            std::vector<cull_result> batch_classes;
+
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int i = 0; i < iterations; ++i) {
+                sat_visible.clear();
+                for (std::uint32_t j = 0; j < instance_boxes.size(); ++j)
+                    if (intersect(aabb(instance_boxes.min(j), instance_boxes.max(j)), frust))
+                        sat_visible.push_back(j);
+            }
+            auto middle = std::chrono::high_resolution_clock::now();
+            for (int i = 0; i < iterations; ++i) {
+                batch_visible.clear();
+                cull(instance_boxes, frust, true, batch_classes, batch_visible);
+            }
+            auto end = std::chrono::high_resolution_clock::now();
+
+            float sat_time = std::chrono::duration<float, std::milli>(middle - start).count() / iterations;
+            float batch_time = std::chrono::duration<float, std::milli>(end - middle).count() / iterations;
+            std::cout << "Culling " << instance_boxes.size() << " boxes: SAT " << sat_time << " ms, batched " << batch_time
+                << " ms (x" << sat_time / batch_time << "), results " << (sat_visible == batch_visible ? "match" : "differ") << std::endl;
+        }
+
+        // BVH culling along a camera path, a slow walk through the grid while
+        // looking around, 10 seconds at 60 FPS: every node against all planes,
+        // with plane masks, and with plane masks and cached rejecting planes
+        {
+            std::vector<frustum> path;
+            for (int frame = 0; frame < 600; ++frame) {
+                float const t = frame / 60.f;
+                glm::mat4 view(1.f);
+                view = glm::rotate(view, 0.8f * std::sin(t * 0.7f), {0.f, 1.f, 0.f});
+                view = glm::translate(view, -glm::vec3(4.f * std::sin(t * 0.3f), 1.5f, 20.f - 4.f * t));
+                path.emplace_back(glm::perspective(glm::pi<float>() / 2.f, (1.f * width) / height, 0.1f, 100.f) * view);
+            }
+
+            instance_bvh::coherence_state coherence;
+            coherence.reset(bvh);
+
+            std::array<char const *, 3> const variants{"without masks", "with masks", "with masks and coherence"};
+            std::array<std::vector<std::uint32_t>, 3> visible;
+            std::array<std::size_t, 3> tests{};
+            std::array<float, 3> times{};
+            bool match = true;
+
+            for (auto const & f : path) {
+                for (std::size_t v = 0; v < variants.size(); ++v) {
+                    visible[v].clear();
+                    auto start = std::chrono::high_resolution_clock::now();
+                    tests[v] += bvh.cull(f, true, visible[v], 0, v == 2 ? &coherence : nullptr, v > 0);
+                    times[v] += std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+                }
+                match = match && visible[1] == visible[0] && visible[2] == visible[0];
+            }
+
+            std::cout << "Camera path culling, per frame:";
+            for (std::size_t v = 0; v < variants.size(); ++v)
+                std::cout << (v > 0 ? "," : "") << " " << tests[v] / path.size() << " plane tests in " << times[v] / path.size() << " ms " << variants[v];
+            std::cout << ", results " << (match ? "match" : "differ") << std::endl;
+        }
+
+        // Culling and LOD bucketing of a 1000 x 1000 grid of instances with 1
+        // to --threads threads; the output must not depend on the thread count
+        {
+            std::size_t const side = 1000;
+            std::vector<glm::vec3> positions, min, max;
+            for (std::size_t x = 0; x < side; ++x) {
+                for (std::size_t z = 0; z < side; ++z) {
+                    glm::vec3 const position(2.f * x, 0.f, 2.f * z);
+                    positions.push_back(position);
+                    min.push_back(position - 0.5f);
+                    max.push_back(position + 0.5f);
+                }
+            }
+
+            instance_bvh scaling_bvh;
+            scaling_bvh.build(min, max);
+
+            glm::vec3 const eye(side, 50.f, 2.f * side + 50.f);
+            frustum const f(glm::perspective(glm::pi<float>() / 2.f, (1.f * width) / height, 0.1f, 4.f * side)
+                * glm::lookAt(eye, glm::vec3(side, 0.f, side), {0.f, 1.f, 0.f}));
+            auto const select = [&](std::uint32_t i) {
+                return std::min(int(glm::distance(eye, positions[i]) / 200.f), int(input_model.meshes.size()) - 1);
+            };
+
+            std::vector<std::size_t> thread_counts;
+            for (std::size_t threads = 1; threads < scaling_threads; threads *= 2)
+                thread_counts.push_back(threads);
+            thread_counts.push_back(scaling_threads);
+
+            int const iterations = 10;
+            float single_thread_time = 0.f;
+            lod_bucketing reference;
+            for (std::size_t threads : thread_counts) {
+                worker_pool pool(threads);
+                lod_bucketing scaling_buckets;
+                scaling_buckets.run(pool, scaling_bvh, f, true, positions, input_model.meshes.size(), select);
+
+                auto start = std::chrono::high_resolution_clock::now();
+                for (int i = 0; i < iterations; ++i)
+                    scaling_buckets.run(pool, scaling_bvh, f, true, positions, input_model.meshes.size(), select);
+                float const time = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / iterations;
+
+                if (threads == 1) {
+                    single_thread_time = time;
+                    reference = scaling_buckets;
+                }
+                bool const match = scaling_buckets.instances == reference.instances && scaling_buckets.lod_offsets == reference.lod_offsets;
+
+                std::cout << "LOD bucketing of " << positions.size() << " instances, " << threads << " threads: " << time << " ms (x"
+                    << single_thread_time / time << "), " << scaling_buckets.instances.size() << " visible, results "
+                    << (match ? "match" : "differ") << std::endl;
+            }
+        }
+
+        // Spatial grid under 100k objects moving through a 400 x 20 x 400 area
+        {
+            std::size_t const object_count = 100000;
+            spatial_grid objects(4.f, object_count, 1 << 16);
+
+            std::default_random_engine rng;
+            std::uniform_real_distribution<float> uniform(-1.f, 1.f);
+
+            std::vector<glm::vec3> object_position(object_count), object_velocity(object_count);
+            std::vector<std::uint32_t> object_handle(object_count);
+            glm::vec3 const half_size(0.5f);
+
+            auto start = std::chrono::high_resolution_clock::now();
+            for (std::size_t i = 0; i < object_count; ++i) {
+                object_position[i] = {200.f * uniform(rng), 10.f * uniform(rng), 200.f * uniform(rng)};
+                object_velocity[i] = {5.f * uniform(rng), 0.f, 5.f * uniform(rng)};
+                object_handle[i] = objects.insert(object_position[i] - half_size, object_position[i] + half_size);
+            }
+            auto end = std::chrono::high_resolution_clock::now();
+            float const insert_time = std::chrono::duration<float, std::milli>(end - start).count();
+
+            int const frames = 60;
+            float move_time = 0.f, frustum_time = 0.f, local_time = 0.f;
+            std::size_t found = 0;
+
+            for (int frame = 0; frame < frames; ++frame) {
+                start = std::chrono::high_resolution_clock::now();
+                for (std::size_t i = 0; i < object_count; ++i) {
+                    object_position[i] += object_velocity[i] / 60.f;
+                    objects.move(object_handle[i], object_position[i] - half_size, object_position[i] + half_size);
+                }
+                auto middle = std::chrono::high_resolution_clock::now();
+
+                glm::vec3 const eye{0.f, 1.5f, 40.f - frame};
+                frustum const f(glm::perspective(glm::pi<float>() / 2.f, (1.f * width) / height, 0.1f, 100.f)
+                    * glm::lookAt(eye, eye + glm::vec3(0.f, 0.f, -1.f), {0.f, 1.f, 0.f}));
+                objects.query_frustum(f, [&](std::uint32_t) { ++found; });
+                auto frustum_end = std::chrono::high_resolution_clock::now();
+
+                objects.query_box(eye - 5.f, eye + 5.f, [&](std::uint32_t) { ++found; });
+                objects.query_sphere(eye, 5.f, [&](std::uint32_t) { ++found; });
+                objects.query_ray(eye, {0.f, 0.f, -1.f}, 100.f, [&](std::uint32_t, float) { ++found; });
+                end = std::chrono::high_resolution_clock::now();
+
+                move_time += std::chrono::duration<float, std::milli>(middle - start).count();
+                frustum_time += std::chrono::duration<float, std::milli>(frustum_end - middle).count();
+                local_time += std::chrono::duration<float, std::milli>(end - frustum_end).count();
+            }
+
+            std::cout << "Spatial grid, " << object_count << " objects: insert " << insert_time << " ms, per frame: move "
+                << move_time / frames << " ms, frustum query " << frustum_time / frames << " ms, box + sphere + ray queries "
+                << local_time / frames << " ms, " << found / frames << " results" << std::endl;
+        }
+
+        glm::mat4 last_view_projection(1.f);
+
+        for (std::size_t frame = 0; frame < options.frames; ++frame) {
+            auto const camera = path.sample(frame * options.dt);
+            glm::vec3 const camera_position{camera[0], camera[1], camera[2]};
+            glm::mat4 const view = camera_view(camera);
+
+            glm::mat4 projection = glm::perspective(glm::pi<float>() / 2.f, (1.f * width) / height, 0.1f, 100.f);
+
+            auto const scene = update_scene([&](std::uint32_t stage, auto && work) {
+                report.time(stages[stage], work);
+            }, camera_position, projection * view, height);
+
+            report.add(tested_counter, scene.tested);
+            report.add(culled_counter, scene.culled);
+            report.add(triangle_counter, lods.last_triangle_count());
+            report.end_frame();
+
+            last_view_projection = projection * view;
+        }
+
+        report.write(options.report);
+        std::cout << "Benchmark of " << report.frames() << " frames written to " << options.report << std::endl;
+
+        // Reference image of the last frame, drawing the same LOD buckets as the GL path
+        if (!image_path.empty()) {
+            auto start = std::chrono::high_resolution_clock::now();
+            software_rasterizer rasterizer(width, height);
+            render_reference(rasterizer, last_view_projection, reference_texture.pixels.empty() ? nullptr : &reference_texture);
+            auto end = std::chrono::high_resolution_clock::now();
+
+            write_png(image_path, width, height, rasterizer.color().data());
+            std::cout << "Software rasterizer: " << rasterizer.stats.triangles << " triangles, " << rasterizer.stats.fragments << " fragments in "
+                      << std::chrono::duration<float, std::milli>(end - start).count() << " ms, written to " << image_path << std::endl;
+        }
+
+        return EXIT_SUCCESS;
+    }
+
     if (SDL_Init(SDL_INIT_VIDEO) != 0)
         sdl2_fail("SDL_Init: ");
 
@@ -182,10 +775,6 @@ int main() try
     GLuint light_direction_location = glGetUniformLocation(program, "light_direction");
     GLuint bones_location = glGetUniformLocation(program, "bones");
 
-    const std::string project_root = PROJECT_ROOT;
-    const std::string model_path = project_root + "/bunny/bunny.gltf";
-
-    auto const input_model = load_gltf(model_path);
     GLuint vbo;
     glGenBuffers(1, &vbo);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
@@ -233,25 +822,16 @@ int main() try
         vaos.push_back(vao);
     }
 
-    GLuint texture;
-    {
-        auto const & mesh = input_model.meshes[0];
-
-        auto path = std::experimental::filesystem::path(model_path).parent_path() / *mesh.material.texture_path;
+    // Decodes in the background while the rest of the setup runs
+    gl_texture_backend texture_backend;
+    texture_cache<gl_texture_backend> textures(texture_backend, texture_budget);
+    auto const texture = textures.request((std::experimental::filesystem::path(model_path).parent_path() / *input_model.meshes[0].material.texture_path).string());
 
-        int width, height, channels;
-        auto data = stbi_load(path.c_str(), &width, &height, &channels, 4);
-        assert(data);
+    gl_stream_backend instance_stream_backend{GL_ARRAY_BUFFER, VBO_translation};
+    stream_ring<gl_stream_backend> instance_stream(instance_stream_backend, instance_positions.size() * sizeof(glm::vec3) + 16);
 
-        glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        stbi_image_free(data);
-    }
+    glBindBuffer(GL_ARRAY_BUFFER, VBO_translation);
+    glBufferData(GL_ARRAY_BUFFER, instance_stream.buffer_size(), nullptr, GL_STREAM_DRAW);
 
     auto last_frame_start = std::chrono::high_resolution_clock::now();
 
@@ -264,8 +844,37 @@ int main() try
 
     bool paused = false;
 
-    std::vector <GLuint> ID_query;
-    std::vector <bool> free;
+    // Window coordinates of a click to pick the bunny under
+    std::optional<glm::ivec2> pick;
+
+    camera_path recorded_path(camera_parameters);
+    float recorded_time = 0.f;
+
+    gl_timer_backend timer_backend;
+    frame_profiler<gl_timer_backend> profiler(timer_backend);
+
+    // Per-frame state of the loop goes through the cache; setup above binds directly
+    gl_state_backend state_backend;
+    gl_state_cache<gl_state_backend> state(state_backend);
+
+    textures.finish();
+
+    auto const frame_scope = profiler.scope_id("frame");
+    std::array<std::uint32_t, 3> scene_scopes;
+    for (std::size_t i = 0; i < scene_scopes.size(); ++i)
+        scene_scopes[i] = profiler.scope_id(scene_stages[i]);
+    auto const upload_scope = profiler.scope_id("upload");
+    auto const draw_scope = profiler.scope_id("draw");
+
+    // Percentiles of the last 10 seconds, appended once per second to the dump by a background thread;
+    // stages are timed once, by the profiler, and its CPU times are recorded here too
+    frame_stats stats("practice14_frame_stats.jsonl");
+
+    std::array<std::uint32_t, 3> scene_channels;
+    for (std::size_t i = 0; i < scene_channels.size(); ++i)
+        scene_channels[i] = stats.channel(scene_stages[i]);
+    auto const upload_channel = stats.channel("upload");
+    auto const draw_channel = stats.channel("draw");
 
     bool running = true;
     while (running)
@@ -288,10 +897,16 @@ int main() try
             button_down[event.key.keysym.sym] = true;
             if (event.key.keysym.sym == SDLK_SPACE)
                 paused = !paused;
+            if (event.key.keysym.sym == SDLK_o)
+                occlusion_enabled = !occlusion_enabled;
             break;
         case SDL_KEYUP:
             button_down[event.key.keysym.sym] = false;
             break;
+        case SDL_MOUSEBUTTONDOWN:
+            if (event.button.button == SDL_BUTTON_LEFT)
+                pick = glm::ivec2(event.button.x, event.button.y);
+            break;
         }
 
         if (!running)
@@ -329,27 +944,23 @@ int main() try
         camera_position += camera_move_forward * glm::vec3(-std::sin(camera_rotation), 0.f, std::cos(camera_rotation));
         camera_position += camera_move_sideways * glm::vec3(std::cos(camera_rotation), 0.f, std::sin(camera_rotation));
 
-        GLuint id = 0;
-        for (int i = 0; i < ID_query.size(); ++i) {
-            if (free[i]) {
-                id = ID_query[i];
-                free[i] = false;
-                break;
-            }
+        if (!options.record.empty() && dt > 0.f) {
+            recorded_time += dt;
+            recorded_path.add(recorded_time, {camera_position.x, camera_position.y, camera_position.z, camera_rotation});
         }
-        if (id == 0) {
-            glGenQueries(1, &id);
-            ID_query.push_back(id);
-            free.push_back(false);
-        }
-        glBeginQuery(GL_TIME_ELAPSED, id);
 
-        glClearColor(0.8f, 0.8f, 1.f, 0.f);
+        profiler.begin(frame_scope);
+
+        // Uploads and evictions bind and delete textures behind the state cache
+        if (textures.update() > 0)
+            state.invalidate();
+
+        state.clear_color(0.8f, 0.8f, 1.f, 0.f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        glEnable(GL_DEPTH_TEST);
+        state.enable(GL_DEPTH_TEST, true);
 
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        state.blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
         float near = 0.1f;
         float far = 100.f;
@@ -366,38 +977,53 @@ int main() try
 
         glm::vec3 light_direction = glm::normalize(glm::vec3(1.f, 2.f, 3.f));
 
-        frustum frust = frustum(projection * view);
-
-        std::vector <std::vector <glm::vec3>> translations(6);
-
-        for (int x = -16; x < 16; ++x) {
-            for (int z = -16; z < 16; ++z) {
-                aabb ab = aabb(input_model.meshes[0].min + glm::vec3(x, 0.f, z), input_model.meshes[0].max + glm::vec3(x, 0.f, z));
-                if (intersect(ab, frust)) {
-                    int LOD_number = glm::length(camera_position -
-                            (input_model.meshes[0].min + glm::vec3(x, 0.f, z) +
-                            input_model.meshes[0].max + glm::vec3(x, 0.f, z)) / 2.f) / 4.f;
-                    //std::cout << LOD_number << std::endl;
-                    if (LOD_number < 6)
-                        translations[LOD_number].push_back(glm::vec3(x, 0.f, z));
+        if (pick) {
+            // Ray through the center of the clicked pixel, from the near plane (t = 0) to the far one (t = 1)
+            glm::mat4 const inverse_view_projection = glm::inverse(projection * view);
+            glm::vec2 const ndc{2.f * (pick->x + 0.5f) / width - 1.f, 1.f - 2.f * (pick->y + 0.5f) / height};
+            glm::vec4 const ray_begin = inverse_view_projection * glm::vec4(ndc, -1.f, 1.f);
+            glm::vec4 const ray_end = inverse_view_projection * glm::vec4(ndc, 1.f, 1.f);
+            glm::vec3 const origin = ray_begin.xyz() / ray_begin.w;
+
+            std::uint32_t picked = spatial_grid::invalid;
+            float nearest = 1.f;
+            picking_grid.query_ray(origin, ray_end.xyz() / ray_end.w - origin, 1.f, [&](std::uint32_t handle, float t) {
+                if (t <= nearest) {
+                    nearest = t;
+                    picked = handle;
                 }
+            });
+
+            if (picked != spatial_grid::invalid) {
+                glm::vec3 const & position = instance_positions[picking_instance[picked]];
+                std::cout << "Picked bunny " << picking_instance[picked] << " at " << glm::to_string(position) << ", "
+                          << glm::distance(camera_position, position) << " away" << std::endl;
+            } else {
+                std::cout << "Picked nothing" << std::endl;
             }
+            pick.reset();
         }
 
+        auto const scene = update_scene([&](std::uint32_t stage, auto && work) {
+            profiler.begin(scene_scopes[stage], false);
+            work();
+            stats.record(scene_channels[stage], profiler.end());
+        }, camera_position, projection * view, height);
+
 //        glBindBuffer(GL_ARRAY_BUFFER, VBO_translation);
 //        glBufferData(GL_ARRAY_BUFFER, translation.size() * sizeof(glm::vec3), translation.data(), GL_STATIC_DRAW);
 //
 //        std::cout << "Number of instances: " << translation.size() << std::endl;
 
-        glUseProgram(program);
+        state.use_program(program);
         glUniformMatrix4fv(model_location, 1, GL_FALSE, reinterpret_cast<float *>(&model));
         glUniformMatrix4fv(view_location, 1, GL_FALSE, reinterpret_cast<float *>(&view));
         glUniformMatrix4fv(projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&projection));
         glUniform3fv(light_direction_location, 1, reinterpret_cast<float *>(&light_direction));
 
-        glBindTexture(GL_TEXTURE_2D, texture);
+        state.bind_texture(0, GL_TEXTURE_2D, textures.bind(texture));
 
-        glBindVertexArray(vaos[0]);
+        state.bind_vertex_array(vaos[0]);
 
 //        for (int x = -16; x < 16; ++x) {
 //            for (int z = -16; z < 16; ++z) {
@@ -411,34 +1037,76 @@ int main() try
 
 //        glDrawElementsInstanced(GL_TRIANGLES, mesh.indices.count, mesh.indices.type,
 //                                reinterpret_cast<void *>(mesh.indices.view.offset), 1024);
+        profiler.begin(upload_scope, false);
+        instance_stream.begin_frame();
+        auto instance_data = instance_stream.allocate(buckets.instances.size() * sizeof(glm::vec3));
+        std::copy(buckets.instances.begin(), buckets.instances.end(), static_cast<glm::vec3 *>(instance_data.data));
+        instance_stream.finish_writes();
+        stats.record(upload_channel, profiler.end());
+
+        profiler.begin(draw_scope);
+
+        glBindBuffer(GL_ARRAY_BUFFER, VBO_translation);
         for (int lod = 0; lod < 6; ++lod) {
             auto const &mesh = input_model.meshes[lod];
-            glBindBuffer(GL_ARRAY_BUFFER, VBO_translation);
-            glBufferData(GL_ARRAY_BUFFER, translations[lod].size() * sizeof(glm::vec3), translations[lod].data(), GL_STATIC_DRAW);
-            glBindVertexArray(vaos[lod]);
+            std::uint32_t const instance_count = buckets.lod_offsets[lod + 1] - buckets.lod_offsets[lod];
+            if (instance_count == 0)
+                continue;
+
+            // Point the instanced attribute at this LOD's part of the frame's allocation
+            state.bind_vertex_array(vaos[lod]);
+            glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0,
+                    reinterpret_cast<void *>(instance_data.offset + buckets.lod_offsets[lod] * sizeof(glm::vec3)));
             glDrawElementsInstanced(GL_TRIANGLES, mesh.indices.count, mesh.indices.type,
-                                    reinterpret_cast<void *>(mesh.indices.view.offset), translations[lod].size());
+                                    reinterpret_cast<void *>(mesh.indices.view.offset), instance_count);
         }
 
-        glEndQuery(GL_TIME_ELAPSED);
-
-        std::cout << "Size: " << ID_query.size() << std::endl;
-
-        for (int i = 0; i < ID_query.size(); ++i) {
-            if (free[i]) continue;
-            GLint result;
-            glGetQueryObjectiv(ID_query[i], GL_QUERY_RESULT_AVAILABLE, &result);
-            if (result) {
-                GLuint64 time;
-                glGetQueryObjectui64v(ID_query[i], GL_QUERY_RESULT, &time);
-                std::cout << "Time: " << time / 1e6 << std::endl;
-                free[i] = true;
+        instance_stream.end_frame();
+        stats.record(draw_channel, profiler.end());
+
+        // Closes the frame scope
+        profiler.end();
+        profiler.end_frame();
+        bool const window_completed = stats.end_frame(dt);
+        state.end_frame();
+        textures.end_frame();
+
+        // Once per statistics window
+        if (window_completed) {
+            if (occlusion_enabled)
+                std::cout << "Occlusion: " << occlusion.triangle_count() << " occluder triangles, culled "
+                          << scene.culled << " of " << scene.tested << " frustum-visible instances in the last frame" << std::endl;
+            else
+                std::cout << "Occlusion: off, O to turn it on" << std::endl;
+            std::cout << "LOD: " << lods.last_triangle_count() << " triangles, pixel error x" << lods.budget_scale() << std::endl;
+            std::cout << "GL state: " << state.last_frame().issued << " calls issued, " << state.last_frame().elided << " elided per frame" << std::endl;
+            std::cout << "Textures: " << textures.totals().resident_textures << " resident, "
+                      << textures.totals().resident_bytes / (1 << 20) << " of " << textures.budget() / (1 << 20) << " MiB, "
+                      << textures.totals().evictions << " evictions" << std::endl;
+            for (std::uint32_t scope = 0; scope < profiler.scope_count(); ++scope) {
+                std::cout << "  " << profiler.name(scope) << ": CPU " << profiler.cpu_stats(scope).average()
+                          << " ms (max " << profiler.cpu_stats(scope).max() << ")";
+                if (profiler.gpu_stats(scope).count() > 0)
+                    std::cout << ", GPU " << profiler.gpu_stats(scope).average()
+                              << " ms (max " << profiler.gpu_stats(scope).max() << ")";
+                std::cout << std::endl;
             }
+            auto const frame_times = stats.summary(frame_stats::frame_channel, 10);
+            std::cout << "  frame time over 10 s: p50 " << frame_times.p50 << " ms, p95 " << frame_times.p95
+                      << " ms, p99 " << frame_times.p99 << " ms, max " << frame_times.max << " ms" << std::endl;
         }
 
         SDL_GL_SwapWindow(window);
     }
 
+    {
+        std::ofstream trace("practice14_trace.json");
+        profiler.write_chrome_trace(trace);
+    }
+
+    if (!options.record.empty())
+        recorded_path.save(options.record);
+
     SDL_GL_DeleteContext(gl_context);
     SDL_DestroyWindow(window);
 }
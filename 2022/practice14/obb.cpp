@@ -0,0 +1,17 @@
+#include "obb.hpp"
+
+obb::obb(glm::vec3 const & center, glm::mat3 const & axes, glm::vec3 const & half_extents)
+	: center(center)
+	, half_extents(half_extents)
+{
+	for (std::size_t i = 0; i < 8; ++i)
+	{
+		vertices[i] = center
+			+ axes[0] * ((i & 1) ? half_extents.x : -half_extents.x)
+			+ axes[1] * ((i & 2) ? half_extents.y : -half_extents.y)
+			+ axes[2] * ((i & 4) ? half_extents.z : -half_extents.z);
+	}
+
+	face_normals = {axes[0], axes[1], axes[2]};
+	edge_directions = {axes[0], axes[1], axes[2]};
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+#include <glm/mat3x3.hpp>
+
+#include <array>
+
+struct obb
+{
+	// axes must be orthonormal
+	obb(glm::vec3 const & center, glm::mat3 const & axes, glm::vec3 const & half_extents);
+
+	glm::vec3 center;
+	glm::vec3 half_extents;
+
+	std::array<glm::vec3, 8> vertices;
+	std::array<glm::vec3, 3> face_normals;
+	std::array<glm::vec3, 3> edge_directions;
+};
@@ -0,0 +1,345 @@
+#include "occlusion_culling.hpp"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <stdexcept>
+#include <cmath>
+
+namespace
+{
+
+	// Triangles of a box with corners indexed by bits (x, y, z), counter-clockwise from outside
+	std::uint8_t const box_indices[36] = {
+		0, 4, 6, 0, 6, 2,
+		1, 3, 7, 1, 7, 5,
+		0, 1, 5, 0, 5, 4,
+		2, 6, 7, 2, 7, 3,
+		0, 2, 3, 0, 3, 1,
+		4, 5, 7, 4, 7, 6,
+	};
+
+}
+
+void occlusion_culling::begin(glm::mat4 const & view_projection)
+{
+	this->view_projection = view_projection;
+	triangles.clear();
+
+	if (levels.empty())
+	{
+		int w = width, h = height;
+		while (true)
+		{
+			levels.emplace_back(std::size_t(w) * h);
+			if (w == 1 && h == 1)
+				break;
+			w = std::max(1, w / 2);
+			h = std::max(1, h / 2);
+		}
+	}
+
+	std::fill(levels[0].begin(), levels[0].end(), 1.f);
+}
+
+void occlusion_culling::add_box_occluder(glm::vec3 const & min, glm::vec3 const & max)
+{
+	box_scratch.resize(8);
+	for (int i = 0; i < 8; ++i)
+		box_scratch[i] = {(i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z};
+	add_occluder(box_scratch, box_indices, std::size(box_indices), glm::mat4(1.f));
+}
+
+void occlusion_culling::finish(worker_pool & pool)
+{
+	// Binned once, so that a thread only visits the triangles of its band
+	int const band_height = (height + pool.size() - 1) / pool.size();
+	bands.resize(pool.size());
+	for (auto & band : bands)
+		band.clear();
+
+	for (std::size_t t = 0; t < triangles.size(); t += 3)
+	{
+		float const y_min = std::min({triangles[t].y, triangles[t + 1].y, triangles[t + 2].y});
+		float const y_max = std::max({triangles[t].y, triangles[t + 1].y, triangles[t + 2].y});
+		int const first = std::max(0, static_cast<int>(std::floor(y_min)) / band_height);
+		int const last = std::min<int>(bands.size() - 1, std::min(height - 1, static_cast<int>(std::ceil(y_max))) / band_height);
+		for (int b = first; b <= last; ++b)
+			bands[b].push_back(t);
+	}
+
+	pool.run([&](std::size_t thread_index)
+	{
+		int const y_begin = std::min<int>(height, thread_index * band_height);
+		int const y_end = std::min<int>(height, y_begin + band_height);
+		if (y_begin < y_end)
+			rasterize(y_begin, y_end, bands[thread_index]);
+	});
+
+	build_pyramid();
+}
+
+void occlusion_culling::rasterize(int y_begin, int y_end, std::vector<std::uint32_t> const & band)
+{
+	static_assert(width % 8 == 0);
+
+	float * const depth = levels[0].data();
+
+	for (std::uint32_t t : band)
+	{
+		glm::vec3 const & a = triangles[t + 0];
+		glm::vec3 const & b = triangles[t + 1];
+		glm::vec3 const & c = triangles[t + 2];
+
+		// Blocks of 8 pixels start at multiples of 8 and width is one too, so they never leave the row
+		int const x0 = std::max(0, static_cast<int>(std::floor(std::min({a.x, b.x, c.x})))) & ~7;
+		int const x1 = std::min(width - 1, static_cast<int>(std::ceil(std::max({a.x, b.x, c.x}))));
+		int const y0 = std::max(y_begin, static_cast<int>(std::floor(std::min({a.y, b.y, c.y}))));
+		int const y1 = std::min(y_end - 1, static_cast<int>(std::ceil(std::max({a.y, b.y, c.y}))));
+
+		if (x0 > x1 || y0 > y1)
+			continue;
+
+		// Edge functions e_i(x, y) = A_i * x + B_i * y + C_i, positive inside
+		float const A0 = b.y - c.y, B0 = c.x - b.x, C0 = b.x * c.y - b.y * c.x;
+		float const A1 = c.y - a.y, B1 = a.x - c.x, C1 = c.x * a.y - c.y * a.x;
+		float const A2 = a.y - b.y, B2 = b.x - a.x, C2 = a.x * b.y - a.y * b.x;
+
+		float const inv_area = 1.f / (A0 * a.x + B0 * a.y + C0);
+
+		// Depth is affine in screen space: z(x, y) = zA * x + zB * y + zC
+		float const zA = (A0 * a.z + A1 * b.z + A2 * c.z) * inv_area;
+		float const zB = (B0 * a.z + B1 * b.z + B2 * c.z) * inv_area;
+		float const zC = (C0 * a.z + C1 * b.z + C2 * c.z) * inv_area;
+
+		for (int y = y0; y <= y1; ++y)
+		{
+			float const py = y + 0.5f;
+			float * __restrict row = depth + std::size_t(y) * width;
+
+			float const r0 = B0 * py + C0;
+			float const r1 = B1 * py + C1;
+			float const r2 = B2 * py + C2;
+			float const rz = zB * py + zC;
+
+			for (int x = x0; x <= x1; x += 8)
+			{
+				// Branchless over a fixed block, so that the compiler vectorizes it
+				for (int k = 0; k < 8; ++k)
+				{
+					float const px = x + k + 0.5f;
+					bool const inside = (A0 * px + r0 >= 0.f) & (A1 * px + r1 >= 0.f) & (A2 * px + r2 >= 0.f);
+					float const z = zA * px + rz;
+					row[x + k] = (inside & (z < row[x + k])) ? z : row[x + k];
+				}
+			}
+		}
+	}
+}
+
+void occlusion_culling::build_pyramid()
+{
+	int w = width, h = height;
+	for (std::size_t level = 1; level < levels.size(); ++level)
+	{
+		int const nw = std::max(1, w / 2);
+		int const nh = std::max(1, h / 2);
+
+		float const * src = levels[level - 1].data();
+		float * dst = levels[level].data();
+
+		for (int y = 0; y < nh; ++y)
+		{
+			int const sy0 = std::min(2 * y, h - 1), sy1 = std::min(2 * y + 1, h - 1);
+			for (int x = 0; x < nw; ++x)
+			{
+				int const sx0 = std::min(2 * x, w - 1), sx1 = std::min(2 * x + 1, w - 1);
+				dst[y * nw + x] = std::max(
+					std::max(src[sy0 * w + sx0], src[sy0 * w + sx1]),
+					std::max(src[sy1 * w + sx0], src[sy1 * w + sx1]));
+			}
+		}
+
+		w = nw;
+		h = nh;
+	}
+}
+
+bool occlusion_culling::visible(glm::vec3 const & min, glm::vec3 const & max) const
+{
+	float xmin = width, xmax = 0.f, ymin = height, ymax = 0.f;
+	float zmin = 1.f;
+
+	for (int i = 0; i < 8; ++i)
+	{
+		glm::vec4 const v = view_projection * glm::vec4(
+			(i & 1) ? max.x : min.x,
+			(i & 2) ? max.y : min.y,
+			(i & 4) ? max.z : min.z,
+			1.f);
+
+		// Boxes reaching behind the near plane are never occluded
+		if (v.w <= 1e-4f || v.z < -v.w)
+			return true;
+
+		float const x = (v.x / v.w * 0.5f + 0.5f) * width;
+		float const y = (v.y / v.w * 0.5f + 0.5f) * height;
+		xmin = std::min(xmin, x); xmax = std::max(xmax, x);
+		ymin = std::min(ymin, y); ymax = std::max(ymax, y);
+		zmin = std::min(zmin, v.z / v.w * 0.5f + 0.5f);
+	}
+
+	int x0 = std::max(0, static_cast<int>(std::floor(xmin)));
+	int x1 = std::min(width - 1, static_cast<int>(std::floor(xmax)));
+	int y0 = std::max(0, static_cast<int>(std::floor(ymin)));
+	int y1 = std::min(height - 1, static_cast<int>(std::floor(ymax)));
+
+	if (x0 > x1 || y0 > y1)
+		return true;
+
+	// Coarsest level at which the rectangle spans at most 2x2 texels
+	std::size_t level = 0;
+	int w = width, h = height;
+	while (level + 1 < levels.size() && (x1 - x0 > 1 || y1 - y0 > 1))
+	{
+		x0 /= 2; x1 /= 2;
+		y0 /= 2; y1 /= 2;
+		w = std::max(1, w / 2);
+		h = std::max(1, h / 2);
+		x1 = std::min(x1, w - 1);
+		y1 = std::min(y1, h - 1);
+		++level;
+	}
+
+	float const * data = levels[level].data();
+	for (int y = y0; y <= y1; ++y)
+		for (int x = x0; x <= x1; ++x)
+			if (zmin <= data[y * w + x])
+				return true;
+
+	return false;
+}
+
+aabb inner_box(std::vector<glm::vec3> const & positions, std::vector<std::uint32_t> const & indices)
+{
+	std::size_t const triangle_count = indices.size() / 3;
+
+	// Bounds of the triangles, one array per side so that the overlap test vectorizes
+	std::array<std::vector<float>, 3> lower, upper;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		lower[axis].resize(triangle_count);
+		upper[axis].resize(triangle_count);
+	}
+
+	glm::vec3 mesh_min(std::numeric_limits<float>::infinity()), mesh_max(-std::numeric_limits<float>::infinity());
+	for (std::size_t t = 0; t < triangle_count; ++t)
+	{
+		glm::vec3 const & a = positions[indices[3 * t + 0]];
+		glm::vec3 const & b = positions[indices[3 * t + 1]];
+		glm::vec3 const & c = positions[indices[3 * t + 2]];
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			lower[axis][t] = std::min({a[axis], b[axis], c[axis]});
+			upper[axis][t] = std::max({a[axis], b[axis], c[axis]});
+		}
+		mesh_min = glm::min(mesh_min, glm::min(a, glm::min(b, c)));
+		mesh_max = glm::max(mesh_max, glm::max(a, glm::max(b, c)));
+	}
+
+	auto const touches = [&](glm::vec3 const & min, glm::vec3 const & max)
+	{
+		bool result = false;
+		for (std::size_t t = 0; t < triangle_count; ++t)
+			result |= (lower[0][t] <= max.x) & (upper[0][t] >= min.x) & (lower[1][t] <= max.y) & (upper[1][t] >= min.y)
+				& (lower[2][t] <= max.z) & (upper[2][t] >= min.z);
+		return result;
+	};
+
+	// Half size of the largest cube around p that touches no triangle's bounds
+	auto const clearance = [&](glm::vec3 const & p)
+	{
+		float result = std::numeric_limits<float>::infinity();
+		for (std::size_t t = 0; t < triangle_count; ++t)
+		{
+			float distance = 0.f;
+			for (int axis = 0; axis < 3; ++axis)
+				distance = std::max({distance, lower[axis][t] - p[axis], p[axis] - upper[axis][t]});
+			result = std::min(result, distance);
+		}
+		return result;
+	};
+
+	// Parity of the crossings of a ray in a direction unlikely to hit an edge exactly (Moller-Trumbore)
+	auto const inside = [&](glm::vec3 const & p)
+	{
+		glm::vec3 const direction(1.f, 0.0123f, 0.0371f);
+		bool result = false;
+		for (std::size_t t = 0; t < triangle_count; ++t)
+		{
+			glm::vec3 const & a = positions[indices[3 * t + 0]];
+			glm::vec3 const e1 = positions[indices[3 * t + 1]] - a;
+			glm::vec3 const e2 = positions[indices[3 * t + 2]] - a;
+			glm::vec3 const h = glm::cross(direction, e2);
+			float const det = glm::dot(e1, h);
+			if (det == 0.f)
+				continue;
+			glm::vec3 const s = p - a;
+			float const u = glm::dot(s, h) / det;
+			glm::vec3 const q = glm::cross(s, e1);
+			float const v = glm::dot(direction, q) / det;
+			float const distance = glm::dot(e2, q) / det;
+			if (u >= 0.f && v >= 0.f && u + v <= 1.f && distance > 0.f)
+				result = !result;
+		}
+		return result;
+	};
+
+	// Seeds on a grid over the bounding box
+	int const seeds = 8;
+	glm::vec3 seed(0.f);
+	float best = 0.f;
+	for (int i = 0; i < seeds * seeds * seeds; ++i)
+	{
+		glm::vec3 const p = mesh_min + (mesh_max - mesh_min) * (glm::vec3(i % seeds, i / seeds % seeds, i / seeds / seeds) + 0.5f) / float(seeds);
+		float const c = clearance(p);
+		if (c > best && inside(p))
+		{
+			best = c;
+			seed = p;
+		}
+	}
+	if (!(best > 0.f))
+		throw std::runtime_error("The mesh has no interior to place an occluder in");
+
+	glm::vec3 min = seed - 0.99f * best, max = seed + 0.99f * best;
+
+	// Faces are grown one step at a time in turn, so that the box stays balanced; the step is halved when none can grow
+	float const size = std::max({mesh_max.x - mesh_min.x, mesh_max.y - mesh_min.y, mesh_max.z - mesh_min.z});
+	for (float step = size / 64.f; step > size / 4096.f;)
+	{
+		bool grown = false;
+		for (int face = 0; face < 6; ++face)
+		{
+			glm::vec3 grown_min = min, grown_max = max;
+			if (face < 3)
+				grown_min[face] -= step;
+			else
+				grown_max[face - 3] += step;
+
+			if (!touches(grown_min, grown_max))
+			{
+				min = grown_min;
+				max = grown_max;
+				grown = true;
+			}
+		}
+		if (!grown)
+			step /= 2.f;
+	}
+
+	return aabb(min, max);
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "worker_pool.hpp"
+#include "aabb.hpp"
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <vector>
+#include <cstdint>
+
+// Software occlusion culling: a few occluder meshes are rasterized into a
+// small depth buffer, which is reduced into a hierarchical-Z pyramid where each
+// texel holds the farthest depth of the texels it covers. A box is occluded if
+// its nearest depth is farther than the pyramid over its screen rectangle.
+//
+// Occluders must never cover more than the objects they stand for; boxes
+// inside the objects, see inner_box(), are conservative and cost 12 triangles.
+struct occlusion_culling
+{
+	static constexpr int width = 256;
+	static constexpr int height = 128;
+
+	// Starts a new frame; depth is reset to the far plane
+	void begin(glm::mat4 const & view_projection);
+
+	// Queues an occluder; positions are in model space, indices form a triangle list.
+	// Occluders should not be larger than the objects they stand for.
+	template <typename Index>
+	void add_occluder(std::vector<glm::vec3> const & positions, Index const * indices, std::size_t index_count, glm::mat4 const & model);
+
+	// Queues a world-space box
+	void add_box_occluder(glm::vec3 const & min, glm::vec3 const & max);
+
+	// Bins queued occluders into horizontal bands, rasterizes one band per thread and builds the pyramid
+	void finish(worker_pool & pool);
+
+	// Thread-safe once finish() returned
+	bool visible(glm::vec3 const & min, glm::vec3 const & max) const;
+
+	std::size_t triangle_count() const { return triangles.size() / 3; }
+
+private:
+	void rasterize(int y_begin, int y_end, std::vector<std::uint32_t> const & band);
+	void build_pyramid();
+
+	glm::mat4 view_projection;
+
+	// Screen-space vertices (x, y in pixels, z is depth in [0, 1]), three per triangle
+	std::vector<glm::vec3> triangles;
+	std::vector<glm::vec4> clip_scratch;
+	std::vector<glm::vec3> box_scratch;
+
+	// Per band, indices of the first vertex of the triangles overlapping it
+	std::vector<std::vector<std::uint32_t>> bands;
+
+	// levels[0] is width x height, each next level halves both sizes
+	std::vector<std::vector<float>> levels;
+};
+
+// A large box inside a closed mesh: it is grown from the interior point
+// farthest from the triangles' bounding boxes until growing any face would
+// touch one of them. No triangle touches the box and it contains a point
+// inside the mesh, so all of it is inside. Throws if the mesh has no interior.
+aabb inner_box(std::vector<glm::vec3> const & positions, std::vector<std::uint32_t> const & indices);
+
+template <typename Index>
+void occlusion_culling::add_occluder(std::vector<glm::vec3> const & positions, Index const * indices, std::size_t index_count, glm::mat4 const & model)
+{
+	glm::mat4 const m = view_projection * model;
+
+	clip_scratch.resize(positions.size());
+	for (std::size_t i = 0; i < positions.size(); ++i)
+		clip_scratch[i] = m * glm::vec4(positions[i], 1.f);
+
+	for (std::size_t i = 0; i + 2 < index_count; i += 3)
+	{
+		glm::vec4 const & a = clip_scratch[indices[i + 0]];
+		glm::vec4 const & b = clip_scratch[indices[i + 1]];
+		glm::vec4 const & c = clip_scratch[indices[i + 2]];
+
+		// Triangles crossing the near plane are dropped: an occluder may only ever be smaller
+		if (a.w <= 1e-4f || b.w <= 1e-4f || c.w <= 1e-4f)
+			continue;
+		if (a.z < -a.w || b.z < -b.w || c.z < -c.w)
+			continue;
+
+		auto to_screen = [](glm::vec4 const & v)
+		{
+			return glm::vec3(
+				(v.x / v.w * 0.5f + 0.5f) * width,
+				(v.y / v.w * 0.5f + 0.5f) * height,
+				v.z / v.w * 0.5f + 0.5f);
+		};
+
+		glm::vec3 const sa = to_screen(a);
+		glm::vec3 const sb = to_screen(b);
+		glm::vec3 const sc = to_screen(c);
+
+		// Back faces are hidden behind front faces of the same closed mesh
+		float const area = (sb.x - sa.x) * (sc.y - sa.y) - (sb.y - sa.y) * (sc.x - sa.x);
+		if (area <= 0.f)
+			continue;
+
+		triangles.push_back(sa);
+		triangles.push_back(sb);
+		triangles.push_back(sc);
+	}
+}
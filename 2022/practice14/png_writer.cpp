@@ -0,0 +1,216 @@
+#include "png_writer.hpp"
+
+#include <vector>
+#include <array>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+
+	struct bit_writer
+	{
+		std::vector<std::uint8_t> & out;
+		std::uint32_t bits = 0;
+		int count = 0;
+
+		// Deflate packs values starting from the least significant bit
+		void write(std::uint32_t value, int length)
+		{
+			bits |= value << count;
+			count += length;
+			while (count >= 8)
+			{
+				out.push_back(bits & 0xff);
+				bits >>= 8;
+				count -= 8;
+			}
+		}
+
+		// Huffman codes are packed starting from their most significant bit
+		void write_code(std::uint32_t code, int length)
+		{
+			std::uint32_t reversed = 0;
+			for (int i = 0; i < length; ++i)
+				reversed |= ((code >> i) & 1) << (length - 1 - i);
+			write(reversed, length);
+		}
+
+		void flush()
+		{
+			if (count > 0)
+				out.push_back(bits & 0xff);
+			bits = 0;
+			count = 0;
+		}
+	};
+
+	void write_literal(bit_writer & writer, std::uint32_t symbol)
+	{
+		if (symbol < 144)
+			writer.write_code(0x30 + symbol, 8);
+		else if (symbol < 256)
+			writer.write_code(0x190 + symbol - 144, 9);
+		else if (symbol < 280)
+			writer.write_code(symbol - 256, 7);
+		else
+			writer.write_code(0xc0 + symbol - 280, 8);
+	}
+
+	constexpr std::array<std::uint16_t, 29> length_base{3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+	constexpr std::array<std::uint8_t, 29> length_extra{0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+	constexpr std::array<std::uint16_t, 30> distance_base{1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+	constexpr std::array<std::uint8_t, 30> distance_extra{0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+	void write_match(bit_writer & writer, std::uint32_t length, std::uint32_t distance)
+	{
+		std::size_t l = std::upper_bound(length_base.begin(), length_base.end(), length) - length_base.begin() - 1;
+		write_literal(writer, 257 + l);
+		writer.write(length - length_base[l], length_extra[l]);
+
+		std::size_t d = std::upper_bound(distance_base.begin(), distance_base.end(), distance) - distance_base.begin() - 1;
+		writer.write_code(d, 5);
+		writer.write(distance - distance_base[d], distance_extra[d]);
+	}
+
+	// zlib stream with a single fixed-code block; greedy matching against the last occurrence of every 3-byte hash
+	std::vector<std::uint8_t> zlib_compress(std::vector<std::uint8_t> const & data)
+	{
+		std::vector<std::uint8_t> out{0x78, 0x01};
+		bit_writer writer{out};
+
+		// Final block, fixed codes
+		writer.write(1, 1);
+		writer.write(1, 2);
+
+		std::size_t const window = 32768;
+		std::size_t const max_length = 258;
+		std::vector<std::int64_t> last(1 << 15, -1);
+
+		auto const hash = [&](std::size_t i)
+		{
+			return ((data[i] << 10) ^ (data[i + 1] << 5) ^ data[i + 2]) & 0x7fff;
+		};
+
+		std::size_t i = 0;
+		while (i < data.size())
+		{
+			std::size_t length = 0, distance = 0;
+			if (i + 3 <= data.size())
+			{
+				auto const h = hash(i);
+				std::int64_t const candidate = last[h];
+				last[h] = i;
+
+				if (candidate >= 0 && i - candidate <= window)
+				{
+					std::size_t const limit = std::min(max_length, data.size() - i);
+					while (length < limit && data[candidate + length] == data[i + length])
+						++length;
+					distance = i - candidate;
+				}
+			}
+
+			if (length >= 3)
+			{
+				write_match(writer, length, distance);
+				for (std::size_t k = 1; k < length && i + k + 3 <= data.size(); ++k)
+					last[hash(i + k)] = i + k;
+				i += length;
+			}
+			else
+			{
+				write_literal(writer, data[i]);
+				++i;
+			}
+		}
+
+		write_literal(writer, 256);
+		writer.flush();
+
+		std::uint32_t a = 1, b = 0;
+		for (auto byte : data)
+		{
+			a = (a + byte) % 65521;
+			b = (b + a) % 65521;
+		}
+		std::uint32_t const adler = (b << 16) | a;
+		for (int shift = 24; shift >= 0; shift -= 8)
+			out.push_back((adler >> shift) & 0xff);
+
+		return out;
+	}
+
+	std::uint32_t crc32(std::uint8_t const * data, std::size_t size, std::uint32_t crc = 0)
+	{
+		static auto const table = []
+		{
+			std::array<std::uint32_t, 256> result;
+			for (std::uint32_t n = 0; n < 256; ++n)
+			{
+				std::uint32_t c = n;
+				for (int k = 0; k < 8; ++k)
+					c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+				result[n] = c;
+			}
+			return result;
+		}();
+
+		crc = ~crc;
+		for (std::size_t i = 0; i < size; ++i)
+			crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+		return ~crc;
+	}
+
+	void write_chunk(std::ostream & os, char const (&type)[5], std::vector<std::uint8_t> const & data)
+	{
+		auto const write_u32 = [&](std::uint32_t value)
+		{
+			char const bytes[4] = {char(value >> 24), char(value >> 16), char(value >> 8), char(value)};
+			os.write(bytes, 4);
+		};
+
+		write_u32(data.size());
+		os.write(type, 4);
+		os.write(reinterpret_cast<char const *>(data.data()), data.size());
+		write_u32(crc32(data.data(), data.size(), crc32(reinterpret_cast<std::uint8_t const *>(type), 4)));
+	}
+
+}
+
+void write_png(std::string const & path, int width, int height, std::uint8_t const * rgba)
+{
+	// Every row starts with its filter type; the Sub filter turns smooth gradients into runs
+	std::size_t const row_size = std::size_t(width) * 4;
+	std::vector<std::uint8_t> filtered;
+	filtered.reserve((row_size + 1) * height);
+	for (int y = height - 1; y >= 0; --y)
+	{
+		std::uint8_t const * row = rgba + y * row_size;
+		filtered.push_back(1);
+		for (std::size_t x = 0; x < row_size; ++x)
+			filtered.push_back(row[x] - (x >= 4 ? row[x - 4] : 0));
+	}
+
+	std::vector<std::uint8_t> header(13);
+	for (int i = 0; i < 4; ++i)
+	{
+		header[i] = std::uint32_t(width) >> (24 - 8 * i);
+		header[4 + i] = std::uint32_t(height) >> (24 - 8 * i);
+	}
+	header[8] = 8;
+	header[9] = 6;
+
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+		throw std::runtime_error("Failed to open " + path);
+
+	file.write("\x89PNG\r\n\x1a\n", 8);
+	write_chunk(file, "IHDR", header);
+	write_chunk(file, "IDAT", zlib_compress(filtered));
+	write_chunk(file, "IEND", {});
+
+	if (!file)
+		throw std::runtime_error("Failed to write " + path);
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+// Writes an 8-bit RGBA image; rows are stored bottom to top, as OpenGL
+// returns them, and are flipped in the file. Compresses with fixed-code
+// deflate, which is a fraction of the size of stored blocks for rendered
+// images. Throws if the file can't be written.
+void write_png(std::string const & path, int width, int height, std::uint8_t const * rgba);
@@ -0,0 +1,402 @@
+#include "software_rasterizer.hpp"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <stdexcept>
+
+namespace
+{
+
+	// OpenGL enums as stored in gltf_model accessors
+	constexpr unsigned int gl_unsigned_short = 0x1403;
+	constexpr unsigned int gl_unsigned_int = 0x1405;
+	constexpr unsigned int gl_float = 0x1406;
+
+	std::uint32_t index_at(raster_mesh const & mesh, std::size_t i)
+	{
+		if (mesh.index_size == 2)
+			return static_cast<std::uint16_t const *>(mesh.indices)[i];
+		return static_cast<std::uint32_t const *>(mesh.indices)[i];
+	}
+
+}
+
+raster_mesh make_raster_mesh(gltf_model const & model, gltf_model::mesh const & mesh)
+{
+	auto const check = [](gltf_model::accessor const & accessor, unsigned int size)
+	{
+		if (accessor.type != gl_float || accessor.size != size)
+			throw std::runtime_error("Unsupported vertex attribute format");
+	};
+
+	check(mesh.position, 3);
+	check(mesh.normal, 3);
+
+	raster_mesh result;
+	char const * buffer = model.buffer.data();
+	result.position = {buffer + mesh.position.view.offset, 3 * sizeof(float)};
+	result.normal = {buffer + mesh.normal.view.offset, 3 * sizeof(float)};
+	if (mesh.texcoord.count > 0)
+	{
+		check(mesh.texcoord, 2);
+		result.texcoord = {buffer + mesh.texcoord.view.offset, 2 * sizeof(float)};
+	}
+	result.vertex_count = mesh.position.count;
+
+	if (mesh.indices.type == gl_unsigned_short)
+		result.index_size = 2;
+	else if (mesh.indices.type == gl_unsigned_int)
+		result.index_size = 4;
+	else
+		throw std::runtime_error("Unsupported index format");
+	result.indices = buffer + mesh.indices.view.offset;
+	result.index_count = mesh.indices.count;
+
+	return result;
+}
+
+glm::vec3 raster_texture::sample(glm::vec2 const & texcoord) const
+{
+	float const u = texcoord.x * width - 0.5f;
+	float const v = texcoord.y * height - 0.5f;
+	float const fu = std::floor(u), fv = std::floor(v);
+	float const tu = u - fu, tv = v - fv;
+
+	auto const wrap = [](int i, int size) { return ((i % size) + size) % size; };
+	int const x0 = wrap(static_cast<int>(fu), width), x1 = wrap(static_cast<int>(fu) + 1, width);
+	int const y0 = wrap(static_cast<int>(fv), height), y1 = wrap(static_cast<int>(fv) + 1, height);
+
+	auto const texel = [&](int x, int y)
+	{
+		std::uint8_t const * p = pixels.data() + (std::size_t(y) * width + x) * 4;
+		return glm::vec3(p[0], p[1], p[2]) / 255.f;
+	};
+
+	return glm::mix(
+		glm::mix(texel(x0, y0), texel(x1, y0), tu),
+		glm::mix(texel(x0, y1), texel(x1, y1), tu),
+		tv);
+}
+
+software_rasterizer::software_rasterizer(int width, int height)
+	: target_width(width)
+	, target_height(height)
+	, tiles_x((width + tile_size - 1) / tile_size)
+	, tiles_y((height + tile_size - 1) / tile_size)
+	, color_buffer(std::size_t(width) * height * 4)
+	, depth_buffer(std::size_t(width) * height)
+{}
+
+void software_rasterizer::begin(glm::mat4 const & view_projection, glm::vec3 const & light_direction, glm::vec4 const & clear_color)
+{
+	this->view_projection = view_projection;
+	this->light_direction = light_direction;
+	this->clear_color = clear_color;
+	draws.clear();
+}
+
+void software_rasterizer::draw(raster_mesh const & mesh, raster_texture const * texture, glm::vec4 const & color, glm::mat4 const & model,
+	glm::vec3 const * instance_positions, std::size_t instance_count)
+{
+	if (instance_count > 0)
+		draws.push_back({&mesh, texture, color, model, instance_positions, instance_count});
+}
+
+void software_rasterizer::finish(worker_pool & pool)
+{
+	// Every instance of every draw is an item; items are split between threads
+	// into contiguous ranges of about the same number of triangles
+	std::vector<std::size_t> item_triangles{0};
+	for (auto const & d : draws)
+		for (std::size_t i = 0; i < d.instance_count; ++i)
+			item_triangles.push_back(item_triangles.back() + d.mesh->index_count / 3);
+
+	threads.resize(pool.size());
+	for (auto & state : threads)
+	{
+		state.triangles.clear();
+		state.tiles.resize(std::size_t(tiles_x) * tiles_y);
+		for (auto & tile : state.tiles)
+			tile.clear();
+		state.fragments = 0;
+	}
+
+	std::size_t const item_count = item_triangles.size() - 1;
+	std::size_t const total = item_triangles.back();
+	auto const split = [&](std::size_t thread_index)
+	{
+		if (thread_index == threads.size())
+			return item_count;
+		return std::size_t(std::lower_bound(item_triangles.begin(), item_triangles.end() - 1, total * thread_index / threads.size()) - item_triangles.begin());
+	};
+
+	pool.run([&](std::size_t thread_index)
+	{
+		process_draws(threads[thread_index], split(thread_index), split(thread_index + 1));
+	});
+
+	std::atomic<int> next_tile{0};
+	pool.run([&](std::size_t thread_index)
+	{
+		for (int tile; (tile = next_tile.fetch_add(1, std::memory_order_relaxed)) < tiles_x * tiles_y;)
+			rasterize_tile(tile, threads[thread_index]);
+	});
+
+	stats = {};
+	for (auto const & state : threads)
+	{
+		stats.triangles += state.triangles.size();
+		for (auto const & tile : state.tiles)
+			stats.tile_entries += tile.size();
+		stats.fragments += state.fragments;
+	}
+}
+
+void software_rasterizer::process_draws(thread_state & state, std::size_t item_begin, std::size_t item_end)
+{
+	std::size_t item = 0;
+	for (std::uint32_t d = 0; d < draws.size() && item < item_end; ++d)
+	{
+		draw_call const & call = draws[d];
+		raster_mesh const & mesh = *call.mesh;
+
+		glm::mat4 const mvp = view_projection * call.model;
+		glm::mat3 const normal_matrix(call.model);
+
+		for (std::size_t instance = 0; instance < call.instance_count; ++instance, ++item)
+		{
+			if (item < item_begin)
+				continue;
+			if (item >= item_end)
+				break;
+
+			glm::vec4 const offset = call.instances ? mvp * glm::vec4(call.instances[instance], 0.f) : glm::vec4(0.f);
+
+			state.vertices.resize(mesh.vertex_count);
+			for (std::size_t i = 0; i < mesh.vertex_count; ++i)
+			{
+				clip_vertex & v = state.vertices[i];
+				v.position = mvp * glm::vec4(mesh.position.get<glm::vec3>(i), 1.f) + offset;
+				v.normal = normal_matrix * mesh.normal.get<glm::vec3>(i);
+				v.texcoord = mesh.texcoord.data ? mesh.texcoord.get<glm::vec2>(i) : glm::vec2(0.f);
+			}
+
+			for (std::size_t i = 0; i + 2 < mesh.index_count; i += 3)
+			{
+				clip_vertex const * v[3] = {
+					&state.vertices[index_at(mesh, i + 0)],
+					&state.vertices[index_at(mesh, i + 1)],
+					&state.vertices[index_at(mesh, i + 2)],
+				};
+
+				// Trivially outside one of the side or far planes
+				auto const outside = [&](auto const & test)
+				{
+					return test(v[0]->position) && test(v[1]->position) && test(v[2]->position);
+				};
+				if (outside([](glm::vec4 const & p){ return p.x > p.w; }) || outside([](glm::vec4 const & p){ return p.x < -p.w; })
+					|| outside([](glm::vec4 const & p){ return p.y > p.w; }) || outside([](glm::vec4 const & p){ return p.y < -p.w; })
+					|| outside([](glm::vec4 const & p){ return p.z > p.w; }))
+					continue;
+
+				float const distance[3] = {
+					v[0]->position.z + v[0]->position.w,
+					v[1]->position.z + v[1]->position.w,
+					v[2]->position.z + v[2]->position.w,
+				};
+
+				if (distance[0] >= 0.f && distance[1] >= 0.f && distance[2] >= 0.f)
+				{
+					setup(state, *v[0], *v[1], *v[2], d);
+					continue;
+				}
+
+				// Clips against the near plane z = -w into a polygon of at most four vertices
+				clip_vertex polygon[4];
+				int count = 0;
+				for (int k = 0; k < 3; ++k)
+				{
+					int const next = (k + 1) % 3;
+					if (distance[k] >= 0.f)
+						polygon[count++] = *v[k];
+					if ((distance[k] >= 0.f) != (distance[next] >= 0.f))
+					{
+						float const t = distance[k] / (distance[k] - distance[next]);
+						polygon[count].position = glm::mix(v[k]->position, v[next]->position, t);
+						polygon[count].normal = glm::mix(v[k]->normal, v[next]->normal, t);
+						polygon[count].texcoord = glm::mix(v[k]->texcoord, v[next]->texcoord, t);
+						++count;
+					}
+				}
+
+				for (int k = 1; k + 1 < count; ++k)
+					setup(state, polygon[0], polygon[k], polygon[k + 1], d);
+			}
+		}
+	}
+}
+
+void software_rasterizer::setup(thread_state & state, clip_vertex const & va, clip_vertex const & vb, clip_vertex const & vc, std::uint32_t draw)
+{
+	auto const to_screen = [this](glm::vec4 const & p)
+	{
+		float const inverse_w = 1.f / p.w;
+		return glm::vec4(
+			(p.x * inverse_w * 0.5f + 0.5f) * target_width,
+			(p.y * inverse_w * 0.5f + 0.5f) * target_height,
+			p.z * inverse_w * 0.5f + 0.5f,
+			inverse_w);
+	};
+
+	clip_vertex const * v[3] = {&va, &vb, &vc};
+	glm::vec4 s[3] = {to_screen(va.position), to_screen(vb.position), to_screen(vc.position)};
+
+	float area = (s[1].x - s[0].x) * (s[2].y - s[0].y) - (s[1].y - s[0].y) * (s[2].x - s[0].x);
+	if (!(std::abs(area) > 0.f))
+		return;
+
+	// Faces are not culled, back faces are turned around so that edge functions are positive inside
+	if (area < 0.f)
+	{
+		std::swap(v[1], v[2]);
+		std::swap(s[1], s[2]);
+		area = -area;
+	}
+
+	triangle t;
+	t.x0 = std::max(0, static_cast<int>(std::floor(std::min({s[0].x, s[1].x, s[2].x}))));
+	t.x1 = std::min(target_width - 1, static_cast<int>(std::floor(std::max({s[0].x, s[1].x, s[2].x}))));
+	t.y0 = std::max(0, static_cast<int>(std::floor(std::min({s[0].y, s[1].y, s[2].y}))));
+	t.y1 = std::min(target_height - 1, static_cast<int>(std::floor(std::max({s[0].y, s[1].y, s[2].y}))));
+	if (t.x0 > t.x1 || t.y0 > t.y1)
+		return;
+
+	// Planes are relative to the corner of the bounding box; with absolute
+	// pixel coordinates the constant terms of small triangles cancel out
+	glm::vec2 const origin(t.x0, t.y0);
+
+	// Edge i is opposite to vertex i
+	for (int i = 0; i < 3; ++i)
+	{
+		glm::vec4 const & p = s[(i + 1) % 3];
+		glm::vec4 const & q = s[(i + 2) % 3];
+		float const a = p.y - q.y, b = q.x - p.x;
+		t.edge[i] = {a, b, a * (origin.x - p.x) + b * (origin.y - p.y)};
+
+		// (a, b) points inside: the inside is to the right of a left edge and below a top one (y is up)
+		t.top_left[i] = a > 0.f || (a == 0.f && b < 0.f);
+	}
+
+	// A value given at the vertices, as a screen-space plane
+	auto const plane = [&](float f0, float f1, float f2)
+	{
+		float const a = (t.edge[0].x * f0 + t.edge[1].x * f1 + t.edge[2].x * f2) / area;
+		float const b = (t.edge[0].y * f0 + t.edge[1].y * f1 + t.edge[2].y * f2) / area;
+		return glm::vec3(a, b, f0 + a * (origin.x - s[0].x) + b * (origin.y - s[0].y));
+	};
+
+	t.depth = plane(s[0].z, s[1].z, s[2].z);
+	t.inverse_w = plane(s[0].w, s[1].w, s[2].w);
+	for (int k = 0; k < 3; ++k)
+		t.attribute[k] = plane(v[0]->normal[k] * s[0].w, v[1]->normal[k] * s[1].w, v[2]->normal[k] * s[2].w);
+	for (int k = 0; k < 2; ++k)
+		t.attribute[3 + k] = plane(v[0]->texcoord[k] * s[0].w, v[1]->texcoord[k] * s[1].w, v[2]->texcoord[k] * s[2].w);
+	t.draw = draw;
+
+	std::uint32_t const index = state.triangles.size();
+	state.triangles.push_back(t);
+
+	for (int ty = t.y0 / tile_size; ty <= t.y1 / tile_size; ++ty)
+		for (int tx = t.x0 / tile_size; tx <= t.x1 / tile_size; ++tx)
+			state.tiles[ty * tiles_x + tx].push_back(index);
+}
+
+void software_rasterizer::rasterize_tile(int tile, thread_state & state)
+{
+	int const tile_x0 = (tile % tiles_x) * tile_size;
+	int const tile_y0 = (tile / tiles_x) * tile_size;
+	int const tile_x1 = std::min(target_width, tile_x0 + tile_size) - 1;
+	int const tile_y1 = std::min(target_height, tile_y0 + tile_size) - 1;
+
+	glm::vec4 const clear = glm::clamp(clear_color, 0.f, 1.f) * 255.f + 0.5f;
+	for (int y = tile_y0; y <= tile_y1; ++y)
+	{
+		std::fill(depth_buffer.begin() + std::size_t(y) * target_width + tile_x0, depth_buffer.begin() + std::size_t(y) * target_width + tile_x1 + 1, 1.f);
+		for (int x = tile_x0; x <= tile_x1; ++x)
+		{
+			std::uint8_t * p = color_buffer.data() + (std::size_t(y) * target_width + x) * 4;
+			for (int c = 0; c < 4; ++c)
+				p[c] = static_cast<std::uint8_t>(clear[c]);
+		}
+	}
+
+	// Bins of all threads, in submission order
+	for (auto const & owner : threads)
+	{
+		for (std::uint32_t index : owner.tiles[tile])
+		{
+			triangle const & t = owner.triangles[index];
+			draw_call const & call = draws[t.draw];
+
+			int const x0 = std::max(t.x0, tile_x0), x1 = std::min(t.x1, tile_x1);
+			int const y0 = std::max(t.y0, tile_y0), y1 = std::min(t.y1, tile_y1);
+
+			for (int y = y0; y <= y1; ++y)
+			{
+				float const py = y - t.y0 + 0.5f;
+				float const r0 = t.edge[0].y * py + t.edge[0].z;
+				float const r1 = t.edge[1].y * py + t.edge[1].z;
+				float const r2 = t.edge[2].y * py + t.edge[2].z;
+				float const rz = t.depth.y * py + t.depth.z;
+
+				float * __restrict depth_row = depth_buffer.data() + std::size_t(y) * target_width;
+				std::uint8_t * color_row = color_buffer.data() + std::size_t(y) * target_width * 4;
+
+				for (int x = x0; x <= x1; x += 8)
+				{
+					// Branchless over a fixed block, so that the compiler vectorizes it
+					float z[8];
+					bool covered[8];
+					for (int k = 0; k < 8; ++k)
+					{
+						float const px = x + k - t.x0 + 0.5f;
+						int const xi = std::min(x + k, x1);
+						z[k] = t.depth.x * px + rz;
+						float const e0 = t.edge[0].x * px + r0, e1 = t.edge[1].x * px + r1, e2 = t.edge[2].x * px + r2;
+						// Top-left fill rule: pixels on an edge shared by two triangles are drawn once
+						covered[k] = ((e0 > 0.f) | ((e0 == 0.f) & t.top_left[0])) & ((e1 > 0.f) | ((e1 == 0.f) & t.top_left[1]))
+							& ((e2 > 0.f) | ((e2 == 0.f) & t.top_left[2])) & (x + k <= x1) & (z[k] < depth_row[xi]);
+					}
+
+					for (int k = 0; k < 8; ++k)
+					{
+						if (!covered[k])
+							continue;
+
+						float const px = x + k - t.x0 + 0.5f;
+						float const w = 1.f / (t.inverse_w.x * px + t.inverse_w.y * py + t.inverse_w.z);
+						auto const attribute = [&](int i) { return (t.attribute[i].x * px + t.attribute[i].y * py + t.attribute[i].z) * w; };
+
+						glm::vec3 const normal{attribute(0), attribute(1), attribute(2)};
+						glm::vec3 const albedo = call.texture ? call.texture->sample({attribute(3), attribute(4)}) : glm::vec3(call.color);
+
+						float const diffuse = std::max(0.f, glm::dot(glm::normalize(normal), light_direction));
+						glm::vec3 const shaded = glm::clamp(albedo * (0.4f + diffuse), 0.f, 1.f) * 255.f + 0.5f;
+
+						std::uint8_t * p = color_row + std::size_t(x + k) * 4;
+						p[0] = static_cast<std::uint8_t>(shaded.r);
+						p[1] = static_cast<std::uint8_t>(shaded.g);
+						p[2] = static_cast<std::uint8_t>(shaded.b);
+						p[3] = 255;
+						depth_row[x + k] = z[k];
+						++state.fragments;
+					}
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include "worker_pool.hpp"
+#include "gltf_loader.hpp"
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <vector>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+
+// Vertex attribute stream, as glVertexAttribPointer describes it: floats at data + i * stride
+struct raster_attribute
+{
+	char const * data = nullptr;
+	std::size_t stride = 0;
+
+	template <typename T>
+	T get(std::size_t i) const
+	{
+		T result;
+		std::memcpy(&result, data + i * stride, sizeof(T));
+		return result;
+	}
+};
+
+// Indexed triangle list over memory owned elsewhere
+struct raster_mesh
+{
+	raster_attribute position;
+	raster_attribute normal;
+	// Optional, untextured if data is null
+	raster_attribute texcoord;
+	std::size_t vertex_count = 0;
+
+	void const * indices = nullptr;
+	// 2 or 4 bytes
+	std::size_t index_size = 4;
+	std::size_t index_count = 0;
+};
+
+// Throws if the mesh has attributes other than floats or indices other than 16 or 32-bit
+raster_mesh make_raster_mesh(gltf_model const & model, gltf_model::mesh const & mesh);
+
+// For obj_data of the other practices: interleaved vertices with position, normal and texcoord arrays
+template <typename ObjData>
+raster_mesh make_raster_mesh(ObjData const & obj)
+{
+	using vertex = typename ObjData::vertex;
+
+	raster_mesh result;
+	char const * vertices = reinterpret_cast<char const *>(obj.vertices.data());
+	result.position = {vertices + offsetof(vertex, position), sizeof(vertex)};
+	result.normal = {vertices + offsetof(vertex, normal), sizeof(vertex)};
+	result.texcoord = {vertices + offsetof(vertex, texcoord), sizeof(vertex)};
+	result.vertex_count = obj.vertices.size();
+	result.indices = obj.indices.data();
+	result.index_size = sizeof(obj.indices[0]);
+	result.index_count = obj.indices.size();
+	return result;
+}
+
+// RGBA8 texture, sampled bilinearly with repeat and without mipmaps
+struct raster_texture
+{
+	int width = 0;
+	int height = 0;
+	std::vector<std::uint8_t> pixels;
+
+	glm::vec3 sample(glm::vec2 const & texcoord) const;
+};
+
+// Reference renderer for machines without a GPU. Triangles are transformed,
+// clipped against the near plane and binned into square tiles; tiles are
+// then rasterized in parallel with edge functions evaluated over blocks of
+// eight pixels, a depth test and perspective-correct attributes. Shading
+// matches the practice's fragment shader: albedo * (0.4 + diffuse).
+//
+// Triangles are binned in submission order, so the image does not depend on
+// the number of threads.
+struct software_rasterizer
+{
+	static constexpr int tile_size = 64;
+
+	software_rasterizer(int width, int height);
+
+	void begin(glm::mat4 const & view_projection, glm::vec3 const & light_direction, glm::vec4 const & clear_color);
+
+	// Queues instance_count copies of the mesh, translated by the instance
+	// positions like the instanced GL draw; untextured meshes use color.
+	// Everything referenced must stay alive until finish().
+	void draw(raster_mesh const & mesh, raster_texture const * texture, glm::vec4 const & color, glm::mat4 const & model,
+		glm::vec3 const * instance_positions = nullptr, std::size_t instance_count = 1);
+
+	void finish(worker_pool & pool);
+
+	int width() const { return target_width; }
+	int height() const { return target_height; }
+
+	// RGBA8 and depth in [0, 1], rows from bottom to top
+	std::vector<std::uint8_t> const & color() const { return color_buffer; }
+	std::vector<float> const & depth() const { return depth_buffer; }
+
+	struct statistics
+	{
+		// After clipping and dropping triangles outside of the screen
+		std::size_t triangles = 0;
+		std::size_t tile_entries = 0;
+		std::size_t fragments = 0;
+	};
+
+	statistics stats;
+
+private:
+	struct draw_call
+	{
+		raster_mesh const * mesh;
+		raster_texture const * texture;
+		glm::vec4 color;
+		glm::mat4 model;
+		glm::vec3 const * instances;
+		std::size_t instance_count;
+	};
+
+	struct clip_vertex
+	{
+		glm::vec4 position;
+		glm::vec3 normal;
+		glm::vec2 texcoord;
+	};
+
+	// Screen-space planes f(x, y) = A * (x - x0) + B * (y - y0) + C, as (A, B, C)
+	struct triangle
+	{
+		glm::vec3 edge[3];
+		// Pixel centers exactly on an edge belong to the triangle only if it is a top or left edge
+		bool top_left[3];
+		glm::vec3 depth;
+		glm::vec3 inverse_w;
+		// normal / w and texcoord / w
+		glm::vec3 attribute[5];
+		int x0, y0, x1, y1;
+		std::uint32_t draw;
+	};
+
+	struct thread_state
+	{
+		std::vector<clip_vertex> vertices;
+		std::vector<triangle> triangles;
+		// Per tile, indices into triangles
+		std::vector<std::vector<std::uint32_t>> tiles;
+		std::size_t fragments = 0;
+	};
+
+	void process_draws(thread_state & state, std::size_t item_begin, std::size_t item_end);
+	void setup(thread_state & state, clip_vertex const & a, clip_vertex const & b, clip_vertex const & c, std::uint32_t draw);
+	void rasterize_tile(int tile, thread_state & state);
+
+	int const target_width;
+	int const target_height;
+	int const tiles_x;
+	int const tiles_y;
+
+	glm::mat4 view_projection;
+	glm::vec3 light_direction;
+	glm::vec4 clear_color;
+
+	std::vector<draw_call> draws;
+	std::vector<thread_state> threads;
+
+	std::vector<std::uint8_t> color_buffer;
+	std::vector<float> depth_buffer;
+};
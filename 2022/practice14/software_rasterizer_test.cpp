@@ -0,0 +1,140 @@
+#include "software_rasterizer.hpp"
+#include "png_writer.hpp"
+#include "check.hpp"
+
+#include "stb_image.h"
+
+#include <glm/mat4x4.hpp>
+
+#include <iostream>
+#include <random>
+#include <filesystem>
+#include <algorithm>
+
+// Checks that write_png round-trips through the stb_image decoder, and that
+// the top-left fill rule draws every pixel center of a mesh without cracks
+// exactly once, including centers on shared edges and vertices.
+namespace
+{
+
+	void test_png_round_trip()
+	{
+		// Odd width, noise that deflate can't match and runs that it can
+		int const width = 37, height = 23;
+		std::vector<std::uint8_t> rgba(std::size_t(width) * height * 4);
+		std::default_random_engine rng(3);
+		std::uniform_int_distribution<int> byte(0, 255);
+		for (int y = 0; y < height; ++y)
+			for (int x = 0; x < width; ++x)
+			{
+				std::uint8_t * p = rgba.data() + (std::size_t(y) * width + x) * 4;
+				bool const noise = (y % 3 == 0);
+				p[0] = noise ? byte(rng) : x * 7;
+				p[1] = noise ? byte(rng) : y * 11;
+				p[2] = noise ? byte(rng) : 128;
+				p[3] = noise ? byte(rng) : 255 - x;
+			}
+
+		std::string const path = (std::filesystem::temp_directory_path() / "practice14_png_round_trip.png").string();
+		write_png(path, width, height, rgba.data());
+
+		int loaded_width, loaded_height, channels;
+		std::uint8_t * loaded = stbi_load(path.c_str(), &loaded_width, &loaded_height, &channels, 4);
+		std::filesystem::remove(path);
+		CHECK(loaded);
+
+		bool const same_size = loaded_width == width && loaded_height == height && channels == 4;
+		bool same_pixels = same_size;
+
+		// The file is top to bottom, the image bottom to top
+		for (int y = 0; same_pixels && y < height; ++y)
+			same_pixels = std::equal(loaded + std::size_t(height - 1 - y) * width * 4, loaded + std::size_t(height - y) * width * 4,
+				rgba.begin() + std::size_t(y) * width * 4);
+		stbi_image_free(loaded);
+
+		CHECK(same_size);
+		CHECK(same_pixels);
+	}
+
+	void test_fill_rule()
+	{
+		// Powers of two, so that vertices at pixel centers land on them exactly
+		int const width = 128, height = 64;
+		int const cell = 4;
+
+		// A grid of cells with corners at pixel centers, reaching past the screen
+		// and over two tiles; cells are split along alternating diagonals and
+		// triangles alternate their winding
+		std::vector<glm::vec3> positions;
+		for (int j = -1; j * cell < height + cell; ++j)
+			for (int i = -1; i * cell < width + cell; ++i)
+				positions.push_back({(i * cell + 0.5f) / width * 2.f - 1.f, (j * cell + 0.5f) / height * 2.f - 1.f, 0.f});
+		int const columns = (width + cell - 1) / cell + 2;
+		int const rows = positions.size() / columns;
+
+		std::vector<std::uint32_t> indices;
+		for (int j = 0; j + 1 < rows; ++j)
+			for (int i = 0; i + 1 < columns; ++i)
+			{
+				std::uint32_t const v00 = j * columns + i, v10 = v00 + 1, v01 = v00 + columns, v11 = v01 + 1;
+				std::uint32_t quad[2][3] = {{v00, v10, v11}, {v00, v11, v01}};
+				if ((i + j) % 2 == 1)
+				{
+					quad[0][2] = v01;
+					quad[1][0] = v10;
+				}
+				if (i % 3 == 0)
+					std::swap(quad[0][1], quad[0][2]);
+				if (j % 3 == 0)
+					std::swap(quad[1][0], quad[1][1]);
+				indices.insert(indices.end(), &quad[0][0], &quad[0][0] + 6);
+			}
+
+		// One draw per triangle, each nearer than the previous one, so that a
+		// pixel drawn twice counts as two fragments
+		std::size_t const triangle_count = indices.size() / 3;
+		std::vector<glm::vec3> normals(positions.size(), glm::vec3(0.f, 0.f, 1.f));
+		std::vector<raster_mesh> meshes(triangle_count);
+		std::vector<glm::mat4> models(triangle_count, glm::mat4(1.f));
+		for (std::size_t k = 0; k < triangle_count; ++k)
+		{
+			raster_mesh & mesh = meshes[k];
+			mesh.position = {reinterpret_cast<char const *>(positions.data()), sizeof(glm::vec3)};
+			mesh.normal = {reinterpret_cast<char const *>(normals.data()), sizeof(glm::vec3)};
+			mesh.vertex_count = positions.size();
+			mesh.indices = indices.data() + 3 * k;
+			mesh.index_count = 3;
+			models[k][3].z = 0.9f - 1.8f * k / triangle_count;
+		}
+
+		for (std::size_t threads : {1, 3})
+		{
+			worker_pool pool(threads);
+			software_rasterizer rasterizer(width, height);
+			rasterizer.begin(glm::mat4(1.f), glm::vec3(0.f, 0.f, 1.f), glm::vec4(0.f));
+			for (std::size_t k = 0; k < triangle_count; ++k)
+				rasterizer.draw(meshes[k], nullptr, glm::vec4(1.f), models[k]);
+			rasterizer.finish(pool);
+
+			CHECK(rasterizer.stats.fragments == std::size_t(width) * height);
+
+			// No pixel is left with the clear color
+			auto const & color = rasterizer.color();
+			for (std::size_t i = 0; i < color.size(); i += 4)
+				CHECK(color[i + 3] == 255);
+		}
+	}
+
+}
+
+int main() try
+{
+	test_png_round_trip();
+	test_fill_rule();
+	std::cout << "software_rasterizer: all checks passed" << std::endl;
+}
+catch (std::exception const & e)
+{
+	std::cerr << e.what() << std::endl;
+	return EXIT_FAILURE;
+}
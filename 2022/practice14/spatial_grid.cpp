@@ -0,0 +1,97 @@
+#include "spatial_grid.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <bit>
+
+spatial_grid::spatial_grid(float cell_size, std::uint32_t capacity, std::uint32_t bucket_count)
+	: cell_size(cell_size)
+	, bucket_mask(std::bit_ceil(std::max<std::uint32_t>(bucket_count, 1)) - 1)
+	, oversized(bucket_mask + 1)
+	, objects(capacity)
+	, heads(std::size_t(bucket_mask) + 2, invalid)
+{
+	// Chain all slots into the free list
+	for (std::uint32_t i = 0; i < capacity; ++i)
+	{
+		objects[i].next = (i + 1 < capacity) ? i + 1 : invalid;
+		objects[i].bucket = invalid;
+	}
+	free_head = (capacity > 0) ? 0 : invalid;
+}
+
+std::uint32_t spatial_grid::insert(glm::vec3 const & min, glm::vec3 const & max)
+{
+	if (free_head == invalid)
+		throw std::runtime_error("Spatial grid is full");
+
+	std::uint32_t const handle = free_head;
+	free_head = objects[handle].next;
+
+	objects[handle].min = min;
+	objects[handle].max = max;
+	link(handle);
+
+	++count;
+	return handle;
+}
+
+void spatial_grid::remove(std::uint32_t handle)
+{
+	unlink(handle);
+	objects[handle].bucket = invalid;
+	objects[handle].next = free_head;
+	free_head = handle;
+
+	--count;
+}
+
+void spatial_grid::move(std::uint32_t handle, glm::vec3 const & min, glm::vec3 const & max)
+{
+	object & o = objects[handle];
+	o.min = min;
+	o.max = max;
+
+	bool const large = glm::any(glm::greaterThan(max - min, glm::vec3(cell_size)));
+	glm::ivec3 const cell = cell_of((min + max) / 2.f);
+
+	// Most moves stay within the cell
+	if (large ? (o.bucket == oversized) : (o.bucket != oversized && o.cell == cell))
+		return;
+
+	unlink(handle);
+	link(handle);
+}
+
+void spatial_grid::link(std::uint32_t handle)
+{
+	object & o = objects[handle];
+
+	o.cell = cell_of((o.min + o.max) / 2.f);
+	o.bucket = glm::any(glm::greaterThan(o.max - o.min, glm::vec3(cell_size))) ? oversized : bucket_of(o.cell);
+
+	if (o.bucket != oversized)
+	{
+		occupied_min = glm::min(occupied_min, o.cell);
+		occupied_max = glm::max(occupied_max, o.cell);
+	}
+
+	o.prev = invalid;
+	o.next = heads[o.bucket];
+	if (o.next != invalid)
+		objects[o.next].prev = handle;
+	heads[o.bucket] = handle;
+}
+
+void spatial_grid::unlink(std::uint32_t handle)
+{
+	object & o = objects[handle];
+
+	if (o.prev != invalid)
+		objects[o.prev].next = o.next;
+	else
+		heads[o.bucket] = o.next;
+
+	if (o.next != invalid)
+		objects[o.next].prev = o.prev;
+}
@@ -0,0 +1,302 @@
+#pragma once
+
+#include "frustum.hpp"
+
+#include <glm/vec3.hpp>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/vector_relational.hpp>
+
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <cmath>
+
+// Loose hashed uniform grid for dynamic objects. An object belongs to the
+// cell containing the center of its box; since objects are at most one cell
+// large, the objects of a cell lie within the cell grown by half a cell on
+// every side. Larger objects are kept in a separate list that every query
+// tests.
+//
+// Cells are hashed into a fixed number of buckets, every bucket holds an
+// intrusive doubly linked list of its objects, so insertion, removal and
+// moving are O(1). All memory is allocated at construction and handles stay
+// valid until the object is removed.
+struct spatial_grid
+{
+	static constexpr std::uint32_t invalid = std::numeric_limits<std::uint32_t>::max();
+
+	// bucket_count is rounded up to a power of two
+	spatial_grid(float cell_size, std::uint32_t capacity, std::uint32_t bucket_count);
+
+	// Throws if the grid is full
+	std::uint32_t insert(glm::vec3 const & min, glm::vec3 const & max);
+	void remove(std::uint32_t handle);
+	void move(std::uint32_t handle, glm::vec3 const & min, glm::vec3 const & max);
+
+	std::size_t size() const { return count; }
+	std::size_t capacity() const { return objects.size(); }
+
+	glm::vec3 const & min(std::uint32_t handle) const { return objects[handle].min; }
+	glm::vec3 const & max(std::uint32_t handle) const { return objects[handle].max; }
+
+	// Queries call visitor(handle) once for every object intersecting the shape
+	template <typename Visitor>
+	void query_box(glm::vec3 const & min, glm::vec3 const & max, Visitor && visitor) const;
+
+	template <typename Visitor>
+	void query_sphere(glm::vec3 const & center, float radius, Visitor && visitor) const;
+
+	// Conservative: objects are tested against the frustum planes only
+	template <typename Visitor>
+	void query_frustum(frustum const & f, Visitor && visitor) const;
+
+	// Calls visitor(handle, t) for every object hit by the ray within [0, t_max],
+	// t is the distance to the hit point in units of direction; t_max must be finite
+	template <typename Visitor>
+	void query_ray(glm::vec3 const & origin, glm::vec3 const & direction, float t_max, Visitor && visitor) const;
+
+private:
+	struct object
+	{
+		glm::vec3 min;
+		std::uint32_t next;
+		glm::vec3 max;
+		std::uint32_t prev;
+		glm::ivec3 cell;
+		// Bucket index, oversized for large objects, invalid for free slots
+		std::uint32_t bucket;
+	};
+
+	// Queries touching more than capacity / cell_scan_ratio cells scan all objects instead
+	static constexpr std::int64_t cell_scan_ratio = 16;
+
+	float const cell_size;
+	std::uint32_t const bucket_mask;
+	// Index of the list of objects larger than a cell
+	std::uint32_t const oversized;
+
+	std::vector<object> objects;
+	// Heads of bucket lists, followed by the oversized list
+	std::vector<std::uint32_t> heads;
+
+	std::uint32_t free_head = invalid;
+	std::size_t count = 0;
+
+	// Range of cells that ever held an object; only grows, so removal stays O(1)
+	glm::ivec3 occupied_min{std::numeric_limits<int>::max()};
+	glm::ivec3 occupied_max{std::numeric_limits<int>::min()};
+
+	glm::ivec3 cell_of(glm::vec3 const & p) const
+	{
+		return glm::ivec3(glm::floor(p / cell_size));
+	}
+
+	std::uint32_t bucket_of(glm::ivec3 const & cell) const
+	{
+		return (std::uint32_t(cell.x) * 73856093u ^ std::uint32_t(cell.y) * 19349663u ^ std::uint32_t(cell.z) * 83492791u) & bucket_mask;
+	}
+
+	void link(std::uint32_t handle);
+	void unlink(std::uint32_t handle);
+
+	// Visits objects of cells in [cell_min, cell_max] accepted by cell_test,
+	// then oversized objects; object_test filters objects of both kinds
+	template <typename CellTest, typename ObjectTest, typename Visitor>
+	void visit_cells(glm::ivec3 const & cell_min, glm::ivec3 const & cell_max,
+		CellTest const & cell_test, ObjectTest const & object_test, Visitor && visitor) const;
+
+	template <typename ObjectTest, typename Visitor>
+	void visit_list(std::uint32_t head, glm::ivec3 const * cell, ObjectTest const & object_test, Visitor && visitor) const
+	{
+		for (std::uint32_t i = head; i != invalid; i = objects[i].next)
+		{
+			object const & o = objects[i];
+			if ((!cell || o.cell == *cell) && object_test(o))
+				visitor(i);
+		}
+	}
+
+	static bool ray_box(glm::vec3 const & origin, glm::vec3 const & inverse_direction, float t_max,
+		glm::vec3 const & min, glm::vec3 const & max, float & t)
+	{
+		glm::vec3 const t0 = (min - origin) * inverse_direction;
+		glm::vec3 const t1 = (max - origin) * inverse_direction;
+		glm::vec3 const near = glm::min(t0, t1);
+		glm::vec3 const far = glm::max(t0, t1);
+
+		float const enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.f));
+		float const exit = std::min(std::min(far.x, far.y), std::min(far.z, t_max));
+
+		t = enter;
+		return enter <= exit;
+	}
+};
+
+template <typename CellTest, typename ObjectTest, typename Visitor>
+void spatial_grid::visit_cells(glm::ivec3 const & query_min, glm::ivec3 const & query_max,
+	CellTest const & cell_test, ObjectTest const & object_test, Visitor && visitor) const
+{
+	glm::ivec3 const cell_min = glm::max(query_min, occupied_min);
+	glm::ivec3 const cell_max = glm::min(query_max, occupied_max);
+
+	std::int64_t const extent_x = std::int64_t(cell_max.x) - cell_min.x + 1;
+	std::int64_t const extent_y = std::int64_t(cell_max.y) - cell_min.y + 1;
+	std::int64_t const extent_z = std::int64_t(cell_max.z) - cell_min.z + 1;
+
+	if (extent_x > 0 && extent_y > 0 && extent_z > 0)
+	{
+		// Every cell costs a couple of cache misses, while a sequential scan
+		// costs a few nanoseconds per object
+		if (extent_x * extent_y * extent_z * cell_scan_ratio <= std::int64_t(objects.size()))
+		{
+			for (int z = cell_min.z; z <= cell_max.z; ++z)
+				for (int y = cell_min.y; y <= cell_max.y; ++y)
+					for (int x = cell_min.x; x <= cell_max.x; ++x)
+					{
+						glm::ivec3 const cell{x, y, z};
+						if (cell_test(cell))
+							visit_list(heads[bucket_of(cell)], &cell, object_test, visitor);
+					}
+		}
+		else
+		{
+			for (std::uint32_t i = 0; i < objects.size(); ++i)
+			{
+				object const & o = objects[i];
+				if (o.bucket < oversized
+					&& glm::all(glm::greaterThanEqual(o.cell, cell_min)) && glm::all(glm::lessThanEqual(o.cell, cell_max))
+					&& object_test(o))
+					visitor(i);
+			}
+		}
+	}
+
+	visit_list(heads[oversized], nullptr, object_test, visitor);
+}
+
+template <typename Visitor>
+void spatial_grid::query_box(glm::vec3 const & min, glm::vec3 const & max, Visitor && visitor) const
+{
+	visit_cells(cell_of(min - cell_size / 2.f), cell_of(max + cell_size / 2.f),
+		[](glm::ivec3 const &){ return true; },
+		[&](object const & o){ return glm::all(glm::lessThanEqual(o.min, max)) && glm::all(glm::lessThanEqual(min, o.max)); },
+		visitor);
+}
+
+template <typename Visitor>
+void spatial_grid::query_sphere(glm::vec3 const & center, float radius, Visitor && visitor) const
+{
+	visit_cells(cell_of(center - radius - cell_size / 2.f), cell_of(center + radius + cell_size / 2.f),
+		[](glm::ivec3 const &){ return true; },
+		[&](object const & o)
+		{
+			glm::vec3 const d = center - glm::clamp(center, o.min, o.max);
+			return glm::dot(d, d) <= radius * radius;
+		},
+		visitor);
+}
+
+template <typename Visitor>
+void spatial_grid::query_frustum(frustum const & f, Visitor && visitor) const
+{
+	auto const outside = [&](glm::vec3 const & min, glm::vec3 const & max)
+	{
+		glm::vec3 const c = (min + max) / 2.f;
+		glm::vec3 const e = (max - min) / 2.f;
+		for (auto const & p : f.planes)
+			if (p.x * c.x + p.y * c.y + p.z * c.z + p.w < -(std::abs(p.x) * e.x + std::abs(p.y) * e.y + std::abs(p.z) * e.z))
+				return true;
+		return false;
+	};
+
+	glm::vec3 min = f.vertices[0], max = f.vertices[0];
+	for (auto const & v : f.vertices)
+	{
+		min = glm::min(min, v);
+		max = glm::max(max, v);
+	}
+
+	visit_cells(cell_of(min - cell_size / 2.f), cell_of(max + cell_size / 2.f),
+		[&](glm::ivec3 const & cell)
+		{
+			glm::vec3 const cell_min = (glm::vec3(cell) - 0.5f) * cell_size;
+			return !outside(cell_min, cell_min + 2.f * cell_size);
+		},
+		[&](object const & o){ return !outside(o.min, o.max); },
+		visitor);
+}
+
+template <typename Visitor>
+void spatial_grid::query_ray(glm::vec3 const & origin, glm::vec3 const & direction, float t_max, Visitor && visitor) const
+{
+	glm::vec3 const inverse_direction = 1.f / direction;
+
+	auto const hit = [&](object const & o)
+	{
+		float t;
+		return ray_box(origin, inverse_direction, t_max, o.min, o.max, t);
+	};
+
+	auto const visit = [&](std::uint32_t handle)
+	{
+		float t;
+		ray_box(origin, inverse_direction, t_max, objects[handle].min, objects[handle].max, t);
+		visitor(handle, t);
+	};
+
+	// Walks the cells pierced by the ray (Amanatides & Woo). Objects of a
+	// pierced cell may stick out into its neighbours, so the 3x3x3 block
+	// around every pierced cell is visited; consecutive blocks differ by the
+	// 3x3 slab on the side of the step, which is all that is visited after the
+	// first block. Since the walk is monotonic, no cell is visited twice.
+	glm::ivec3 cell = cell_of(origin);
+	glm::ivec3 const step{direction.x < 0.f ? -1 : 1, direction.y < 0.f ? -1 : 1, direction.z < 0.f ? -1 : 1};
+
+	glm::vec3 t_next, t_delta;
+	for (int a = 0; a < 3; ++a)
+	{
+		if (direction[a] == 0.f)
+		{
+			t_next[a] = std::numeric_limits<float>::infinity();
+			t_delta[a] = std::numeric_limits<float>::infinity();
+			continue;
+		}
+		float const boundary = (cell[a] + (step[a] > 0 ? 1 : 0)) * cell_size;
+		t_next[a] = (boundary - origin[a]) * inverse_direction[a];
+		t_delta[a] = cell_size * std::abs(inverse_direction[a]);
+	}
+
+	auto const visit_block = [&](glm::ivec3 const & min, glm::ivec3 const & max)
+	{
+		for (int z = min.z; z <= max.z; ++z)
+			for (int y = min.y; y <= max.y; ++y)
+				for (int x = min.x; x <= max.x; ++x)
+				{
+					glm::ivec3 const c{x, y, z};
+					visit_list(heads[bucket_of(c)], &c, hit, visit);
+				}
+	};
+
+	visit_block(cell - 1, cell + 1);
+
+	float t = 0.f;
+	while (true)
+	{
+		int const a = (t_next.x < t_next.y) ? (t_next.x < t_next.z ? 0 : 2) : (t_next.y < t_next.z ? 1 : 2);
+
+		// Objects reach at most half a cell out of their cell, whose block was already visited
+		t = t_next[a];
+		if (t > t_max)
+			break;
+
+		cell[a] += step[a];
+		t_next[a] += t_delta[a];
+
+		glm::ivec3 slab_min = cell - 1, slab_max = cell + 1;
+		slab_min[a] = slab_max[a] = cell[a] + step[a];
+		visit_block(slab_min, slab_max);
+	}
+
+	visit_list(heads[oversized], nullptr, hit, visit);
+}
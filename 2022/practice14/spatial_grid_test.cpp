@@ -0,0 +1,232 @@
+#include "spatial_grid.hpp"
+#include "intersect.hpp"
+#include "check.hpp"
+
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+
+#include <iostream>
+#include <random>
+#include <algorithm>
+#include <vector>
+
+// Checks every query of the grid against a brute-force scan of the live
+// objects, while objects are inserted, moved across cells and removed.
+// Frustum queries are only bounded, between the separating axis test and the
+// plane test.
+namespace
+{
+
+	struct box
+	{
+		glm::vec3 min;
+		glm::vec3 max;
+		bool live = false;
+	};
+
+	bool frustum_outside(frustum const & f, glm::vec3 const & min, glm::vec3 const & max)
+	{
+		glm::vec3 const c = (min + max) / 2.f;
+		glm::vec3 const e = (max - min) / 2.f;
+		for (auto const & p : f.planes)
+			if (p.x * c.x + p.y * c.y + p.z * c.z + p.w < -(std::abs(p.x) * e.x + std::abs(p.y) * e.y + std::abs(p.z) * e.z))
+				return true;
+		return false;
+	}
+
+	// Slab test, the reference for query_ray; returns the entry distance or a negative value
+	float ray_box(glm::vec3 const & origin, glm::vec3 const & direction, float t_max, glm::vec3 const & min, glm::vec3 const & max)
+	{
+		float enter = 0.f, exit = t_max;
+		for (int a = 0; a < 3; ++a)
+		{
+			if (direction[a] == 0.f)
+			{
+				if (origin[a] < min[a] || origin[a] > max[a])
+					return -1.f;
+				continue;
+			}
+			float const t0 = (min[a] - origin[a]) / direction[a];
+			float const t1 = (max[a] - origin[a]) / direction[a];
+			enter = std::max(enter, std::min(t0, t1));
+			exit = std::min(exit, std::max(t0, t1));
+		}
+		return enter <= exit ? enter : -1.f;
+	}
+
+	template <typename Query>
+	std::vector<std::uint32_t> collect(Query const & query)
+	{
+		std::vector<std::uint32_t> result;
+		query([&](std::uint32_t handle){ result.push_back(handle); });
+		std::sort(result.begin(), result.end());
+		return result;
+	}
+
+	template <typename Predicate>
+	std::vector<std::uint32_t> brute_force(std::vector<box> const & boxes, Predicate const & predicate)
+	{
+		std::vector<std::uint32_t> result;
+		for (std::uint32_t i = 0; i < boxes.size(); ++i)
+			if (boxes[i].live && predicate(boxes[i]))
+				result.push_back(i);
+		return result;
+	}
+
+}
+
+int main() try
+{
+	float const cell_size = 2.f;
+	std::uint32_t const capacity = 2000;
+
+	// Few buckets, so that distinct cells share bucket lists
+	spatial_grid grid(cell_size, capacity, 64);
+	std::vector<box> boxes(capacity);
+
+	std::default_random_engine rng(42);
+	std::uniform_real_distribution<float> position(-40.f, 40.f);
+	std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+	// Mostly objects up to a cell large, some larger ones for the oversized list
+	auto const random_box = [&]
+	{
+		glm::vec3 const center{position(rng), position(rng) / 4.f, position(rng)};
+		glm::vec3 const half_size = glm::vec3(unit(rng), unit(rng), unit(rng)) * (unit(rng) < 0.05f ? 4.f * cell_size : cell_size / 2.f);
+		return box{center - half_size, center + half_size, true};
+	};
+
+	auto const insert = [&]
+	{
+		box const b = random_box();
+		std::uint32_t const handle = grid.insert(b.min, b.max);
+		CHECK(handle < capacity && !boxes[handle].live);
+		boxes[handle] = b;
+	};
+
+	for (std::uint32_t i = 0; i < capacity / 2; ++i)
+		insert();
+
+	std::size_t checked_hits = 0;
+
+	for (int round = 0; round < 50; ++round)
+	{
+		// Moves, most of them small, some across the whole area; removals and insertions
+		for (std::uint32_t i = 0; i < capacity; ++i)
+		{
+			if (!boxes[i].live)
+				continue;
+
+			float const r = unit(rng);
+			if (r < 0.05f)
+			{
+				grid.remove(i);
+				boxes[i].live = false;
+			}
+			else if (r < 0.15f)
+			{
+				boxes[i] = random_box();
+				grid.move(i, boxes[i].min, boxes[i].max);
+			}
+			else
+			{
+				glm::vec3 const delta{unit(rng) - 0.5f, 0.f, unit(rng) - 0.5f};
+				boxes[i].min += delta;
+				boxes[i].max += delta;
+				grid.move(i, boxes[i].min, boxes[i].max);
+			}
+		}
+		while (grid.size() < capacity * 3 / 4)
+			insert();
+
+		CHECK(grid.size() == brute_force(boxes, [](box const &){ return true; }).size());
+
+		for (int query = 0; query < 20; ++query)
+		{
+			glm::vec3 const center{position(rng), position(rng) / 4.f, position(rng)};
+
+			// Small boxes go through the cells, large ones through the scan of all objects
+			glm::vec3 const half_size = glm::vec3(unit(rng), unit(rng), unit(rng)) * (query % 2 ? 3.f : 60.f);
+			glm::vec3 const min = center - half_size, max = center + half_size;
+			auto const expected_box = brute_force(boxes, [&](box const & b){
+				return glm::all(glm::lessThanEqual(b.min, max)) && glm::all(glm::lessThanEqual(min, b.max));
+			});
+			CHECK(collect([&](auto && visitor){ grid.query_box(min, max, visitor); }) == expected_box);
+
+			float const radius = unit(rng) * (query % 2 ? 3.f : 60.f);
+			auto const expected_sphere = brute_force(boxes, [&](box const & b){
+				glm::vec3 const d = center - glm::clamp(center, b.min, b.max);
+				return glm::dot(d, d) <= radius * radius;
+			});
+			CHECK(collect([&](auto && visitor){ grid.query_sphere(center, radius, visitor); }) == expected_sphere);
+
+			glm::vec3 const target{position(rng), 0.f, position(rng)};
+			frustum const f(glm::perspective(glm::radians(30.f + 60.f * unit(rng)), 16.f / 9.f, 0.1f, 5.f + 50.f * unit(rng))
+				* glm::lookAt(center, target, {0.f, 1.f, 0.f}));
+			// The query may drop boxes that only pass the plane test, but never one that intersects the
+			// frustum; boxes touching it are shrunk a little, since the two tests round differently
+			auto const found_frustum = collect([&](auto && visitor){ grid.query_frustum(f, visitor); });
+			auto const plane_frustum = brute_force(boxes, [&](box const & b){ return !frustum_outside(f, b.min, b.max); });
+			auto const expected_frustum = brute_force(boxes, [&](box const & b){
+				glm::vec3 const c = (b.min + b.max) / 2.f;
+				glm::vec3 const e = glm::max((b.max - b.min) / 2.f - 1e-3f, 0.f);
+				return intersect(aabb(c - e, c + e), f);
+			});
+			CHECK(std::includes(plane_frustum.begin(), plane_frustum.end(), found_frustum.begin(), found_frustum.end()));
+			CHECK(std::includes(found_frustum.begin(), found_frustum.end(), expected_frustum.begin(), expected_frustum.end()));
+
+			// Rays along the axes and in the plane of the grid hit zero components of the direction
+			glm::vec3 direction = target - center;
+			if (query % 5 == 0)
+				direction = {0.f, 0.f, (query % 10 == 0) ? 1.f : -1.f};
+			else if (query % 5 == 1)
+				direction.y = 0.f;
+			direction = glm::normalize(direction);
+			float const t_max = 5.f + 80.f * unit(rng);
+
+			std::vector<std::pair<std::uint32_t, float>> hits, expected_hits;
+			grid.query_ray(center, direction, t_max, [&](std::uint32_t handle, float t){ hits.emplace_back(handle, t); });
+			for (std::uint32_t i = 0; i < capacity; ++i)
+				if (float const t = boxes[i].live ? ray_box(center, direction, t_max, boxes[i].min, boxes[i].max) : -1.f; t >= 0.f)
+					expected_hits.emplace_back(i, t);
+
+			std::sort(hits.begin(), hits.end());
+			CHECK(hits.size() == expected_hits.size());
+			for (std::size_t i = 0; i < hits.size(); ++i)
+			{
+				CHECK(hits[i].first == expected_hits[i].first);
+				CHECK(std::abs(hits[i].second - expected_hits[i].second) <= 1e-4f * (1.f + expected_hits[i].second));
+			}
+
+			checked_hits += expected_box.size() + expected_sphere.size() + expected_frustum.size() + expected_hits.size();
+		}
+	}
+
+	// Every slot is reusable once freed
+	for (std::uint32_t i = 0; i < capacity; ++i)
+		if (boxes[i].live)
+		{
+			grid.remove(i);
+			boxes[i].live = false;
+		}
+	CHECK(grid.size() == 0);
+	for (std::uint32_t i = 0; i < capacity; ++i)
+		insert();
+	bool full = false;
+	try
+	{
+		grid.insert(glm::vec3(0.f), glm::vec3(1.f));
+	}
+	catch (std::runtime_error const &)
+	{
+		full = true;
+	}
+	CHECK(full);
+
+	std::cout << "Spatial grid queries match brute force, " << checked_hits << " results checked" << std::endl;
+}
+catch (std::exception const & e)
+{
+	std::cerr << e.what() << std::endl;
+	return EXIT_FAILURE;
+}
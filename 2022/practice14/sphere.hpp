@@ -0,0 +1,9 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+struct sphere
+{
+	glm::vec3 center;
+	float radius;
+};
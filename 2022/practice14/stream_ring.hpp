@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+
+// Ring of per-frame segments in one buffer object for streaming data that is
+// rewritten every frame. Frame k writes into segment k % frame_count; before
+// a segment is reused, the fence inserted after its last use is waited on,
+// so the CPU never overwrites data the GPU may still be reading. Within a
+// frame, allocations are bumped linearly inside the segment.
+//
+// The backend performs the actual API calls and must provide
+//     void * map(std::size_t offset, std::size_t size);
+//     void unmap(std::size_t flushed_size);
+//     fence_type insert_fence();
+//     void wait_fence(fence_type fence);
+//     void delete_fence(fence_type fence);
+// with fence_type default-constructible and comparable to a default-constructed value.
+template <typename Backend>
+struct stream_ring
+{
+	using fence_type = decltype(std::declval<Backend &>().insert_fence());
+
+	struct allocation
+	{
+		// Offset from the start of the buffer object
+		std::size_t offset;
+		void * data;
+	};
+
+	stream_ring(Backend & backend, std::size_t segment_size, std::size_t frame_count = 3)
+		: backend(backend)
+		, segment_size(segment_size)
+		, fences(frame_count)
+	{}
+
+	~stream_ring()
+	{
+		for (auto & fence : fences)
+			if (fence != fence_type{})
+				backend.delete_fence(fence);
+	}
+
+	stream_ring(stream_ring const &) = delete;
+	stream_ring & operator = (stream_ring const &) = delete;
+
+	std::size_t buffer_size() const { return segment_size * fences.size(); }
+
+	// Waits until the next segment is free and maps it
+	void begin_frame()
+	{
+		auto & fence = fences[segment];
+		if (fence != fence_type{})
+		{
+			backend.wait_fence(fence);
+			backend.delete_fence(fence);
+			fence = fence_type{};
+		}
+
+		used = 0;
+		mapped = static_cast<char *>(backend.map(segment * segment_size, segment_size));
+	}
+
+	allocation allocate(std::size_t size, std::size_t alignment = 16)
+	{
+		if (!mapped)
+			throw std::logic_error("stream_ring::allocate outside of a frame");
+
+		std::size_t const offset = (used + alignment - 1) / alignment * alignment;
+		if (offset + size > segment_size)
+			throw std::runtime_error("Stream ring segment overflow");
+
+		used = offset + size;
+		return {segment * segment_size + offset, mapped + offset};
+	}
+
+	// Unmaps the segment; must be called before draws that read the allocations
+	void finish_writes()
+	{
+		backend.unmap(used);
+		mapped = nullptr;
+	}
+
+	// Fences the segment after the draws that read it and moves to the next one
+	void end_frame()
+	{
+		if (mapped)
+			finish_writes();
+
+		fences[segment] = backend.insert_fence();
+		segment = (segment + 1) % fences.size();
+	}
+
+	Backend & backend;
+	std::size_t const segment_size;
+
+	std::vector<fence_type> fences;
+	std::size_t segment = 0;
+	std::size_t used = 0;
+	char * mapped = nullptr;
+};
@@ -0,0 +1,198 @@
+#include "stream_ring.hpp"
+#include "check.hpp"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <utility>
+
+// Runs stream_ring against a backend that records the calls it receives, and
+// checks that segments rotate through the buffer, that a segment's fence is
+// waited on and deleted before the segment is mapped again, that allocations
+// are aligned, and that allocations past the end of a segment throw.
+namespace
+{
+
+	// Fences are numbered from 1, so that 0 is the default-constructed "no fence"
+	struct recording_backend
+	{
+		std::vector<char> buffer;
+		std::vector<std::string> calls;
+		int fence_count = 0;
+
+		void * map(std::size_t offset, std::size_t size)
+		{
+			CHECK(offset + size <= buffer.size());
+			record("map", offset, size);
+			return buffer.data() + offset;
+		}
+
+		void unmap(std::size_t flushed_size) { record("unmap", flushed_size); }
+
+		int insert_fence()
+		{
+			record("insert_fence", ++fence_count);
+			return fence_count;
+		}
+
+		void wait_fence(int fence) { record("wait_fence", fence); }
+		void delete_fence(int fence) { record("delete_fence", fence); }
+
+		// Returns the calls since the last take()
+		std::vector<std::string> take()
+		{
+			return std::exchange(calls, {});
+		}
+
+	private:
+		template <typename ... Arguments>
+		void record(std::string call, Arguments ... arguments)
+		{
+			((call += " " + std::to_string(arguments)), ...);
+			calls.push_back(std::move(call));
+		}
+	};
+
+	using calls = std::vector<std::string>;
+
+	template <typename Exception, typename Function>
+	bool throws(Function && function)
+	{
+		try
+		{
+			function();
+		}
+		catch (Exception const &)
+		{
+			return true;
+		}
+		return false;
+	}
+
+	void test_rotation()
+	{
+		recording_backend backend;
+		backend.buffer.resize(3 * 256);
+		stream_ring<recording_backend> ring(backend, 256);
+		CHECK(ring.buffer_size() == 3 * 256);
+
+		// The first pass over the segments has nothing to wait for
+		for (int frame = 0; frame < 3; ++frame)
+		{
+			ring.begin_frame();
+			auto const a = ring.allocate(10);
+			CHECK(a.offset == std::size_t(frame) * 256);
+			CHECK(a.data == backend.buffer.data() + frame * 256);
+			ring.end_frame();
+
+			std::string const offset = std::to_string(frame * 256);
+			std::string const fence = std::to_string(frame + 1);
+			CHECK((backend.take() == calls{"map " + offset + " 256", "unmap 10", "insert_fence " + fence}));
+		}
+
+		// Then every segment waits for the fence of the frame that used it
+		// last, deletes it, and only then is mapped again
+		for (int frame = 3; frame < 7; ++frame)
+		{
+			ring.begin_frame();
+			CHECK(ring.allocate(20).offset == std::size_t(frame % 3) * 256);
+			ring.end_frame();
+
+			std::string const offset = std::to_string(frame % 3 * 256);
+			std::string const waited = std::to_string(frame - 2);
+			std::string const fence = std::to_string(frame + 1);
+			CHECK((backend.take() == calls{"wait_fence " + waited, "delete_fence " + waited,
+				"map " + offset + " 256", "unmap 20", "insert_fence " + fence}));
+		}
+	}
+
+	void test_alignment()
+	{
+		recording_backend backend;
+		backend.buffer.resize(2 * 128);
+		stream_ring<recording_backend> ring(backend, 128, 2);
+
+		// Move to the second segment, so that offsets include its start
+		ring.begin_frame();
+		ring.end_frame();
+		backend.take();
+
+		ring.begin_frame();
+		CHECK(ring.allocate(3).offset == 128);
+		CHECK(ring.allocate(5).offset == 128 + 16);
+		CHECK(ring.allocate(1, 64).offset == 128 + 64);
+		CHECK(ring.allocate(4, 4).offset == 128 + 68);
+		CHECK(ring.allocate(1, 1).offset == 128 + 72);
+
+		auto const a = ring.allocate(8, 8);
+		CHECK(a.offset == 128 + 80);
+		CHECK(a.data == backend.buffer.data() + a.offset);
+
+		// Writes are flushed up to the end of the last allocation, and
+		// end_frame does not unmap a second time
+		ring.finish_writes();
+		ring.end_frame();
+		CHECK((backend.take() == calls{"map 128 128", "unmap 88", "insert_fence 2"}));
+
+		// The next frame starts from the beginning of its segment
+		ring.begin_frame();
+		CHECK(ring.allocate(1, 32).offset == 0);
+	}
+
+	void test_overflow()
+	{
+		recording_backend backend;
+		backend.buffer.resize(3 * 64);
+		stream_ring<recording_backend> ring(backend, 64);
+
+		CHECK(throws<std::logic_error>([&]{ ring.allocate(1); }));
+
+		ring.begin_frame();
+		CHECK(throws<std::runtime_error>([&]{ ring.allocate(65); }));
+
+		// A failed allocation takes nothing, the whole segment still fits
+		CHECK(ring.allocate(64).offset == 0);
+		CHECK(throws<std::runtime_error>([&]{ ring.allocate(1, 1); }));
+		ring.end_frame();
+
+		// Alignment padding counts towards the segment size
+		ring.begin_frame();
+		ring.allocate(40);
+		CHECK(throws<std::runtime_error>([&]{ ring.allocate(16, 32); }));
+		CHECK(ring.allocate(16, 16).offset == 64 + 48);
+		ring.end_frame();
+	}
+
+	void test_destruction()
+	{
+		recording_backend backend;
+		backend.buffer.resize(3 * 32);
+		{
+			stream_ring<recording_backend> ring(backend, 32);
+			for (int frame = 0; frame < 2; ++frame)
+			{
+				ring.begin_frame();
+				ring.end_frame();
+			}
+			backend.take();
+		}
+
+		// Fences still pending are deleted without waiting; the unused segment has none
+		CHECK((backend.take() == calls{"delete_fence 1", "delete_fence 2"}));
+	}
+
+}
+
+int main() try
+{
+	test_rotation();
+	test_alignment();
+	test_overflow();
+	test_destruction();
+	std::cout << "stream_ring: all checks passed" << std::endl;
+}
+catch (std::exception const & e)
+{
+	std::cerr << e.what() << std::endl;
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,171 @@
+#include "texture_cache.hpp"
+#include "check.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <set>
+
+// Runs texture_cache against a backend that records created and deleted
+// textures, on small PPM files written to a temporary directory, and checks
+// sharing by path and by content, that finish() returns with everything
+// requested uploaded, that eviction spares the textures bound in the current
+// and the previous frame and otherwise takes the least recently bound one,
+// and that an evicted texture is decoded and uploaded again once bound.
+namespace
+{
+
+	struct recording_backend
+	{
+		unsigned int next_name = 1;
+		std::set<unsigned int> live;
+		std::vector<unsigned int> deleted;
+
+		unsigned int create_texture(int width, int height, unsigned char const * rgba)
+		{
+			CHECK(width == 2 && height == 2 && rgba);
+			live.insert(next_name);
+			return next_name++;
+		}
+
+		void delete_texture(unsigned int texture)
+		{
+			CHECK(live.erase(texture) == 1);
+			deleted.push_back(texture);
+		}
+	};
+
+	// A 2x2 texture is estimated at 2 * 2 * 4 * 4 / 3 bytes, so this budget holds two of them
+	constexpr std::size_t texture_bytes = 21;
+	constexpr std::size_t budget = 2 * texture_bytes + 8;
+
+	struct test_directory
+	{
+		std::filesystem::path const path = std::filesystem::temp_directory_path() / "practice14_texture_cache_test";
+
+		test_directory()
+		{
+			std::filesystem::remove_all(path);
+			std::filesystem::create_directories(path);
+		}
+
+		~test_directory()
+		{
+			std::filesystem::remove_all(path);
+		}
+
+		// A 2x2 binary PPM, its contents told apart by the seed
+		std::string write(std::string const & name, unsigned char seed)
+		{
+			std::ofstream file(path / name, std::ios::binary);
+			file << "P6\n2 2\n255\n";
+			for (int i = 0; i < 12; ++i)
+				file.put(char(seed + i));
+			return (path / name).string();
+		}
+	};
+
+	void test_sharing()
+	{
+		test_directory directory;
+		std::string const a = directory.write("a.ppm", 0);
+		std::string const copy = directory.write("copy.ppm", 0);
+		std::string const b = directory.write("b.ppm", 100);
+
+		recording_backend backend;
+		texture_cache<recording_backend> cache(backend, budget);
+
+		auto const ha = cache.request(a);
+		auto const ha_again = cache.request((directory.path / "." / "a.ppm").string());
+		auto const hcopy = cache.request(copy);
+		auto const hb = cache.request(b);
+		auto const missing = cache.request((directory.path / "missing.ppm").string());
+
+		// Another spelling of a path is the same handle, a copy of the file is not
+		CHECK(ha == ha_again);
+		CHECK(hcopy != ha && hb != ha);
+		CHECK(cache.totals().requests == 5 && cache.totals().path_hits == 1);
+
+		// Everything requested is settled when finish() returns
+		CHECK(cache.finish() == 2);
+		CHECK(cache.resident(ha) && cache.resident(hcopy) && cache.resident(hb));
+		CHECK(cache.failed(missing) && !cache.resident(missing));
+
+		// The copy shares the texture of the original
+		CHECK(backend.live.size() == 2);
+		CHECK(cache.bind(ha) == cache.bind(hcopy));
+		CHECK(cache.bind(ha) != cache.bind(hb));
+		CHECK(cache.totals().content_hits == 1);
+		CHECK(cache.totals().uploads == 2);
+		CHECK(cache.totals().resident_bytes == 2 * texture_bytes);
+
+		// A failed file is not queued again by binding it
+		CHECK(cache.bind(missing) == 0);
+		CHECK(cache.finish() == 0);
+		CHECK(cache.failed(missing));
+	}
+
+	void test_eviction()
+	{
+		test_directory directory;
+		recording_backend backend;
+		texture_cache<recording_backend> cache(backend, budget);
+
+		// Frame 1: uploads count as binds, so three textures are in use and may exceed the budget
+		auto const a = cache.request(directory.write("a.ppm", 0));
+		auto const b = cache.request(directory.write("b.ppm", 50));
+		auto const c = cache.request(directory.write("c.ppm", 100));
+		CHECK(cache.finish() == 3);
+		CHECK(cache.totals().resident_textures == 3);
+		CHECK(cache.totals().resident_bytes > cache.budget());
+		unsigned int const c_name = cache.bind(c);
+		CHECK(c_name != 0);
+		cache.end_frame();
+
+		// Frame 2: c was bound in the previous frame, so it stays
+		CHECK(cache.update() == 0);
+		cache.bind(a);
+		cache.bind(b);
+		cache.end_frame();
+
+		// Frame 3: c is two frames old and goes, a and b from the previous frame stay
+		CHECK(cache.update() == 1);
+		CHECK(!cache.resident(c));
+		CHECK(cache.resident(a) && cache.resident(b));
+		CHECK(backend.deleted == std::vector<unsigned int>{c_name});
+		CHECK(cache.residency(c).evictions == 1 && cache.residency(c).bytes == 0);
+		CHECK(cache.totals().resident_bytes == 2 * texture_bytes);
+
+		// Binding an evicted texture queues it again; it is uploaded a second time
+		CHECK(cache.bind(c) == 0);
+		CHECK(cache.finish() == 1);
+		CHECK(cache.resident(c));
+		CHECK(cache.residency(c).uploads == 2);
+		CHECK(cache.totals().decodes == 4);
+		cache.bind(b);
+		cache.end_frame();
+
+		// Frame 4 binds c. In frame 5, a and b are both older than the previous
+		// frame, and a, bound least recently, goes first
+		cache.bind(c);
+		cache.end_frame();
+		CHECK(cache.update() == 1);
+		CHECK(!cache.resident(a));
+		CHECK(cache.resident(b) && cache.resident(c));
+		CHECK(cache.totals().evictions == 2);
+		CHECK(cache.totals().resident_textures == 2);
+	}
+
+}
+
+int main() try
+{
+	test_sharing();
+	test_eviction();
+	std::cout << "texture_cache: all checks passed" << std::endl;
+}
+catch (std::exception const & e)
+{
+	std::cerr << e.what() << std::endl;
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x3.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// Transform hierarchy with nodes stored sorted by depth: parents always come
+// before their children, and the nodes of one level are contiguous. Local TRS
+// is kept in separate per-component arrays and world transforms are affine
+// 4x3 matrices, so each level is one flat loop over contiguous storage.
+struct transform_hierarchy
+{
+    static constexpr std::uint32_t no_parent = -1;
+
+    transform_hierarchy() = default;
+
+    // parents[i] is the parent of node i, or no_parent for roots
+    explicit transform_hierarchy(std::vector<std::uint32_t> const & parents);
+
+    std::size_t size() const { return slot.size(); }
+
+    void set_translation(std::uint32_t node, glm::vec3 const & translation);
+    void set_rotation(std::uint32_t node, glm::quat const & rotation);
+    void set_scale(std::uint32_t node, glm::vec3 const & scale);
+    void set_local(std::uint32_t node, glm::vec3 const & translation, glm::quat const & rotation, glm::vec3 const & scale);
+
+    // Recomputes world transforms of the nodes that changed since the last
+    // update and of their descendants; levels without changes are skipped
+    void update();
+
+    glm::mat4x3 const & world(std::uint32_t node) const { return world_transforms[slot[node]]; }
+
+    // Node index -> storage slot
+    std::vector<std::uint32_t> slot;
+
+    // Storage slot -> parent storage slot; roots point to the identity at world_transforms.back()
+    std::vector<std::uint32_t> parent_slot;
+
+    // Storage slots of level k are [level_begin[k], level_begin[k + 1])
+    std::vector<std::uint32_t> level_begin;
+
+    std::vector<float> tx, ty, tz;
+    std::vector<float> qx, qy, qz, qw;
+    std::vector<float> sx, sy, sz;
+
+    // Per storage slot, and a last one for the identity slot that is never set
+    std::vector<std::uint8_t> dirty;
+    std::vector<glm::mat4x3> world_transforms;
+};
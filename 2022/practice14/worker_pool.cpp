@@ -0,0 +1,66 @@
+#include "worker_pool.hpp"
+
+#include <algorithm>
+
+worker_pool::worker_pool(std::size_t thread_count)
+{
+	thread_count = std::max<std::size_t>(thread_count, 1);
+	for (std::size_t i = 1; i < thread_count; ++i)
+		workers.emplace_back(&worker_pool::worker_loop, this, i);
+}
+
+worker_pool::~worker_pool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	start_condition.notify_all();
+
+	for (auto & worker : workers)
+		worker.join();
+}
+
+void worker_pool::run(std::function<void(std::size_t)> const & job)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		current_job = &job;
+		running = workers.size();
+		++generation;
+	}
+	start_condition.notify_all();
+
+	job(0);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	done_condition.wait(lock, [&]{ return running == 0; });
+	current_job = nullptr;
+}
+
+void worker_pool::worker_loop(std::size_t thread_index)
+{
+	std::uint64_t seen_generation = 0;
+
+	while (true)
+	{
+		std::function<void(std::size_t)> const * job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			start_condition.wait(lock, [&]{ return stopping || generation != seen_generation; });
+			if (stopping)
+				return;
+
+			seen_generation = generation;
+			job = current_job;
+		}
+
+		(*job)(thread_index);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--running == 0)
+				done_condition.notify_one();
+		}
+	}
+}
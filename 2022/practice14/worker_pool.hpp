@@ -0,0 +1,39 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+#include <cstdint>
+
+// Persistent worker threads that run one job at a time on every thread
+struct worker_pool
+{
+	// thread_count includes the calling thread
+	explicit worker_pool(std::size_t thread_count = std::thread::hardware_concurrency());
+	~worker_pool();
+
+	worker_pool(worker_pool const &) = delete;
+	worker_pool & operator = (worker_pool const &) = delete;
+
+	std::size_t size() const { return workers.size() + 1; }
+
+	// Calls job(thread_index) on every thread, with the calling thread as
+	// index 0, and returns when all of them finished
+	void run(std::function<void(std::size_t)> const & job);
+
+private:
+	void worker_loop(std::size_t thread_index);
+
+	std::vector<std::thread> workers;
+
+	std::mutex mutex;
+	std::condition_variable start_condition;
+	std::condition_variable done_condition;
+
+	std::function<void(std::size_t)> const * current_job = nullptr;
+	std::uint64_t generation = 0;
+	std::size_t running = 0;
+	bool stopping = false;
+};
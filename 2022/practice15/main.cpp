@@ -27,6 +27,7 @@
 
 #include "msdf_loader.hpp"
 #include "stb_image.h"
+#include "benchmark.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -137,8 +138,115 @@ GLuint create_program(Shaders ... shaders)
     return result;
 }
 
-int main() try
+// The text is replayed as the first `length` characters of benchmark_text
+std::vector<std::string> const camera_parameters{"scale", "length"};
+
+std::string const benchmark_text = "The quick brown fox jumps over the lazy dog. Sphinx of black quartz, judge my vow! "
+    "Pack my box with five dozen liquor jugs; how vexingly quick daft zebras jump (42 times, at 3.14 m/s).";
+
+// Types benchmark_text while zooming out, then erases it, 10 seconds long
+camera_path scripted_camera_path()
+{
+    camera_path result(camera_parameters);
+    for (int key = 0; key <= 100; ++key) {
+        float const t = key / 10.f;
+        float const typed = (t < 8.f) ? t / 8.f : (10.f - t) / 2.f;
+        result.add(t, {5.f - 4.f * typed, typed * benchmark_text.size()});
+    }
+    return result;
+}
+
+int main(int argc, char ** argv) try
 {
+    auto const options = parse_benchmark_options(argc, argv);
+
+    const std::string project_root = PROJECT_ROOT;
+    const std::string font_path = project_root + "/font/font-msdf.json";
+
+    auto const font = load_msdf_font(font_path);
+
+    int texture_width, texture_height;
+    {
+        int channels;
+        if (!stbi_info(font.texture_path.c_str(), &texture_width, &texture_height, &channels))
+            throw std::runtime_error("Failed to read " + font.texture_path);
+    }
+
+    // Fills vertices with the glyph quads of the text
+    auto layout_text = [&](std::string const & text, std::vector<vertex> & vertices, glm::vec2 & bbox_min, glm::vec2 & bbox_max)
+    {
+        vertices.clear();
+        glm::vec2 pen(0.0);
+        bbox_min = glm::vec2{std::numeric_limits<float>::max(), std::numeric_limits<float>::max()};
+        bbox_max = glm::vec2{std::numeric_limits<float>::min(), std::numeric_limits<float>::min()};
+
+        for (char32_t el : text) {
+            auto const& glyph = font.glyphs.at(el);
+            vertex new_symbol[6];
+            new_symbol[0].position = { pen.x + glyph.xoffset, pen.y + glyph.yoffset };
+            new_symbol[0].texcoord = { (float)glyph.x / texture_width, (float)glyph.y / texture_height };
+            new_symbol[1].position = { pen.x + glyph.xoffset + glyph.width, pen.y + glyph.yoffset + glyph.height };
+            new_symbol[1].texcoord = { (float)(glyph.x + glyph.width) / texture_width, (float)(glyph.y + glyph.height) / texture_height };
+            new_symbol[2].position = { pen.x + glyph.xoffset + glyph.width, pen.y + glyph.yoffset };
+            new_symbol[2].texcoord = { (float)(glyph.x + glyph.width) / texture_width, (float)glyph.y / texture_height };
+            new_symbol[3].position = { pen.x + glyph.xoffset, pen.y + glyph.yoffset };
+            new_symbol[3].texcoord = { (float)glyph.x / texture_width, (float)glyph.y / texture_height };
+            new_symbol[4].position = { pen.x + glyph.xoffset, pen.y + glyph.yoffset + glyph.height };
+            new_symbol[4].texcoord = { (float)glyph.x / texture_width, (float)(glyph.y + glyph.height) / texture_height };
+            new_symbol[5].position = { pen.x + glyph.xoffset + glyph.width, pen.y + glyph.yoffset + glyph.height };
+            new_symbol[5].texcoord = { (float)(glyph.x + glyph.width) / texture_width, (float)(glyph.y + glyph.height) / texture_height };
+            vertices.insert(vertices.end(), new_symbol, new_symbol + 6);
+            for (auto el : new_symbol) {
+                bbox_min.x = std::min(bbox_min.x, el.position.x);
+                bbox_min.y = std::min(bbox_min.y, el.position.y);
+                bbox_max.x = std::max(bbox_max.x, el.position.x);
+                bbox_max.y = std::max(bbox_max.y, el.position.y);
+            }
+            pen.x += glyph.advance;
+        }
+    };
+
+    if (options.frames > 0)
+    {
+        camera_path const path = options.path.empty() ? scripted_camera_path() : camera_path::load(options.path, camera_parameters);
+
+        benchmark_report report("practice15", options);
+        auto const layout_stage = report.stage("text layout");
+        auto const glyph_counter = report.counter("glyphs");
+
+        // Viewport of the benchmark, in place of the window
+        int const width = 1920, height = 1080;
+
+        std::vector<vertex> vertices;
+        glm::vec2 bbox_min{}, bbox_max{};
+        std::size_t length = std::string::npos;
+
+        for (std::size_t frame = 0; frame < options.frames; ++frame) {
+            auto const camera = path.sample(frame * options.dt);
+            float const scale = camera[0];
+
+            report.time(layout_stage, [&] {
+                // As in the interactive loop, the text is laid out again only when it changes
+                if (std::size_t const typed = std::min<std::size_t>(std::max(camera[1], 0.f), benchmark_text.size()); typed != length) {
+                    length = typed;
+                    layout_text(benchmark_text.substr(0, length), vertices, bbox_min, bbox_max);
+                }
+
+                auto transform = glm::ortho(0.0f, (float)width, (float)height, 0.0f, -1.0f, 1.0f);
+                auto mid = (bbox_max + bbox_min) * scale / 2.0f;
+                transform = transform * glm::translate(glm::mat4(1.f), glm::vec3(glm::vec2{width / 2.f, height / 2.f} - mid, 0.0)) *
+                            glm::scale(glm::mat4(1.f), glm::vec3(scale, scale, 1.f));
+            });
+
+            report.add(glyph_counter, vertices.size() / 6);
+            report.end_frame();
+        }
+
+        report.write(options.report);
+        std::cout << "Benchmark of " << report.frames() << " frames written to " << options.report << std::endl;
+        return EXIT_SUCCESS;
+    }
+
     if (SDL_Init(SDL_INIT_VIDEO) != 0)
         sdl2_fail("SDL_Init: ");
 
@@ -181,13 +289,7 @@ int main() try
     GLuint sdf_scale_location = glGetUniformLocation(msdf_program, "sdf_scale");
     GLuint sdf_texture_location = glGetUniformLocation(msdf_program, "sdf_texture");
 
-    const std::string project_root = PROJECT_ROOT;
-    const std::string font_path = project_root + "/font/font-msdf.json";
-
-    auto const font = load_msdf_font(font_path);
-
     GLuint texture;
-    int texture_width, texture_height;
     {
         int channels;
         auto data = stbi_load(font.texture_path.c_str(), &texture_width, &texture_height, &channels, 4);
@@ -239,6 +341,9 @@ int main() try
     glm::vec2 bbox_max{};
     float scale = 5.f;
 
+    camera_path recorded_path(camera_parameters);
+    float recorded_time = 0.f;
+
     bool running = true;
     while (running)
     {
@@ -279,37 +384,14 @@ int main() try
         float dt = std::chrono::duration_cast<std::chrono::duration<float>>(now - last_frame_start).count();
         last_frame_start = now;
 
+        if (!options.record.empty() && dt > 0.f) {
+            recorded_time += dt;
+            recorded_path.add(recorded_time, {scale, static_cast<float>(text.size())});
+        }
+
         if (text_changed) {
-            vertices.clear();
-            glm::vec2 pen(0.0);
-            bbox_min = glm::vec2{std::numeric_limits<float>::max(), std::numeric_limits<float>::max()};
-            bbox_max = glm::vec2{std::numeric_limits<float>::min(), std::numeric_limits<float>::min()};
-
-            for (char32_t el : text) {
-                auto const& glyph = font.glyphs.at(el);
-                vertex new_symbol[6];
-                new_symbol[0].position = { pen.x + glyph.xoffset, pen.y + glyph.yoffset };
-                new_symbol[0].texcoord = { (float)glyph.x / texture_width, (float)glyph.y / texture_height };
-                new_symbol[1].position = { pen.x + glyph.xoffset + glyph.width, pen.y + glyph.yoffset + glyph.height };
-                new_symbol[1].texcoord = { (float)(glyph.x + glyph.width) / texture_width, (float)(glyph.y + glyph.height) / texture_height };
-                new_symbol[2].position = { pen.x + glyph.xoffset + glyph.width, pen.y + glyph.yoffset };
-                new_symbol[2].texcoord = { (float)(glyph.x + glyph.width) / texture_width, (float)glyph.y / texture_height };
-                new_symbol[3].position = { pen.x + glyph.xoffset, pen.y + glyph.yoffset };
-                new_symbol[3].texcoord = { (float)glyph.x / texture_width, (float)glyph.y / texture_height };
-                new_symbol[4].position = { pen.x + glyph.xoffset, pen.y + glyph.yoffset + glyph.height };
-                new_symbol[4].texcoord = { (float)glyph.x / texture_width, (float)(glyph.y + glyph.height) / texture_height };
-                new_symbol[5].position = { pen.x + glyph.xoffset + glyph.width, pen.y + glyph.yoffset + glyph.height };
-                new_symbol[5].texcoord = { (float)(glyph.x + glyph.width) / texture_width, (float)(glyph.y + glyph.height) / texture_height };
-                vertices.insert(vertices.end(), new_symbol, new_symbol + 6);
-                for (auto el : new_symbol) {
-                    bbox_min.x = std::min(bbox_min.x, el.position.x);
-                    bbox_min.y = std::min(bbox_min.y, el.position.y);
-                    bbox_max.x = std::max(bbox_max.x, el.position.x);
-                    bbox_max.y = std::max(bbox_max.y, el.position.y);
-                }
-                pen.x += glyph.advance;
-                size += 6;
-            }
+            layout_text(text, vertices, bbox_min, bbox_max);
+            size = vertices.size();
             glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vertex), vertices.data(), GL_STATIC_DRAW);
             text_changed = false;
         }
@@ -342,6 +424,9 @@ int main() try
         SDL_GL_SwapWindow(window);
     }
 
+    if (!options.record.empty())
+        recorded_path.save(options.record);
+
     SDL_GL_DeleteContext(gl_context);
     SDL_DestroyWindow(window);
 }
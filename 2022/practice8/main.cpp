@@ -18,6 +18,7 @@
 #include <cmath>
 #include <fstream>
 #include <sstream>
+#include <limits>
 
 #define GLM_FORCE_SWIZZLE
 #define GLM_ENABLE_EXPERIMENTAL
@@ -30,6 +31,7 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include "obj_parser.hpp"
+#include "shadow_fitting.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -303,6 +305,16 @@ try
     std::string scene_path = project_root + "/buddha.obj";
     obj_data scene = parse_obj(scene_path);
 
+    // The scene is a single caster, fitted together with the camera frustum
+    std::vector<shadow_box> scene_boxes{{glm::vec3(std::numeric_limits<float>::infinity()), glm::vec3(-std::numeric_limits<float>::infinity())}};
+    for (auto const & vertex : scene.vertices) {
+        glm::vec3 const position(vertex.position[0], vertex.position[1], vertex.position[2]);
+        scene_boxes[0].min = glm::min(scene_boxes[0].min, position);
+        scene_boxes[0].max = glm::max(scene_boxes[0].max, position);
+    }
+    float const shadow_size_step = glm::length(scene_boxes[0].max - scene_boxes[0].min) / 32.f;
+    shadow_setup shadow;
+
     GLuint scene_vao, scene_vbo, scene_ebo, rect_vao;
     glGenVertexArrays(1, &scene_vao);
     glBindVertexArray(scene_vao);
@@ -436,11 +448,8 @@ try
         auto light_Y = glm::cross(light_X, light_Z);
         auto proect = glm::mat4(glm::transpose(glm::mat3(light_X, light_Y, light_Z)));*/
 
-        auto light_direction = normalize(sun_direction);
-        auto light_Z = -light_direction;
-        auto light_X = normalize(cross(glm::vec3(0.0, 1.0, 0.0), light_Z));
-        auto light_Y = cross(light_X, light_Z);
-        auto proect = glm::mat4(transpose(glm::mat3(light_X, light_Y, light_Z)));
+        fit_shadow(sun_direction, projection * view, scene_boxes, shadow_map_size, shadow_size_step, shadow);
+        auto proect = shadow.transform;
 
         glUniformMatrix4fv(shadow_model_location, 1, GL_FALSE, reinterpret_cast<float *>(&model));
         glUniformMatrix4fv(shadow_projection_locationS, 1, GL_FALSE, reinterpret_cast<float *>(&proect));
@@ -449,7 +458,8 @@ try
         glCullFace(GL_FRONT);
 
         glBindVertexArray(scene_vao);
-        glDrawElements(GL_TRIANGLES, scene.indices.size(), GL_UNSIGNED_INT, nullptr);
+        if (!shadow.casters.empty())
+            glDrawElements(GL_TRIANGLES, scene.indices.size(), GL_UNSIGNED_INT, nullptr);
 
         glCullFace(GL_BACK);
 
@@ -0,0 +1,137 @@
+#include "shadow_fitting.hpp"
+
+#include <glm/vec2.hpp>
+#include <glm/geometric.hpp>
+#include <glm/common.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+namespace
+{
+
+    constexpr float inf = std::numeric_limits<float>::infinity();
+
+    struct light_box
+    {
+        glm::vec3 min{inf};
+        glm::vec3 max{-inf};
+    };
+
+}
+
+void fit_shadow(glm::vec3 const & light_direction, glm::mat4 const & camera_view_projection,
+    std::vector<shadow_box> const & boxes, int resolution, float size_step, shadow_setup & result)
+{
+    glm::vec3 const light_z = -glm::normalize(light_direction);
+    glm::vec3 const up = (std::abs(light_z.y) < 0.99f) ? glm::vec3(0.f, 1.f, 0.f) : glm::vec3(1.f, 0.f, 0.f);
+    glm::vec3 const light_x = glm::normalize(glm::cross(light_z, up));
+    glm::vec3 const light_y = glm::cross(light_x, light_z);
+
+    auto to_light = [&](glm::vec3 const & p)
+    {
+        return glm::vec3(glm::dot(p, light_x), glm::dot(p, light_y), glm::dot(p, light_z));
+    };
+
+    auto box_to_light = [&](shadow_box const & b)
+    {
+        glm::vec3 const c = to_light((b.min + b.max) / 2.f);
+        glm::vec3 const e = (b.max - b.min) / 2.f;
+        glm::vec3 const r{
+            glm::dot(e, glm::abs(light_x)),
+            glm::dot(e, glm::abs(light_y)),
+            glm::dot(e, glm::abs(light_z)),
+        };
+        return light_box{c - r, c + r};
+    };
+
+    // Camera frustum planes, normals pointing inside
+    glm::mat4 const t = glm::transpose(camera_view_projection);
+    glm::vec4 const planes[6] = {t[3] + t[0], t[3] - t[0], t[3] + t[1], t[3] - t[1], t[3] + t[2], t[3] - t[2]};
+
+    auto visible = [&](shadow_box const & b)
+    {
+        glm::vec3 const c = (b.min + b.max) / 2.f;
+        glm::vec3 const e = (b.max - b.min) / 2.f;
+        for (auto const & p : planes)
+            if (glm::dot(glm::vec3(p), c) + p.w < -glm::dot(e, glm::abs(glm::vec3(p))))
+                return false;
+        return true;
+    };
+
+    light_box frustum_bounds;
+    glm::mat4 const inverse = glm::inverse(camera_view_projection);
+    for (int i = 0; i < 8; ++i)
+    {
+        glm::vec4 v = inverse * glm::vec4((i & 1) ? 1.f : -1.f, (i & 2) ? 1.f : -1.f, (i & 4) ? 1.f : -1.f, 1.f);
+        glm::vec3 const p = to_light(glm::vec3(v) / v.w);
+        frustum_bounds.min = glm::min(frustum_bounds.min, p);
+        frustum_bounds.max = glm::max(frustum_bounds.max, p);
+    }
+
+    std::vector<light_box> light_boxes(boxes.size());
+    light_box receiver_bounds;
+
+    result.receivers.clear();
+    for (std::uint32_t i = 0; i < boxes.size(); ++i)
+    {
+        light_boxes[i] = box_to_light(boxes[i]);
+        if (!visible(boxes[i]))
+            continue;
+
+        result.receivers.push_back(i);
+        receiver_bounds.min = glm::min(receiver_bounds.min, light_boxes[i].min);
+        receiver_bounds.max = glm::max(receiver_bounds.max, light_boxes[i].max);
+    }
+
+    // Only the part of the receivers inside the frustum needs shadows
+    receiver_bounds.min = glm::max(receiver_bounds.min, frustum_bounds.min);
+    receiver_bounds.max = glm::min(receiver_bounds.max, frustum_bounds.max);
+
+    result.casters.clear();
+    if (result.receivers.empty() || glm::any(glm::greaterThan(receiver_bounds.min, receiver_bounds.max)))
+    {
+        result.receivers.clear();
+        receiver_bounds = frustum_bounds;
+    }
+
+    float near = receiver_bounds.min.z;
+    float const far = receiver_bounds.max.z;
+
+    for (std::uint32_t i = 0; i < boxes.size() && !result.receivers.empty(); ++i)
+    {
+        light_box const & b = light_boxes[i];
+        bool const overlaps = b.min.x <= receiver_bounds.max.x && receiver_bounds.min.x <= b.max.x
+            && b.min.y <= receiver_bounds.max.y && receiver_bounds.min.y <= b.max.y;
+        if (!overlaps || b.min.z > far)
+            continue;
+
+        result.casters.push_back(i);
+        near = std::min(near, b.min.z);
+    }
+
+    // Square extent, rounded up with room for snapping the origin by up to a texel on each side
+    float const raw_size = std::max(receiver_bounds.max.x - receiver_bounds.min.x, receiver_bounds.max.y - receiver_bounds.min.y);
+    float size = raw_size * resolution / std::max(resolution - 2, 1);
+    size = std::max(std::ceil(size / size_step), 1.f) * size_step;
+
+    float const texel = size / resolution;
+    glm::vec2 const center = (glm::vec2(receiver_bounds.min) + glm::vec2(receiver_bounds.max)) / 2.f;
+    glm::vec2 const origin = glm::floor((center - size / 2.f) / texel) * texel;
+
+    float const depth = std::max(far - near, 1e-6f);
+
+    glm::mat4 transform(1.f);
+    for (int c = 0; c < 3; ++c)
+    {
+        transform[c][0] = 2.f / size * light_x[c];
+        transform[c][1] = 2.f / size * light_y[c];
+        transform[c][2] = 2.f / depth * light_z[c];
+        transform[c][3] = 0.f;
+    }
+    transform[3] = glm::vec4(-2.f * origin.x / size - 1.f, -2.f * origin.y / size - 1.f, -2.f * near / depth - 1.f, 1.f);
+
+    result.transform = transform;
+    result.texel_size = texel;
+}
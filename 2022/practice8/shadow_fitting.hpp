@@ -0,0 +1,37 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <vector>
+#include <cstdint>
+
+struct shadow_box
+{
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+struct shadow_setup
+{
+    // Maps world space to [-1, 1]^3, z grows away from the light
+    glm::mat4 transform;
+
+    // World-space size of a shadow map texel
+    float texel_size;
+
+    // Boxes visible to the camera, and boxes that may cast shadows onto them
+    std::vector<std::uint32_t> receivers;
+    std::vector<std::uint32_t> casters;
+};
+
+// Fits an orthographic shadow transform to the part of the visible receivers
+// inside the camera frustum. Its depth range is extended towards the light to
+// cover every caster whose box, swept away from the light, reaches a receiver;
+// other boxes are not casters.
+//
+// The shadow map extent is rounded up to a multiple of size_step and its origin
+// is snapped to whole texels, so that shadow edges do not shimmer when the
+// camera moves. light_direction points towards the light.
+void fit_shadow(glm::vec3 const & light_direction, glm::mat4 const & camera_view_projection,
+    std::vector<shadow_box> const & boxes, int resolution, float size_step, shadow_setup & result);
@@ -0,0 +1,176 @@
+#include "cascaded_shadows.hpp"
+
+#include <glm/vec2.hpp>
+#include <glm/geometric.hpp>
+#include <glm/common.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+shadow_cascades::shadow_cascades(std::size_t cascade_count)
+    : cascades(cascade_count)
+{
+    // Never equal to a fitted transform, so that the first update is dirty
+    for (auto & c : cascades)
+        c.transform = glm::mat4(0.f);
+}
+
+void shadow_cascades::update(glm::vec3 const & light_direction, glm::mat4 const & camera_view,
+    float fov_y, float aspect, float near, float far,
+    std::vector<shadow_box> const & boxes, int resolution)
+{
+    glm::vec3 const light_z = -glm::normalize(light_direction);
+    glm::vec3 const up = (std::abs(light_z.y) < 0.99f) ? glm::vec3(0.f, 1.f, 0.f) : glm::vec3(1.f, 0.f, 0.f);
+    glm::vec3 const light_x = glm::normalize(glm::cross(light_z, up));
+    glm::vec3 const light_y = glm::cross(light_x, light_z);
+
+    auto to_light = [&](glm::vec3 const & p)
+    {
+        return glm::vec3(glm::dot(p, light_x), glm::dot(p, light_y), glm::dot(p, light_z));
+    };
+
+    glm::mat4 const camera_to_world = glm::inverse(camera_view);
+    float const tan_y = std::tan(fov_y / 2.f);
+    float const tan_x = tan_y * aspect;
+
+    std::size_t const count = cascades.size();
+
+    // Light-space boxes and the scene bounds they add up to
+    light_boxes.resize(boxes.size());
+    glm::vec3 scene_min(std::numeric_limits<float>::infinity());
+    glm::vec3 scene_max(-std::numeric_limits<float>::infinity());
+    for (std::size_t i = 0; i < boxes.size(); ++i)
+    {
+        glm::vec3 const c = to_light((boxes[i].min + boxes[i].max) / 2.f);
+        glm::vec3 const e = (boxes[i].max - boxes[i].min) / 2.f;
+        glm::vec3 const r{
+            glm::dot(e, glm::abs(light_x)),
+            glm::dot(e, glm::abs(light_y)),
+            glm::dot(e, glm::abs(light_z)),
+        };
+        light_boxes[i] = {c - r, c + r};
+        scene_min = glm::min(scene_min, c - r);
+        scene_max = glm::max(scene_max, c + r);
+    }
+
+    // Per cascade: light-space extent and depth range
+    struct bounds
+    {
+        glm::vec2 origin;
+        float size;
+        float near;
+        float far;
+    };
+    std::vector<bounds> fitted(count);
+
+    float slice_near = near;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        float const t = float(i + 1) / count;
+        float const split = split_lambda * near * std::pow(far / near, t) + (1.f - split_lambda) * (near + (far - near) * t);
+
+        glm::vec3 corners[8];
+        glm::vec3 centroid(0.f);
+        for (int k = 0; k < 8; ++k)
+        {
+            float const d = (k & 4) ? split : slice_near;
+            glm::vec3 const view_corner{((k & 1) ? 1.f : -1.f) * tan_x * d, ((k & 2) ? 1.f : -1.f) * tan_y * d, -d};
+            corners[k] = glm::vec3(camera_to_world * glm::vec4(view_corner, 1.f));
+            centroid += corners[k] / 8.f;
+        }
+
+        float radius = 0.f;
+        for (auto const & c : corners)
+            radius = std::max(radius, glm::distance(c, centroid));
+
+        // Quantized, so that rounding noise in the corners does not change the texel size
+        radius = std::ceil(radius * 64.f) / 64.f;
+
+        glm::vec3 const center = to_light(centroid);
+        glm::vec3 lower = center - radius;
+        glm::vec3 upper = center + radius;
+        float extent = 2.f * radius;
+
+        // Nothing outside the scene needs a shadow. Clipped, the extent is
+        // rounded up to 1/16 of the sphere, so that the texel size changes in
+        // steps rather than with every camera move.
+        glm::vec3 const clipped_lower = glm::max(lower, scene_min);
+        glm::vec3 const clipped_upper = glm::min(upper, scene_max);
+        if (clipped_lower.x < clipped_upper.x && clipped_lower.y < clipped_upper.y)
+        {
+            lower = clipped_lower;
+            upper = glm::max(clipped_upper, clipped_lower);
+            float const step = radius / 8.f;
+            extent = std::min(std::ceil(std::max(upper.x - lower.x, upper.y - lower.y) / step) * step, extent);
+        }
+
+        // One spare texel covers the origin snapping
+        float const texel = extent / (resolution - 1);
+        glm::vec2 const middle = (glm::vec2(lower) + glm::vec2(upper)) / 2.f;
+
+        auto & b = fitted[i];
+        b.size = texel * resolution;
+        b.origin = glm::floor((middle - extent / 2.f) / texel) * texel;
+        b.near = lower.z;
+        b.far = std::ceil(upper.z / texel) * texel;
+
+        cascades[i].split = split;
+        cascades[i].texel_size = texel;
+
+        slice_near = split;
+    }
+
+    previous_casters.resize(count);
+    for (std::size_t k = 0; k < count; ++k)
+    {
+        std::swap(previous_casters[k], cascades[k].casters);
+        cascades[k].casters.clear();
+    }
+
+    // One pass over the boxes, each sorted into every cascade it can shadow
+    for (std::uint32_t i = 0; i < boxes.size(); ++i)
+    {
+        glm::vec3 const & min = light_boxes[i].min;
+        glm::vec3 const & max = light_boxes[i].max;
+
+        for (std::size_t k = 0; k < count; ++k)
+        {
+            auto & b = fitted[k];
+            bool const overlaps = min.x <= b.origin.x + b.size && b.origin.x <= max.x
+                && min.y <= b.origin.y + b.size && b.origin.y <= max.y;
+
+            // Swept away from the light, the box must reach the cascade
+            if (!overlaps || min.z > b.far)
+                continue;
+
+            cascades[k].casters.push_back(i);
+            b.near = std::min(b.near, min.z);
+        }
+    }
+
+    for (std::size_t k = 0; k < count; ++k)
+    {
+        auto const & b = fitted[k];
+        float const texel = cascades[k].texel_size;
+
+        // The depth range is snapped to whole texels too, or it would change the transform on every camera move
+        float const near = std::floor(b.near / texel) * texel;
+        float const depth = std::max(b.far - near, texel);
+
+        glm::mat4 transform(1.f);
+        for (int c = 0; c < 3; ++c)
+        {
+            transform[c][0] = 2.f / b.size * light_x[c];
+            transform[c][1] = 2.f / b.size * light_y[c];
+            transform[c][2] = 2.f / depth * light_z[c];
+            transform[c][3] = 0.f;
+        }
+        transform[3] = glm::vec4(-2.f * b.origin.x / b.size - 1.f, -2.f * b.origin.y / b.size - 1.f, -2.f * near / depth - 1.f, 1.f);
+
+        auto & c = cascades[k];
+
+        c.dirty = (c.casters != previous_casters[k]) || (transform != c.transform);
+        c.transform = transform;
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "shadow_fitting.hpp"
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <vector>
+#include <cstdint>
+
+// Cascaded shadow maps for a directional light. The view range is split with
+// the practical scheme, a blend of logarithmic and uniform splits. Every
+// cascade is fitted to the bounding sphere of its slice of the camera
+// frustum, so its size does not change when the camera rotates, clipped
+// against the light-space bounds of the scene, and its origin and depth
+// range are snapped to whole texels.
+//
+// Casters are culled in a single pass over the boxes that sorts them into
+// the cascades they can shadow. A cascade whose transform and casters did
+// not change since the previous update is not dirty, and its shadow map may
+// be kept as long as the boxes did not move.
+struct shadow_cascades
+{
+    struct cascade
+    {
+        // Maps world space to [-1, 1]^3, z grows away from the light
+        glm::mat4 transform;
+
+        // View-space distance at which the cascade ends
+        float split;
+
+        float texel_size;
+
+        std::vector<std::uint32_t> casters;
+
+        // Set by update() if the transform or the casters changed
+        bool dirty = true;
+    };
+
+    std::vector<cascade> cascades;
+
+    // 0 gives uniform splits, 1 gives logarithmic splits
+    float split_lambda = 0.75f;
+
+    explicit shadow_cascades(std::size_t cascade_count);
+
+    // light_direction points towards the light
+    void update(glm::vec3 const & light_direction, glm::mat4 const & camera_view,
+        float fov_y, float aspect, float near, float far,
+        std::vector<shadow_box> const & boxes, int resolution);
+
+private:
+    std::vector<std::vector<std::uint32_t>> previous_casters;
+    std::vector<shadow_box> light_boxes;
+};
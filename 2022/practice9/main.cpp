@@ -27,6 +27,8 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include "obj_parser.hpp"
+#include "shadow_fitting.hpp"
+#include "cascaded_shadows.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -55,11 +57,13 @@ layout (location = 1) in vec3 in_normal;
 
 out vec3 position;
 out vec3 normal;
+out float view_depth;
 
 void main()
 {
     gl_Position = projection * view * model * vec4(in_position, 1.0);
     position = (model * vec4(in_position, 1.0)).xyz;
+    view_depth = -(view * model * vec4(in_position, 1.0)).z;
     normal = normalize((model * vec4(in_normal, 0.0)).xyz);
 }
 )";
@@ -72,21 +76,30 @@ uniform vec3 ambient;
 uniform vec3 light_direction;
 uniform vec3 light_color;
 
-uniform mat4 transform;
+const int max_cascades = 4;
+
+uniform mat4 transform[max_cascades];
+uniform float cascade_split[max_cascades];
+uniform int cascade_count;
 
-uniform sampler2D shadow_map;
+uniform sampler2DArray shadow_map;
 uniform float bias;
 uniform float delta;
 uniform float texture_size;
 
 in vec3 position;
 in vec3 normal;
+in float view_depth;
 
 layout (location = 0) out vec4 out_color;
 
 void main()
 {
-    vec4 shadow_pos = transform * vec4(position, 1.0);
+    int cascade = 0;
+    while (cascade < cascade_count - 1 && view_depth > cascade_split[cascade])
+        ++cascade;
+
+    vec4 shadow_pos = transform[cascade] * vec4(position, 1.0);
     shadow_pos /= shadow_pos.w;
     shadow_pos = shadow_pos * 0.5 + vec4(0.5);
     vec2 data = vec2(0.0);
@@ -97,7 +110,7 @@ void main()
         {
             float d = length(vec2(x, y));
             float w = exp(-d * d / 25.0);
-            data += texture(shadow_map, shadow_pos.xy + vec2(x, y) / texture_size).rg * w;
+            data += texture(shadow_map, vec3(shadow_pos.xy + vec2(x, y) / texture_size, cascade)).rg * w;
             weight += w;
         }
     }
@@ -145,7 +158,7 @@ void main()
 const char debug_fragment_shader_source[] =
 R"(#version 330 core
 
-uniform sampler2D shadow_map;
+uniform sampler2DArray shadow_map;
 
 in vec2 texcoord;
 
@@ -153,7 +166,7 @@ layout (location = 0) out vec4 out_color;
 
 void main()
 {
-    out_color = vec4(texture(shadow_map, texcoord).rgb, 1.0);
+    out_color = vec4(texture(shadow_map, vec3(texcoord, 0.0)).rgb, 1.0);
 }
 )";
 
@@ -269,6 +282,8 @@ int main() try
     GLuint view_location = glGetUniformLocation(program, "view");
     GLuint projection_location = glGetUniformLocation(program, "projection");
     GLuint transform_location = glGetUniformLocation(program, "transform");
+    GLuint cascade_split_location = glGetUniformLocation(program, "cascade_split");
+    GLuint cascade_count_location = glGetUniformLocation(program, "cascade_count");
     GLuint bias_location = glGetUniformLocation(program, "bias");
     GLuint delta_location = glGetUniformLocation(program, "delta");
     GLuint texture_size_location = glGetUniformLocation(program, "texture_size");
@@ -310,10 +325,6 @@ int main() try
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
     glBufferData(GL_ARRAY_BUFFER, scene.vertices.size() * sizeof(scene.vertices[0]), scene.vertices.data(), GL_STATIC_DRAW);
 
-    glGenBuffers(1, &ebo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, scene.indices.size() * sizeof(scene.indices[0]), scene.indices.data(), GL_STATIC_DRAW);
-
     auto min = glm::vec3(std::numeric_limits<float>::infinity());
     auto max = glm::vec3(-std::numeric_limits<float>::infinity());
     for (auto & vertex : scene.vertices) {
@@ -325,7 +336,51 @@ int main() try
         max.y = std::max(max.y, vertex.position[1]);
         max.z = std::max(max.z, vertex.position[2]);
     }
-    glm::vec3 C = (min + max) / 2.0f;
+
+    // Split the scene into a grid of chunks, so that shadow casters can be culled per chunk
+    struct chunk
+    {
+        std::uint32_t first_index;
+        std::uint32_t index_count;
+    };
+
+    int const chunk_grid = 4;
+    std::vector<chunk> chunks;
+    std::vector<shadow_box> chunk_boxes;
+    {
+        auto position = [&](std::uint32_t index) {
+            auto const & p = scene.vertices[index].position;
+            return glm::vec3(p[0], p[1], p[2]);
+        };
+
+        std::vector<std::vector<std::uint32_t>> cells(chunk_grid * chunk_grid * chunk_grid);
+        for (std::size_t i = 0; i < scene.indices.size(); i += 3) {
+            glm::vec3 const centroid = (position(scene.indices[i]) + position(scene.indices[i + 1]) + position(scene.indices[i + 2])) / 3.f;
+            glm::ivec3 const cell = glm::clamp(glm::ivec3((centroid - min) / (max - min) * float(chunk_grid)), 0, chunk_grid - 1);
+            auto & indices = cells[(cell.z * chunk_grid + cell.y) * chunk_grid + cell.x];
+            indices.insert(indices.end(), scene.indices.begin() + i, scene.indices.begin() + i + 3);
+        }
+
+        scene.indices.clear();
+        for (auto const & indices : cells) {
+            if (indices.empty())
+                continue;
+
+            shadow_box box{glm::vec3(std::numeric_limits<float>::infinity()), glm::vec3(-std::numeric_limits<float>::infinity())};
+            for (auto index : indices) {
+                box.min = glm::min(box.min, position(index));
+                box.max = glm::max(box.max, position(index));
+            }
+
+            chunks.push_back({static_cast<std::uint32_t>(scene.indices.size()), static_cast<std::uint32_t>(indices.size())});
+            chunk_boxes.push_back(box);
+            scene.indices.insert(scene.indices.end(), indices.begin(), indices.end());
+        }
+    }
+
+    glGenBuffers(1, &ebo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, scene.indices.size() * sizeof(scene.indices[0]), scene.indices.data(), GL_STATIC_DRAW);
 
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(obj_data::vertex), (void*)(0));
@@ -337,21 +392,24 @@ int main() try
 
     GLsizei shadow_map_resolution = 1024;
 
+    // Must not exceed max_cascades in the fragment shader
+    shadow_cascades cascades(4);
+
     GLuint shadow_map;
     glGenTextures(1, &shadow_map);
-    glBindTexture(GL_TEXTURE_2D, shadow_map);
-    //glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    //glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, shadow_map_resolution, shadow_map_resolution, 0, GL_RGBA, GL_FLOAT, nullptr);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, shadow_map);
+    //glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    //glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RG32F, shadow_map_resolution, shadow_map_resolution, cascades.cascades.size(), 0, GL_RGBA, GL_FLOAT, nullptr);
 
     GLuint shadow_fbo;
     glGenFramebuffers(1, &shadow_fbo);
     glBindFramebuffer(GL_DRAW_FRAMEBUFFER, shadow_fbo);
-    glFramebufferTexture(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, shadow_map, 0);
+    glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, shadow_map, 0, 0);
 
     GLuint depth_rb;
     glGenRenderbuffers(1, &depth_rb);
@@ -373,6 +431,11 @@ int main() try
     float view_elevation = glm::radians(45.f);
     float view_azimuth = 0.f;
     float camera_distance = 1.5f;
+
+    std::vector<glm::mat4> cascade_transforms;
+    std::vector<float> cascade_splits;
+    float shadow_report_time = 0.f;
+    std::size_t shadow_frames = 0, shadow_cascades_drawn = 0, shadow_chunks_drawn = 0;
     bool running = true;
     while (running)
     {
@@ -425,9 +488,24 @@ int main() try
 
         glm::vec3 light_direction = glm::normalize(glm::vec3(std::cos(time * 0.5f), 1.f, std::sin(time * 0.5f)));
 
+        float near = 0.01f;
+        float far = 10.f;
+
+        glm::mat4 view(1.f);
+        view = glm::translate(view, {0.f, 0.f, -camera_distance});
+        view = glm::rotate(view, view_elevation, {1.f, 0.f, 0.f});
+        view = glm::rotate(view, view_azimuth, {0.f, 1.f, 0.f});
+
+        glm::mat4 projection = glm::mat4(1.f);
+        projection = glm::perspective(glm::pi<float>() / 2.f, (1.f * width) / height, near, far);
+
+        // Nothing beyond the scene needs shadows
+        float const shadow_far = std::min(far, camera_distance + glm::length(max - min));
+        cascades.update(light_direction, view, glm::pi<float>() / 2.f, (1.f * width) / height, near, shadow_far,
+                        chunk_boxes, shadow_map_resolution);
+
         glBindFramebuffer(GL_DRAW_FRAMEBUFFER, shadow_fbo);
         glClearColor(1.f, 1.f, 0.f, 0.f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         glViewport(0, 0, shadow_map_resolution, shadow_map_resolution);
 
         glEnable(GL_DEPTH_TEST);
@@ -436,66 +514,51 @@ int main() try
         glEnable(GL_CULL_FACE);
         glCullFace(GL_BACK);
 
-        glm::vec3 light_z = -light_direction;
-        glm::vec3 light_x = glm::normalize(glm::cross(light_z, {0.f, 1.f, 0.f}));
-        glm::vec3 light_y = glm::cross(light_x, light_z);
-
-        float X_len = 0.f, Y_len = 0.f, Z_len = 0.f;
-        for (int i = 0; i < 2; i++) {
-            for (int j = 0; j < 2; j++) {
-                for (int q = 0; q < 2; q++) {
-                    glm::vec3 V;
-                    if (i == 0)
-                        V.x = min.x;
-                    else
-                        V.x = max.x;
-                    if (j == 0)
-                        V.y = min.y;
-                    else
-                        V.y = max.y;
-                    if (q == 0)
-                        V.z = min.z;
-                    else
-                        V.z = max.z;
-
-                    X_len = std::max(X_len, abs(glm::dot(V - C, light_x)));
-                    Y_len = std::max(Y_len, abs(glm::dot(V - C, light_y)));
-                    Z_len = std::max(Z_len, abs(glm::dot(V - C, light_z)));
-                }
-            }
-        }
-        glm::mat4 lens =
-        {
-                1.f / X_len, 0.f, 0.f, 0.f,
-                0.f, 1.f / Y_len, 0, 0.f,
-                0.f, 0.f, 1.f / Z_len, 0.f,
-                0.f, 0.f, 0.f, 1.f
-        };
-        glm::mat4 poss =
-        {
-                light_x.x, light_y.x, light_z.x, 0.f,
-                light_x.y, light_y.y, light_z.y, 0.f,
-                light_x.z, light_y.z, light_z.z, 0.f,
-                0.f, 0.f, 0.f, 1.f
-        };
-        glm::mat4 cent =
-        {
-                1.f, 0.f, 0.f, -C.x,
-                0.f, 1.f, 0.f, -C.y,
-                0.f, 0.f, 1.f, -C.z,
-                0.f, 0.f, 0.f, 1.f
-        };
-        glm::mat4 transform = glm::transpose(lens) * poss * glm::transpose(cent);
-
         glUseProgram(shadow_program);
         glUniformMatrix4fv(shadow_model_location, 1, GL_FALSE, reinterpret_cast<float *>(&model));
-        glUniformMatrix4fv(shadow_transform_location, 1, GL_FALSE, reinterpret_cast<float *>(&transform));
-
         glBindVertexArray(vao);
-        glDrawElements(GL_TRIANGLES, scene.indices.size(), GL_UNSIGNED_INT, nullptr);
 
-        glBindTexture(GL_TEXTURE_2D, shadow_map);
-        glGenerateMipmap(GL_TEXTURE_2D);
+        bool shadow_map_changed = false;
+        cascade_transforms.clear();
+        cascade_splits.clear();
+        for (std::size_t i = 0; i < cascades.cascades.size(); ++i) {
+            auto & cascade = cascades.cascades[i];
+            cascade_transforms.push_back(cascade.transform);
+            cascade_splits.push_back(cascade.split);
+
+            // Unchanged cascades keep last frame's layer
+            if (!cascade.dirty)
+                continue;
+
+            glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, shadow_map, 0, i);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+            glUniformMatrix4fv(shadow_transform_location, 1, GL_FALSE, reinterpret_cast<float *>(&cascade.transform));
+            for (auto caster : cascade.casters)
+                glDrawElements(GL_TRIANGLES, chunks[caster].index_count, GL_UNSIGNED_INT,
+                               reinterpret_cast<void *>(chunks[caster].first_index * sizeof(std::uint32_t)));
+
+            shadow_map_changed = true;
+            ++shadow_cascades_drawn;
+            shadow_chunks_drawn += cascade.casters.size();
+        }
+
+        if (shadow_map_changed) {
+            glBindTexture(GL_TEXTURE_2D_ARRAY, shadow_map);
+            glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        }
+
+        ++shadow_frames;
+        shadow_report_time += dt;
+        if (shadow_report_time >= 1.f) {
+            std::cout << "Shadow: " << float(shadow_cascades_drawn) / shadow_frames << " cascades and "
+                      << float(shadow_chunks_drawn) / shadow_frames << " chunk draws per frame, texels";
+            for (auto const & cascade : cascades.cascades)
+                std::cout << " " << cascade.texel_size;
+            std::cout << " (whole scene fit " << glm::length(max - min) / shadow_map_resolution << ")" << std::endl;
+            shadow_report_time = 0.f;
+            shadow_frames = shadow_cascades_drawn = shadow_chunks_drawn = 0;
+        }
 
         glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
         glViewport(0, 0, width, height);
@@ -509,24 +572,15 @@ int main() try
         glEnable(GL_CULL_FACE);
         glCullFace(GL_BACK);
 
-        float near = 0.01f;
-        float far = 10.f;
-
-        glm::mat4 view(1.f);
-        view = glm::translate(view, {0.f, 0.f, -camera_distance});
-        view = glm::rotate(view, view_elevation, {1.f, 0.f, 0.f});
-        view = glm::rotate(view, view_azimuth, {0.f, 1.f, 0.f});
-
-        glm::mat4 projection = glm::mat4(1.f);
-        projection = glm::perspective(glm::pi<float>() / 2.f, (1.f * width) / height, near, far);
-
-        glBindTexture(GL_TEXTURE_2D, shadow_map);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, shadow_map);
 
         glUseProgram(program);
         glUniformMatrix4fv(model_location, 1, GL_FALSE, reinterpret_cast<float *>(&model));
         glUniformMatrix4fv(view_location, 1, GL_FALSE, reinterpret_cast<float *>(&view));
         glUniformMatrix4fv(projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&projection));
-        glUniformMatrix4fv(transform_location, 1, GL_FALSE, reinterpret_cast<float *>(&transform));
+        glUniformMatrix4fv(transform_location, cascade_transforms.size(), GL_FALSE, reinterpret_cast<float *>(cascade_transforms.data()));
+        glUniform1fv(cascade_split_location, cascade_splits.size(), cascade_splits.data());
+        glUniform1i(cascade_count_location, cascade_transforms.size());
 
         glUniform3f(ambient_location, 0.2f, 0.2f, 0.2f);
         glUniform3fv(light_direction_location, 1, reinterpret_cast<float *>(&light_direction));
@@ -539,7 +593,7 @@ int main() try
         glDrawElements(GL_TRIANGLES, scene.indices.size(), GL_UNSIGNED_INT, nullptr);
 
         glUseProgram(debug_program);
-        glBindTexture(GL_TEXTURE_2D, shadow_map);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, shadow_map);
         glBindVertexArray(debug_vao);
         glDrawArrays(GL_TRIANGLES, 0, 6);
 